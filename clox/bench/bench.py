@@ -0,0 +1,270 @@
+# Runs the benchmark suite against an optimized build of clox and compares
+# the results with a saved baseline
+# Usage: bench.py [options] [workload...]
+#   --trials=N          timed runs of each workload (default 10)
+#   --warmup=N          untimed runs before those (default 2)
+#   --save=FILE         write the results to FILE as JSON
+#   --baseline=FILE     compare with results saved earlier by --save
+#   --threshold=PERCENT slowdown of the median that counts as a regression
+#                       (default 5)
+#   --no-build          use the clox-bench binary as it is
+#   --list              list the workloads and exit
+# Exits with 1 if any workload regressed against the baseline.
+
+from collections import namedtuple
+import json
+from math import ceil
+from os import listdir, remove
+from os.path import basename, dirname, isfile, join, realpath, splitext
+import random
+import re
+from subprocess import DEVNULL, run
+import sys
+import tempfile
+import time
+
+BENCH_DIR = dirname(realpath(__file__))
+CLOX_DIR = dirname(BENCH_DIR)
+interpreter_args = [join(CLOX_DIR, 'clox-bench')]
+
+# Annotation in each .lox workload giving the work it does
+OPS_RE = re.compile(r'// bench: (\d+) (\w+)')
+
+# source is None for workloads read from path
+Workload = namedtuple('Workload', ['name', 'path', 'source', 'ops', 'unit'])
+
+def deep_scopes():
+    # Locals declared at every level of deeply nested blocks, used from the
+    # innermost one
+    depth = 40
+    iterations = 5000000
+    lines = []
+    for level in range(depth):
+        lines.append('    ' * level + '{')
+        lines.append('    ' * (level + 1) + 'var v{0} = {0};'.format(level))
+    inner = '    ' * depth
+    lines.append(inner + 'var sum = 0;')
+    lines.append(inner + 'for (var i = 0; i < {}; i = i + 1) {{'.format(
+        iterations))
+    lines.append(inner + '    sum = sum + v0 + v{0} + v{1} - i;'.format(
+        depth // 2, depth - 1))
+    lines.append(inner + '}')
+    lines.append(inner + 'print sum;')
+    for level in reversed(range(depth)):
+        lines.append('    ' * level + '}')
+    return '\n'.join(lines), iterations, 'iterations'
+
+def mixed_statements(rng, size, defined):
+    # Scanning-heavy statements that do little work at runtime, using only
+    # globals that have already been defined
+    lines = []
+    total = 0
+    while total < size:
+        kind = rng.random()
+        if kind < 0.2:
+            line = '"{0}" + "{1}";\n'.format(
+                'x' * rng.randint(1, 30), 'y' * rng.randint(1, 30))
+        elif kind < 0.4:
+            line = '{0}.{1} * {2} <= {3}; // {4}\n'.format(
+                rng.randint(0, 999), rng.randint(0, 99), rng.randint(1, 99),
+                rng.randint(0, 9999), 'note ' * rng.randint(0, 4))
+        else:
+            line = '(g{0} + {1}) * g{2} - {3};\n'.format(
+                rng.randint(0, defined - 1), rng.randint(0, 255),
+                rng.randint(0, defined - 1), rng.randint(0, 9))
+        lines.append(line)
+        total += len(line)
+    return lines
+
+def huge_source():
+    # Several megabytes of top-level code, compiled and run
+    rng = random.Random(39)
+    defined = 1000
+    lines = ['var g{0} = {0};\n'.format(i) for i in range(defined)]
+    lines += mixed_statements(rng, 3 * 1000 * 1000, defined)
+    source = ''.join(lines)
+    return source, len(source), 'bytes'
+
+def compile_only():
+    # The same kind of code as huge_source, all behind a branch that is
+    # never taken, so only compiling is measured
+    rng = random.Random(40)
+    defined = 1000
+    lines = ['var g{0} = {0};\n'.format(i) for i in range(defined)]
+    lines.append('if (false) {\n')
+    lines += mixed_statements(rng, 3 * 1000 * 1000, defined)
+    lines.append('}\n')
+    source = ''.join(lines)
+    return source, len(source), 'bytes'
+
+GENERATED = [deep_scopes, huge_source, compile_only]
+
+def workloads():
+    found = []
+    for name in sorted(listdir(BENCH_DIR)):
+        path = join(BENCH_DIR, name)
+        if not name.endswith('.lox') or not isfile(path):
+            continue
+        with open(path, 'r') as file:
+            match = OPS_RE.search(file.read())
+        if not match:
+            raise RuntimeError('{} has no "// bench:" line'.format(name))
+        found.append(Workload(splitext(name)[0], path, None,
+            int(match.group(1)), match.group(2)))
+    for generate in GENERATED:
+        found.append(Workload(generate.__name__, None, generate, 0, None))
+    return found
+
+def build():
+    result = run(['make', 'clox-bench'], cwd=CLOX_DIR)
+    if result.returncode != 0:
+        raise RuntimeError('could not build clox-bench')
+
+def time_run(path):
+    start = time.perf_counter()
+    result = run(interpreter_args + [path], stdout=DEVNULL)
+    elapsed = time.perf_counter() - start
+    if result.returncode != 0:
+        raise RuntimeError('clox exited with code {} running {}'.format(
+            result.returncode, path))
+    return elapsed
+
+def percentile(times, fraction):
+    # Nearest rank
+    ordered = sorted(times)
+    rank = max(1, ceil(fraction * len(ordered)))
+    return ordered[rank - 1]
+
+def median(times):
+    ordered = sorted(times)
+    middle = len(ordered) // 2
+    if len(ordered) % 2 == 1:
+        return ordered[middle]
+    return (ordered[middle - 1] + ordered[middle]) / 2
+
+def measure(workload, trials, warmup):
+    path = workload.path
+    ops = workload.ops
+    unit = workload.unit
+    temporary = None
+    if workload.source is not None:
+        source, ops, unit = workload.source()
+        with tempfile.NamedTemporaryFile('w', suffix='.lox',
+                delete=False) as file:
+            file.write(source)
+            temporary = path = file.name
+    try:
+        for _ in range(warmup):
+            time_run(path)
+        times = [time_run(path) for _ in range(trials)]
+    finally:
+        if temporary is not None:
+            remove(temporary)
+    middle = median(times)
+    return {
+        'median': middle,
+        'p95': percentile(times, 0.95),
+        'min': min(times),
+        'ops': ops,
+        'unit': unit,
+        'ops_per_sec': ops / middle,
+        'trials': trials,
+    }
+
+def compare(result, baseline, threshold):
+    # Returns the change in median as a fraction and a verdict
+    if baseline is None:
+        return None, ''
+    change = result['median'] / baseline['median'] - 1
+    if change > threshold:
+        return change, 'REGRESSION'
+    if change < -threshold:
+        return change, 'faster'
+    return change, ''
+
+def parse_args(argv):
+    options = {'trials': 10, 'warmup': 2, 'save': None, 'baseline': None,
+        'threshold': 5.0, 'build': True, 'list': False, 'names': []}
+    for arg in argv[1:]:
+        if arg.startswith('--trials='):
+            options['trials'] = int(arg[len('--trials='):])
+        elif arg.startswith('--warmup='):
+            options['warmup'] = int(arg[len('--warmup='):])
+        elif arg.startswith('--save='):
+            options['save'] = arg[len('--save='):]
+        elif arg.startswith('--baseline='):
+            options['baseline'] = arg[len('--baseline='):]
+        elif arg.startswith('--threshold='):
+            options['threshold'] = float(arg[len('--threshold='):])
+        elif arg == '--no-build':
+            options['build'] = False
+        elif arg == '--list':
+            options['list'] = True
+        elif arg.startswith('--'):
+            raise ValueError('unknown option {}'.format(arg))
+        else:
+            options['names'].append(arg)
+    if options['trials'] < 1 or options['warmup'] < 0:
+        raise ValueError('need at least one trial')
+    return options
+
+def main(argv):
+    try:
+        options = parse_args(argv)
+    except ValueError as error:
+        print('Usage: {} [options] [workload...]: {}'.format(
+            basename(argv[0]), error), file=sys.stderr)
+        return 64
+
+    suite = workloads()
+    if options['list']:
+        for workload in suite:
+            print(workload.name)
+        return 0
+    if options['names']:
+        known = {workload.name for workload in suite}
+        for name in options['names']:
+            if name not in known:
+                print('Unknown workload {}.'.format(name), file=sys.stderr)
+                return 64
+        suite = [w for w in suite if w.name in options['names']]
+
+    baseline = {}
+    if options['baseline'] is not None:
+        with open(options['baseline'], 'r') as file:
+            baseline = json.load(file)['workloads']
+
+    if options['build']:
+        build()
+
+    threshold = options['threshold'] / 100
+    results = {}
+    regressions = 0
+    print('{:<14} {:>10} {:>10} {:>12} {:<15} {:>8}'.format(
+        'workload', 'median s', 'p95 s', 'ops/sec', '', 'change'))
+    for workload in suite:
+        result = measure(workload, options['trials'], options['warmup'])
+        results[workload.name] = result
+        change, verdict = compare(result, baseline.get(workload.name),
+            threshold)
+        if verdict == 'REGRESSION':
+            regressions += 1
+        print('{:<14} {:>10.4f} {:>10.4f} {:>12.4g} {:<15} {:>8} {}'.format(
+            workload.name, result['median'], result['p95'],
+            result['ops_per_sec'], result['unit'],
+            '' if change is None else '{:+.1%}'.format(change), verdict))
+
+    if options['save'] is not None:
+        with open(options['save'], 'w') as file:
+            json.dump({'workloads': results}, file, indent=2, sort_keys=True)
+            file.write('\n')
+
+    if regressions > 0:
+        print('{} workload{} regressed by more than {}%.'.format(
+            regressions, '' if regressions == 1 else 's',
+            options['threshold']))
+        return 1
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
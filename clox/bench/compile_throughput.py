@@ -0,0 +1,86 @@
+# Measures how quickly clox compiles large sources, with and without the
+# scanner running on its own thread
+# Usage: compile_throughput.py [options]
+#   --megabytes=N   size of the generated source (default 16)
+#   --trials=N      timed runs of each mode (default 5)
+#   --no-build      use the clox-bench binary as it is
+
+from os import cpu_count, remove
+from os.path import join
+import random
+from subprocess import DEVNULL, run
+import sys
+import tempfile
+import time
+
+from bench import CLOX_DIR, build, median, mixed_statements
+
+MODES = [('single thread', '--no-pipeline'), ('pipelined', '--pipeline')]
+
+def generate(size):
+    # The globals mixed_statements uses, then the statements themselves
+    rng = random.Random(28)
+    defined = 1000
+    lines = ['var g{0} = {0};\n'.format(i) for i in range(defined)]
+    lines += mixed_statements(rng, size, defined)
+    return ''.join(lines)
+
+def time_run(args):
+    start = time.perf_counter()
+    result = run(args, stdout=DEVNULL)
+    elapsed = time.perf_counter() - start
+    if result.returncode != 0:
+        raise RuntimeError('clox exited with code {} running {}'.format(
+            result.returncode, ' '.join(args)))
+    return elapsed
+
+def parse_args(argv):
+    options = {'megabytes': 16.0, 'trials': 5, 'build': True}
+    for arg in argv[1:]:
+        if arg.startswith('--megabytes='):
+            options['megabytes'] = float(arg[len('--megabytes='):])
+        elif arg.startswith('--trials='):
+            options['trials'] = int(arg[len('--trials='):])
+        elif arg == '--no-build':
+            options['build'] = False
+        else:
+            raise ValueError('unknown option {}'.format(arg))
+    if options['megabytes'] <= 0 or options['trials'] < 1:
+        raise ValueError('need some source and at least one trial')
+    return options
+
+def main(argv):
+    try:
+        options = parse_args(argv)
+    except ValueError as error:
+        print('Usage: {} [options]: {}'.format(argv[0], error),
+            file=sys.stderr)
+        return 64
+
+    if options['build']:
+        build()
+    binary = join(CLOX_DIR, 'clox-bench')
+
+    source = generate(int(options['megabytes'] * 1e6))
+    with tempfile.NamedTemporaryFile('w', suffix='.lox',
+            delete=False) as file:
+        file.write(source)
+        path = file.name
+
+    print('{:.1f} MB source, {} cores'.format(len(source) / 1e6, cpu_count()))
+    try:
+        baseline = None
+        for name, option in MODES:
+            elapsed = median([time_run([binary, option, path])
+                for _ in range(options['trials'])])
+            if baseline is None:
+                baseline = elapsed
+            print('{:>14}: {:.3f} s, {:.1f} MB/s, {:.2f}x'.format(
+                name, elapsed, len(source) / 1e6 / elapsed,
+                baseline / elapsed))
+    finally:
+        remove(path)
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -0,0 +1,92 @@
+# Measures how long clox takes to print the first line of a large script,
+# with and without running top-level code while compiling
+# Usage: first_output_latency.py [options]
+#   --megabytes=N   size of the generated source (default 16)
+#   --trials=N      timed runs of each mode (default 5)
+#   --no-build      use the clox-bench binary as it is
+
+from os import remove
+from os.path import join
+from subprocess import PIPE, Popen
+import sys
+import tempfile
+import time
+
+from bench import CLOX_DIR, build, median
+
+MODES = [('whole file', []), ('incremental', ['--incremental'])]
+
+def generate(size):
+    lines = ['print "first";\n']
+    total = 0
+    index = 0
+    while total < size:
+        line = 'var value_{0} = {0} * 2 + {1}; // filler\n'.format(
+            index, index % 7)
+        lines.append(line)
+        total += len(line)
+        index += 1
+    lines.append('print "last";\n')
+    return ''.join(lines)
+
+def time_output(args):
+    # Returns seconds to the first line of output and to exit
+    start = time.perf_counter()
+    proc = Popen(args, stdout=PIPE)
+    first = proc.stdout.readline()
+    first_time = time.perf_counter() - start
+    proc.stdout.read()
+    proc.wait()
+    total_time = time.perf_counter() - start
+    if proc.returncode != 0 or first != b'first\n':
+        raise RuntimeError('clox exited with code {} running {}'.format(
+            proc.returncode, ' '.join(args)))
+    return first_time, total_time
+
+def parse_args(argv):
+    options = {'megabytes': 16.0, 'trials': 5, 'build': True}
+    for arg in argv[1:]:
+        if arg.startswith('--megabytes='):
+            options['megabytes'] = float(arg[len('--megabytes='):])
+        elif arg.startswith('--trials='):
+            options['trials'] = int(arg[len('--trials='):])
+        elif arg == '--no-build':
+            options['build'] = False
+        else:
+            raise ValueError('unknown option {}'.format(arg))
+    if options['megabytes'] <= 0 or options['trials'] < 1:
+        raise ValueError('need some source and at least one trial')
+    return options
+
+def main(argv):
+    try:
+        options = parse_args(argv)
+    except ValueError as error:
+        print('Usage: {} [options]: {}'.format(argv[0], error),
+            file=sys.stderr)
+        return 64
+
+    if options['build']:
+        build()
+    binary = join(CLOX_DIR, 'clox-bench')
+
+    source = generate(int(options['megabytes'] * 1e6))
+    with tempfile.NamedTemporaryFile('w', suffix='.lox',
+            delete=False) as file:
+        file.write(source)
+        path = file.name
+
+    print('{:.1f} MB source'.format(len(source) / 1e6))
+    try:
+        for name, flags in MODES:
+            times = [time_output([binary] + flags + [path])
+                for _ in range(options['trials'])]
+            print('{:>12}: first output {:.4f} s, total {:.3f} s'.format(
+                name, median([first for first, _ in times]),
+                median([total for _, total in times])))
+    finally:
+        remove(path)
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
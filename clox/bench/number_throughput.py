@@ -0,0 +1,87 @@
+# Measures how quickly clox compiles number literals
+# Usage: number_throughput.py [options]
+#   --literals=N    literals in the generated source (default 1000000)
+#   --trials=N      timed runs (default 5)
+#   --no-build      use the clox-bench binary as it is
+
+from os import remove
+from os.path import join
+import random
+from subprocess import DEVNULL, run
+import sys
+import tempfile
+import time
+
+from bench import CLOX_DIR, build, median, percentile
+
+def generate(count):
+    # Mix of short floats, long floats and integers, wrapped in expression
+    # statements so the time is dominated by compilation
+    rng = random.Random(26)
+    lines = []
+    for i in range(count):
+        kind = i % 3
+        if kind == 0:
+            lines.append('{}.{};'.format(
+                rng.randint(0, 99999), rng.randint(0, 9999)))
+        elif kind == 1:
+            lines.append('{:.17f};'.format(rng.uniform(0, 1)))
+        else:
+            lines.append('{};'.format(rng.randint(0, 2 ** 62)))
+    return '\n'.join(lines) + '\n'
+
+def time_run(args):
+    start = time.perf_counter()
+    result = run(args, stdout=DEVNULL)
+    elapsed = time.perf_counter() - start
+    if result.returncode != 0:
+        raise RuntimeError('clox exited with code {} running {}'.format(
+            result.returncode, ' '.join(args)))
+    return elapsed
+
+def parse_args(argv):
+    options = {'literals': 1000000, 'trials': 5, 'build': True}
+    for arg in argv[1:]:
+        if arg.startswith('--literals='):
+            options['literals'] = int(arg[len('--literals='):])
+        elif arg.startswith('--trials='):
+            options['trials'] = int(arg[len('--trials='):])
+        elif arg == '--no-build':
+            options['build'] = False
+        else:
+            raise ValueError('unknown option {}'.format(arg))
+    if options['literals'] < 1 or options['trials'] < 1:
+        raise ValueError('need at least one literal and one trial')
+    return options
+
+def main(argv):
+    try:
+        options = parse_args(argv)
+    except ValueError as error:
+        print('Usage: {} [options]: {}'.format(argv[0], error),
+            file=sys.stderr)
+        return 64
+
+    if options['build']:
+        build()
+    binary = join(CLOX_DIR, 'clox-bench')
+
+    count = options['literals']
+    source = generate(count)
+    with tempfile.NamedTemporaryFile('w', suffix='.lox',
+            delete=False) as file:
+        file.write(source)
+        path = file.name
+    try:
+        times = [time_run([binary, path]) for _ in range(options['trials'])]
+    finally:
+        remove(path)
+
+    middle = median(times)
+    print('{} literals ({:.1f} MB): median {:.3f} s, p90 {:.3f} s, '
+        '{:.2f} M literals/s'.format(count, len(source) / 1e6, middle,
+        percentile(times, 0.90), count / middle / 1e6))
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -0,0 +1,100 @@
+# Measures how many lines per second clox prints, for each kind of value
+# and each --flush policy
+# Usage: print_throughput.py [options]
+#   --lines=N         lines each workload prints (default 1000000)
+#   --trials=N        timed runs of each (default 5)
+#   --against=BINARY  also time another build of clox, such as one from
+#                     before output was buffered, run without --flush
+#   --no-build        use the clox-bench binary as it is
+# Output goes to /dev/null, so what is timed is the interpreter's own work.
+
+from os import remove
+from os.path import join
+from subprocess import DEVNULL, run
+import sys
+import tempfile
+import time
+
+from bench import CLOX_DIR, build, median
+
+POLICIES = ['line', 'size', 'exit']
+
+def workloads(lines):
+    # Each prints lines lines from a loop
+    return [
+        ('integers', 'for (var i = 0; i < {0}; i = i + 1) {{ print i * 7919; }}'
+            .format(lines)),
+        ('floats', 'for (var i = 0; i < {0}; i = i + 1) {{ print i * 0.37; }}'
+            .format(lines)),
+        ('strings', 'var s = "a line of a report";\n'
+            'for (var i = 0; i < {0}; i = i + 1) {{ print s; }}'
+            .format(lines)),
+        ('mixed', 'for (var i = 0; i < {0}; i = i + 1) {{\n'
+            '    print "row";\n'
+            '    print i;\n'
+            '    print i / 8.0;\n'
+            '}}'.format(lines // 3)),
+    ]
+
+def time_run(args):
+    start = time.perf_counter()
+    result = run(args, stdout=DEVNULL)
+    elapsed = time.perf_counter() - start
+    if result.returncode != 0:
+        raise RuntimeError('clox exited with code {} running {}'.format(
+            result.returncode, ' '.join(args)))
+    return elapsed
+
+def parse_args(argv):
+    options = {'lines': 1000000, 'trials': 5, 'against': None,
+        'build': True}
+    for arg in argv[1:]:
+        if arg.startswith('--lines='):
+            options['lines'] = int(arg[len('--lines='):])
+        elif arg.startswith('--trials='):
+            options['trials'] = int(arg[len('--trials='):])
+        elif arg.startswith('--against='):
+            options['against'] = arg[len('--against='):]
+        elif arg == '--no-build':
+            options['build'] = False
+        else:
+            raise ValueError('unknown option {}'.format(arg))
+    if options['lines'] < 3 or options['trials'] < 1:
+        raise ValueError('need at least three lines and one trial')
+    return options
+
+def main(argv):
+    try:
+        options = parse_args(argv)
+    except ValueError as error:
+        print('Usage: {} [options]: {}'.format(argv[0], error),
+            file=sys.stderr)
+        return 64
+
+    if options['build']:
+        build()
+    binary = join(CLOX_DIR, 'clox-bench')
+    modes = [(policy, [binary, '--flush=' + policy]) for policy in POLICIES]
+    if options['against'] is not None:
+        modes.append(('against', [options['against']]))
+
+    print('{:<10} {:<8} {:>10} {:>12}'.format('workload', 'mode', 'median s',
+        'lines/s'))
+    for name, source in workloads(options['lines']):
+        with tempfile.NamedTemporaryFile('w', suffix='.lox',
+                delete=False) as file:
+            file.write(source)
+            path = file.name
+        try:
+            for mode, args in modes:
+                times = [time_run(args + [path])
+                    for _ in range(options['trials'])]
+                middle = median(times)
+                print('{:<10} {:<8} {:>10.4f} {:>12.0f}'.format(name, mode,
+                    middle, options['lines'] / middle))
+        finally:
+            remove(path)
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
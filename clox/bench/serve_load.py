@@ -0,0 +1,220 @@
+# Sends requests to a clox --serve daemon from several connections at once
+# and reports requests per second and latency percentiles
+# Usage: serve_load.py [options] [script]
+#   --socket=PATH       use the server already listening at PATH instead of
+#                       starting clox-bench --serve
+#   --workers=N         worker threads of the server started (default 4)
+#   --connections=N     requests in flight at once (default 4)
+#   --duration=SECONDS  how long to send requests for (default 5)
+#   --file              name the script by its path instead of sending its
+#                       source
+#   --instructions=N    instruction limit of each request (default none)
+#   --memory=BYTES      memory limit of each request (default none)
+#   --process           also run the script in a new process per request,
+#                       for comparison
+#   --no-build          use the clox-bench binary as it is
+# The script defaults to a small one that loops and prints.
+
+import os
+from os.path import abspath, join
+import socket
+from subprocess import DEVNULL, Popen, run
+import sys
+import tempfile
+import threading
+import time
+
+from bench import CLOX_DIR, build, median, percentile
+
+DEFAULT_SCRIPT = '''var total = 0;
+for (var i = 0; i < 2000; i = i + 1) {
+    total = total + i * 2;
+}
+print "total: " + "done";
+print total;
+'''
+
+class Connection:
+    def __init__(self, path):
+        self.socket = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.socket.connect(path)
+        self.reader = self.socket.makefile('rb')
+
+    def request(self, header, body):
+        # Returns the exit code and the output
+        self.socket.sendall(header + body)
+        output = []
+        while True:
+            line = self.reader.readline()
+            if not line:
+                raise RuntimeError('server closed the connection')
+            kind, value = line.split()
+            if kind == b'exit':
+                return int(value), b''.join(output)
+            data = self.reader.read(int(value))
+            if kind == b'out':
+                output.append(data)
+
+    def close(self):
+        self.reader.close()
+        self.socket.close()
+
+def wait_for_socket(path, server):
+    for _ in range(500):
+        if server.poll() is not None:
+            raise RuntimeError('server exited with code {}'.format(
+                server.returncode))
+        try:
+            Connection(path).close()
+            return
+        except OSError:
+            time.sleep(0.01)
+    raise RuntimeError('server did not start listening')
+
+def drive(send, connections, duration):
+    # Calls send from each of connections threads until duration is up
+    # Returns the latencies of every request and the number that failed
+    latencies = []
+    failures = [0]
+    lock = threading.Lock()
+    deadline = time.perf_counter() + duration
+
+    def loop():
+        mine = []
+        failed = 0
+        state = {}
+        while time.perf_counter() < deadline:
+            start = time.perf_counter()
+            if send(state) != 0:
+                failed += 1
+            mine.append(time.perf_counter() - start)
+        if 'connection' in state:
+            state['connection'].close()
+        with lock:
+            latencies.extend(mine)
+            failures[0] += failed
+
+    threads = [threading.Thread(target=loop) for _ in range(connections)]
+    start = time.perf_counter()
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    return latencies, failures[0], time.perf_counter() - start
+
+def report(name, latencies, failures, elapsed):
+    if not latencies:
+        print('{}: no requests finished'.format(name))
+        return
+    print('{:<8} {:>9} {:>7} {:>10.1f} {:>8.3f} {:>8.3f} {:>8.3f} {:>8.3f} '
+        '{:>8.3f}'.format(name, len(latencies), failures,
+        len(latencies) / elapsed, 1000 * median(latencies),
+        1000 * percentile(latencies, 0.90),
+        1000 * percentile(latencies, 0.99),
+        1000 * percentile(latencies, 0.999), 1000 * max(latencies)))
+
+def parse_args(argv):
+    options = {'socket': None, 'workers': 4, 'connections': 4,
+        'duration': 5.0, 'file': False, 'instructions': 0, 'memory': 0,
+        'process': False, 'build': True, 'script': None}
+    for arg in argv[1:]:
+        if arg.startswith('--socket='):
+            options['socket'] = arg[len('--socket='):]
+        elif arg.startswith('--workers='):
+            options['workers'] = int(arg[len('--workers='):])
+        elif arg.startswith('--connections='):
+            options['connections'] = int(arg[len('--connections='):])
+        elif arg.startswith('--duration='):
+            options['duration'] = float(arg[len('--duration='):])
+        elif arg == '--file':
+            options['file'] = True
+        elif arg.startswith('--instructions='):
+            options['instructions'] = int(arg[len('--instructions='):])
+        elif arg.startswith('--memory='):
+            options['memory'] = int(arg[len('--memory='):])
+        elif arg == '--process':
+            options['process'] = True
+        elif arg == '--no-build':
+            options['build'] = False
+        elif arg.startswith('--'):
+            raise ValueError('unknown option {}'.format(arg))
+        elif options['script'] is None:
+            options['script'] = arg
+        else:
+            raise ValueError('only one script can be given')
+    if options['workers'] < 1 or options['connections'] < 1:
+        raise ValueError('need at least one worker and connection')
+    return options
+
+def main(argv):
+    try:
+        options = parse_args(argv)
+    except ValueError as error:
+        print('Usage: {} [options] [script]: {}'.format(argv[0], error),
+            file=sys.stderr)
+        return 64
+
+    temporary = None
+    script = options['script']
+    if script is None:
+        with tempfile.NamedTemporaryFile('w', suffix='.lox',
+                delete=False) as file:
+            file.write(DEFAULT_SCRIPT)
+            temporary = script = file.name
+    script = abspath(script)
+    with open(script, 'rb') as file:
+        source = file.read()
+    limits = '{} {}'.format(options['instructions'], options['memory'])
+    if options['file']:
+        header = 'file {} {}\n'.format(limits, script).encode()
+        body = b''
+    else:
+        header = 'source {} {}\n'.format(limits, len(source)).encode()
+        body = source
+
+    if options['build']:
+        build()
+    binary = join(CLOX_DIR, 'clox-bench')
+
+    server = None
+    socket_dir = None
+    path = options['socket']
+    try:
+        if path is None:
+            socket_dir = tempfile.mkdtemp()
+            path = join(socket_dir, 'clox.sock')
+            server = Popen([binary, '--serve=' + path,
+                '--jobs={}'.format(options['workers'])])
+            wait_for_socket(path, server)
+
+        def send_request(state):
+            if 'connection' not in state:
+                state['connection'] = Connection(path)
+            status, _ = state['connection'].request(header, body)
+            return status
+
+        def send_process(state):
+            return run([binary, script], stdout=DEVNULL).returncode
+
+        print('{:<8} {:>9} {:>7} {:>10} {:>8} {:>8} {:>8} {:>8} {:>8}'.format(
+            'mode', 'requests', 'failed', 'req/s', 'p50 ms', 'p90 ms',
+            'p99 ms', 'p99.9 ms', 'max ms'))
+        report('serve', *drive(send_request, options['connections'],
+            options['duration']))
+        if options['process']:
+            report('process', *drive(send_process, options['connections'],
+                options['duration']))
+    finally:
+        if server is not None:
+            server.terminate()
+            server.wait()
+        if socket_dir is not None:
+            if os.path.exists(path):
+                os.remove(path)
+            os.rmdir(socket_dir)
+        if temporary is not None:
+            os.remove(temporary)
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -0,0 +1,124 @@
+# Measures how long clox takes to start a script that depends on a large
+# prelude, running the prelude each time against restoring a snapshot of
+# the globals it defines
+# Usage: startup.py [options]
+#   --globals=N     globals the generated prelude defines (default 20000)
+#   --trials=N      timed runs of each way of starting (default 20)
+#   --no-build      use the clox-bench binary as it is
+
+from os.path import getsize, join
+from subprocess import DEVNULL, run
+import shutil
+import sys
+import tempfile
+import time
+
+from bench import CLOX_DIR, build, median, percentile
+
+def prelude(count):
+    # Strings, consts and globals computed by short loops, in equal parts
+    lines = []
+    for i in range(count):
+        kind = i % 3
+        if kind == 0:
+            lines.append('var name{0} = "value of global number {0}";'.format(
+                i))
+        elif kind == 1:
+            lines.append('const LIMIT{0} = {0} * 7 + 3;'.format(i))
+        else:
+            lines.append('var sum{0} = 0;'.format(i))
+            lines.append('for (var j = 0; j < 10; j = j + 1) '
+                '{{ sum{0} = sum{0} + j * {0}; }}'.format(i))
+    return '\n'.join(lines) + '\n'
+
+def script(count):
+    # Uses a few of the prelude's globals
+    last = count - count % 3
+    return '\n'.join([
+        'print name0 + " and " + name{};'.format(max(0, last - 3)),
+        'print LIMIT1 + LIMIT{};'.format(max(1, last - 2)),
+        'print sum2;',
+        '',
+    ])
+
+def time_run(args):
+    start = time.perf_counter()
+    result = run(args, stdout=DEVNULL)
+    elapsed = time.perf_counter() - start
+    if result.returncode != 0:
+        raise RuntimeError('clox exited with code {} running {}'.format(
+            result.returncode, ' '.join(args)))
+    return elapsed
+
+def parse_args(argv):
+    options = {'globals': 20000, 'trials': 20, 'build': True}
+    for arg in argv[1:]:
+        if arg.startswith('--globals='):
+            options['globals'] = int(arg[len('--globals='):])
+        elif arg.startswith('--trials='):
+            options['trials'] = int(arg[len('--trials='):])
+        elif arg == '--no-build':
+            options['build'] = False
+        else:
+            raise ValueError('unknown option {}'.format(arg))
+    if options['globals'] < 3 or options['trials'] < 1:
+        raise ValueError('need at least three globals and one trial')
+    return options
+
+def main(argv):
+    try:
+        options = parse_args(argv)
+    except ValueError as error:
+        print('Usage: {} [options]: {}'.format(argv[0], error),
+            file=sys.stderr)
+        return 64
+
+    if options['build']:
+        build()
+    binary = join(CLOX_DIR, 'clox-bench')
+
+    directory = tempfile.mkdtemp()
+    try:
+        prelude_path = join(directory, 'prelude.lox')
+        script_path = join(directory, 'script.lox')
+        whole_path = join(directory, 'whole.lox')
+        image_path = join(directory, 'prelude.img')
+        with open(prelude_path, 'w') as file:
+            file.write(prelude(options['globals']))
+        with open(script_path, 'w') as file:
+            file.write(script(options['globals']))
+        with open(whole_path, 'w') as file:
+            file.write(prelude(options['globals']))
+            file.write(script(options['globals']))
+
+        save_time = time_run([binary, '--save-snapshot=' + image_path,
+            prelude_path])
+        whole = [binary, whole_path]
+        restored = [binary, '--snapshot=' + image_path, script_path]
+        expected = run(whole, capture_output=True).stdout
+        if run(restored, capture_output=True).stdout != expected:
+            raise RuntimeError('the snapshot gave different output')
+
+        # Interleaved so that both see the same noise
+        times = {'prelude': [], 'snapshot': []}
+        for _ in range(options['trials']):
+            times['prelude'].append(time_run(whole))
+            times['snapshot'].append(time_run(restored))
+
+        print('prelude: {} globals, {} bytes of source, {} byte image saved '
+            'in {:.1f} ms'.format(options['globals'], getsize(prelude_path),
+            getsize(image_path), 1000 * save_time))
+        print('{:<9} {:>8} {:>8} {:>8}'.format('start', 'p50 ms', 'p90 ms',
+            'min ms'))
+        for name, measured in times.items():
+            print('{:<9} {:>8.2f} {:>8.2f} {:>8.2f}'.format(name,
+                1000 * median(measured), 1000 * percentile(measured, 0.90),
+                1000 * min(measured)))
+        print('speedup   {:>7.1f}x'.format(
+            median(times['prelude']) / median(times['snapshot'])))
+    finally:
+        shutil.rmtree(directory)
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
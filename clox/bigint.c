@@ -0,0 +1,580 @@
+#include <string.h>
+
+#include "bigint.h"
+#include "memory.h"
+
+#ifdef CLOX_BIG_INTEGERS
+
+#define LIMB_BITS 32
+#define LIMB_BASE ((uint64_t)1 << LIMB_BITS)
+// Largest power of ten in a limb, which decimal text is converted by
+#define DECIMAL_BASE 1000000000u
+#define DECIMAL_DIGITS 9
+// Multiplications with a shorter operand are done the schoolbook way
+#define KARATSUBA_THRESHOLD 40
+// Scratch space up to this many limbs is kept on the stack
+#define SCRATCH_LIMBS 32
+
+// An integer of either size as a sign and magnitude. A small one's limbs
+// are held in storage, so an operand must not be copied.
+typedef struct {
+    bool negative;
+    int count;
+    const uint32_t* limbs;
+    uint32_t storage[2];
+} Operand;
+
+static void toOperand(Value value, Operand* operand) {
+    if (IS_INT(value)) {
+        int64_t vint = AS_INT(value);
+        uint64_t magnitude = vint < 0 ? (uint64_t)0 - (uint64_t)vint :
+            (uint64_t)vint;
+        operand->negative = vint < 0;
+        operand->storage[0] = (uint32_t)magnitude;
+        operand->storage[1] = (uint32_t)(magnitude >> LIMB_BITS);
+        operand->count = operand->storage[1] != 0 ? 2 :
+            operand->storage[0] != 0 ? 1 : 0;
+        operand->limbs = operand->storage;
+    }
+    else {
+        ObjBigInt* big = AS_BIGINT(value);
+        operand->negative = big->negative;
+        operand->count = big->count;
+        operand->limbs = big->limbs;
+    }
+}
+
+static uint32_t* takeScratch(uint32_t* local, int count) {
+    if (count <= SCRATCH_LIMBS) {
+        return local;
+    }
+    return ALLOCATE(uint32_t, count, false, MEM_BIG_INTEGERS);
+}
+
+static void releaseScratch(uint32_t* local, uint32_t* scratch, int count) {
+    if (scratch != local) {
+        FREE_ARRAY(uint32_t, scratch, count, MEM_BIG_INTEGERS);
+    }
+}
+
+// Drops the most significant limbs that are zero, returning how many are
+// left
+static int trim(const uint32_t* limbs, int count) {
+    while (count > 0 && limbs[count - 1] == 0) {
+        count--;
+    }
+    return count;
+}
+
+static int compareMagnitudes(const uint32_t* a, int aCount,
+        const uint32_t* b, int bCount) {
+    if (aCount != bCount) {
+        return aCount < bCount ? -1 : 1;
+    }
+    for (int i = aCount - 1; i >= 0; i--) {
+        if (a[i] != b[i]) {
+            return a[i] < b[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+// Adds b to the out, which is outCount limbs and at least as long as b,
+// returning the carry out of the top
+static uint32_t addInto(uint32_t* out, int outCount, const uint32_t* b,
+        int bCount) {
+    uint64_t carry = 0;
+    int i = 0;
+    for (; i < bCount; i++) {
+        uint64_t sum = (uint64_t)out[i] + b[i] + carry;
+        out[i] = (uint32_t)sum;
+        carry = sum >> LIMB_BITS;
+    }
+    for (; carry != 0 && i < outCount; i++) {
+        uint64_t sum = (uint64_t)out[i] + carry;
+        out[i] = (uint32_t)sum;
+        carry = sum >> LIMB_BITS;
+    }
+    return (uint32_t)carry;
+}
+
+// Subtracts b from out, which is outCount limbs and no less than b
+static void subtractFrom(uint32_t* out, int outCount, const uint32_t* b,
+        int bCount) {
+    uint64_t borrow = 0;
+    int i = 0;
+    for (; i < bCount; i++) {
+        uint64_t difference = (uint64_t)out[i] - b[i] - borrow;
+        out[i] = (uint32_t)difference;
+        borrow = (difference >> LIMB_BITS) != 0;
+    }
+    for (; borrow != 0 && i < outCount; i++) {
+        uint64_t difference = (uint64_t)out[i] - borrow;
+        out[i] = (uint32_t)difference;
+        borrow = (difference >> LIMB_BITS) != 0;
+    }
+}
+
+// out is aCount + bCount limbs and overlaps neither operand
+static void multiplySchoolbook(uint32_t* out, const uint32_t* a, int aCount,
+        const uint32_t* b, int bCount) {
+    memset(out, 0, sizeof(uint32_t) * (size_t)bCount);
+    for (int i = 0; i < aCount; i++) {
+        uint64_t carry = 0;
+        for (int j = 0; j < bCount; j++) {
+            uint64_t product = (uint64_t)a[i] * b[j] + out[i + j] + carry;
+            out[i + j] = (uint32_t)product;
+            carry = product >> LIMB_BITS;
+        }
+        out[i + bCount] = (uint32_t)carry;
+    }
+}
+
+static bool multiplyMagnitudes(uint32_t* out, const uint32_t* a, int aCount,
+    const uint32_t* b, int bCount);
+
+// Splits both operands at half the longer one's length m:
+//   a * b = z2 * B^2m + ((a0 + a1)(b0 + b1) - z2 - z0) * B^m + z0
+// aCount >= bCount > m
+// Returns false for failed allocation
+static bool multiplyKaratsuba(uint32_t* out, const uint32_t* a, int aCount,
+        const uint32_t* b, int bCount) {
+    int m = (aCount + 1) / 2;
+    int sumCount = m + 1;
+    int middleCount = 2 * sumCount;
+    int scratchCount = 2 * sumCount + middleCount;
+    uint32_t* scratch = ALLOCATE(uint32_t, scratchCount, false,
+        MEM_BIG_INTEGERS);
+    if (scratch == NULL) {
+        return false;
+    }
+    uint32_t* aSum = scratch;
+    uint32_t* bSum = scratch + sumCount;
+    uint32_t* middle = scratch + 2 * sumCount;
+
+    // z0 and z2 go straight into place
+    bool multiplied = multiplyMagnitudes(out, a, m, b, m) &&
+        multiplyMagnitudes(out + 2 * m, a + m, aCount - m, b + m, bCount - m);
+    if (multiplied) {
+        memcpy(aSum, a, sizeof(uint32_t) * (size_t)m);
+        aSum[m] = addInto(aSum, m, a + m, aCount - m);
+        memcpy(bSum, b, sizeof(uint32_t) * (size_t)m);
+        bSum[m] = addInto(bSum, m, b + m, bCount - m);
+        multiplied = multiplyMagnitudes(middle, aSum, sumCount,
+            bSum, sumCount);
+    }
+    if (multiplied) {
+        subtractFrom(middle, middleCount, out, 2 * m);
+        subtractFrom(middle, middleCount, out + 2 * m,
+            aCount + bCount - 2 * m);
+        addInto(out + m, aCount + bCount - m, middle,
+            trim(middle, middleCount));
+    }
+    FREE_ARRAY(uint32_t, scratch, scratchCount, MEM_BIG_INTEGERS);
+    return multiplied;
+}
+
+// out is aCount + bCount limbs and overlaps neither operand
+// Returns false for failed allocation
+static bool multiplyMagnitudes(uint32_t* out, const uint32_t* a, int aCount,
+        const uint32_t* b, int bCount) {
+    if (aCount < bCount) {
+        const uint32_t* swap = a;
+        a = b;
+        b = swap;
+        int swapCount = aCount;
+        aCount = bCount;
+        bCount = swapCount;
+    }
+    if (bCount < KARATSUBA_THRESHOLD) {
+        multiplySchoolbook(out, a, aCount, b, bCount);
+        return true;
+    }
+    if (bCount > (aCount + 1) / 2) {
+        return multiplyKaratsuba(out, a, aCount, b, bCount);
+    }
+
+    // Too lopsided to split evenly, so a is taken in pieces as long as b
+    uint32_t* piece = ALLOCATE(uint32_t, 2 * bCount, false,
+        MEM_BIG_INTEGERS);
+    if (piece == NULL) {
+        return false;
+    }
+    memset(out, 0, sizeof(uint32_t) * (size_t)(aCount + bCount));
+    bool multiplied = true;
+    for (int i = 0; multiplied && i < aCount; i += bCount) {
+        int pieceCount = aCount - i < bCount ? aCount - i : bCount;
+        multiplied = multiplyMagnitudes(piece, a + i, pieceCount, b, bCount);
+        if (multiplied) {
+            addInto(out + i, aCount + bCount - i, piece,
+                pieceCount + bCount);
+        }
+    }
+    FREE_ARRAY(uint32_t, piece, 2 * bCount, MEM_BIG_INTEGERS);
+    return multiplied;
+}
+
+// Divides limbs in place by a single limb, returning the remainder
+static uint32_t divideBySmall(uint32_t* limbs, int count, uint32_t divisor) {
+    uint64_t remainder = 0;
+    for (int i = count - 1; i >= 0; i--) {
+        uint64_t current = (remainder << LIMB_BITS) | limbs[i];
+        limbs[i] = (uint32_t)(current / divisor);
+        remainder = current % divisor;
+    }
+    return (uint32_t)remainder;
+}
+
+// Knuth's algorithm D, writing the uCount - vCount + 1 limbs of the quotient
+// to quotient. uCount >= vCount >= 2 and the top limb of v is not zero.
+// Returns false for failed allocation
+static bool divideMagnitudes(uint32_t* quotient, const uint32_t* u,
+        int uCount, const uint32_t* v, int vCount) {
+    uint32_t local[SCRATCH_LIMBS];
+    int scratchCount = uCount + 1 + vCount;
+    uint32_t* scratch = takeScratch(local, scratchCount);
+    if (scratch == NULL) {
+        return false;
+    }
+    uint32_t* un = scratch;
+    uint32_t* vn = scratch + uCount + 1;
+
+    // Normalized so that the divisor's top bit is set, which keeps each
+    // estimated quotient limb at most two too large
+    int shift = __builtin_clz(v[vCount - 1]);
+    for (int i = vCount - 1; i > 0; i--) {
+        vn[i] = (v[i] << shift) |
+            (shift == 0 ? 0 : v[i - 1] >> (LIMB_BITS - shift));
+    }
+    vn[0] = v[0] << shift;
+    un[uCount] = shift == 0 ? 0 : u[uCount - 1] >> (LIMB_BITS - shift);
+    for (int i = uCount - 1; i > 0; i--) {
+        un[i] = (u[i] << shift) |
+            (shift == 0 ? 0 : u[i - 1] >> (LIMB_BITS - shift));
+    }
+    un[0] = u[0] << shift;
+
+    for (int j = uCount - vCount; j >= 0; j--) {
+        uint64_t top = ((uint64_t)un[j + vCount] << LIMB_BITS) |
+            un[j + vCount - 1];
+        uint64_t estimate = top / vn[vCount - 1];
+        uint64_t rest = top % vn[vCount - 1];
+        while (estimate >= LIMB_BASE || estimate * vn[vCount - 2] >
+                ((rest << LIMB_BITS) | un[j + vCount - 2])) {
+            estimate--;
+            rest += vn[vCount - 1];
+            if (rest >= LIMB_BASE) {
+                break;
+            }
+        }
+
+        // Subtract estimate * vn from the window of un
+        int64_t borrow = 0;
+        int64_t difference;
+        for (int i = 0; i < vCount; i++) {
+            uint64_t product = estimate * vn[i];
+            difference = (int64_t)un[i + j] - borrow -
+                (int64_t)(product & 0xFFFFFFFF);
+            un[i + j] = (uint32_t)difference;
+            borrow = (int64_t)(product >> LIMB_BITS) - (difference >> 32);
+        }
+        difference = (int64_t)un[j + vCount] - borrow;
+        un[j + vCount] = (uint32_t)difference;
+
+        quotient[j] = (uint32_t)estimate;
+        if (difference < 0) {
+            // The estimate was one too large, so vn is added back
+            quotient[j]--;
+            uint64_t carry = 0;
+            for (int i = 0; i < vCount; i++) {
+                uint64_t sum = (uint64_t)un[i + j] + vn[i] + carry;
+                un[i + j] = (uint32_t)sum;
+                carry = sum >> LIMB_BITS;
+            }
+            un[j + vCount] += (uint32_t)carry;
+        }
+    }
+    releaseScratch(local, scratch, scratchCount);
+    return true;
+}
+
+// Frees a big integer that is not used after all
+// big must be the object most recently allocated in freeList
+static void discardBigInt(FreeList* freeList, ObjBigInt* big) {
+    freeList->head = big->obj.next;
+    reallocate(big, BIGINT_SIZE(big->capacity), 0, false, MEM_BIG_INTEGERS);
+}
+
+// Turns a big integer whose limbs have been filled in into a value, which
+// is a small integer if it fits, discarding the object
+// big must be the object most recently allocated in freeList
+static Value finishBigInt(FreeList* freeList, ObjBigInt* big, int count,
+        bool negative) {
+    count = trim(big->limbs, count);
+    if (count <= 2) {
+        uint64_t magnitude = count == 0 ? 0 : big->limbs[0];
+        if (count == 2) {
+            magnitude |= (uint64_t)big->limbs[1] << LIMB_BITS;
+        }
+        if (magnitude <= (uint64_t)INT64_MAX ||
+                (negative && magnitude == (uint64_t)INT64_MAX + 1)) {
+            discardBigInt(freeList, big);
+            if (magnitude == (uint64_t)INT64_MAX + 1) {
+                return INT_VAL(INT64_MIN);
+            }
+            return INT_VAL(negative ? -(int64_t)magnitude :
+                (int64_t)magnitude);
+        }
+    }
+    big->negative = negative;
+    big->count = count;
+    big->hash = hashString((const char*)big->limbs,
+        (int)sizeof(uint32_t) * count);
+    if (negative) {
+        big->hash = ~big->hash;
+    }
+    return OBJ_VAL(big);
+}
+
+static bool addOperands(FreeList* freeList, Operand* a, Operand* b,
+        Value* result) {
+    if (a->negative != b->negative) {
+        // The smaller magnitude comes off the larger, which gives the sign
+        if (compareMagnitudes(a->limbs, a->count, b->limbs, b->count) < 0) {
+            Operand* swap = a;
+            a = b;
+            b = swap;
+        }
+        ObjBigInt* big = allocateBigInt(freeList, a->count);
+        if (big == NULL) {
+            return false;
+        }
+        memcpy(big->limbs, a->limbs, sizeof(uint32_t) * (size_t)a->count);
+        subtractFrom(big->limbs, a->count, b->limbs, b->count);
+        *result = finishBigInt(freeList, big, a->count, a->negative);
+        return true;
+    }
+
+    if (a->count < b->count) {
+        Operand* swap = a;
+        a = b;
+        b = swap;
+    }
+    ObjBigInt* big = allocateBigInt(freeList, a->count + 1);
+    if (big == NULL) {
+        return false;
+    }
+    memcpy(big->limbs, a->limbs, sizeof(uint32_t) * (size_t)a->count);
+    big->limbs[a->count] = addInto(big->limbs, a->count, b->limbs, b->count);
+    *result = finishBigInt(freeList, big, a->count + 1, a->negative);
+    return true;
+}
+
+static bool multiplyOperands(FreeList* freeList, Operand* a, Operand* b,
+        Value* result) {
+    if (a->count == 0 || b->count == 0) {
+        *result = INT_VAL(0);
+        return true;
+    }
+    int count = a->count + b->count;
+    ObjBigInt* big = allocateBigInt(freeList, count);
+    if (big == NULL) {
+        return false;
+    }
+    if (!multiplyMagnitudes(big->limbs, a->limbs, a->count,
+            b->limbs, b->count)) {
+        discardBigInt(freeList, big);
+        return false;
+    }
+    *result = finishBigInt(freeList, big, count, a->negative != b->negative);
+    return true;
+}
+
+static bool divideOperands(FreeList* freeList, Operand* a, Operand* b,
+        Value* result) {
+    if (compareMagnitudes(a->limbs, a->count, b->limbs, b->count) < 0) {
+        *result = INT_VAL(0);
+        return true;
+    }
+    int count = a->count - b->count + 1;
+    ObjBigInt* big = allocateBigInt(freeList, count);
+    if (big == NULL) {
+        return false;
+    }
+    if (b->count == 1) {
+        memcpy(big->limbs, a->limbs, sizeof(uint32_t) * (size_t)a->count);
+        divideBySmall(big->limbs, a->count, b->limbs[0]);
+    }
+    else if (!divideMagnitudes(big->limbs, a->limbs, a->count,
+            b->limbs, b->count)) {
+        discardBigInt(freeList, big);
+        return false;
+    }
+    *result = finishBigInt(freeList, big, count, a->negative != b->negative);
+    return true;
+}
+
+bool bigArithmetic(FreeList* freeList, BigOp op, Value a, Value b,
+        Value* result) {
+    Operand aOperand;
+    Operand bOperand;
+    toOperand(a, &aOperand);
+    toOperand(b, &bOperand);
+    switch (op) {
+        case BIG_ADD:
+            return addOperands(freeList, &aOperand, &bOperand, result);
+        case BIG_SUBTRACT:
+            bOperand.negative = !bOperand.negative;
+            return addOperands(freeList, &aOperand, &bOperand, result);
+        case BIG_MULTIPLY:
+            return multiplyOperands(freeList, &aOperand, &bOperand, result);
+        case BIG_DIVIDE:
+            return divideOperands(freeList, &aOperand, &bOperand, result);
+    }
+    return false;
+}
+
+bool bigNegate(FreeList* freeList, Value a, Value* result) {
+    Operand operand;
+    toOperand(a, &operand);
+    ObjBigInt* big = allocateBigInt(freeList, operand.count);
+    if (big == NULL) {
+        return false;
+    }
+    memcpy(big->limbs, operand.limbs,
+        sizeof(uint32_t) * (size_t)operand.count);
+    *result = finishBigInt(freeList, big, operand.count, !operand.negative);
+    return true;
+}
+
+bool parseBigInt(FreeList* freeList, const char* chars, size_t length,
+        Value* result) {
+    bool negative = length > 0 && chars[0] == '-';
+    size_t start = negative ? 1 : 0;
+    if (length == start || length - start > (size_t)BIGINT_MAX_LIMBS * 9) {
+        return false;
+    }
+    for (size_t i = start; i < length; i++) {
+        if (chars[i] < '0' || chars[i] > '9') {
+            return false;
+        }
+    }
+
+    // Each limb holds more than nine digits
+    int capacity = (int)((length - start) / DECIMAL_DIGITS) + 1;
+    ObjBigInt* big = allocateBigInt(freeList, capacity);
+    if (big == NULL) {
+        return false;
+    }
+    int count = 0;
+    size_t i = start;
+    while (i < length) {
+        // Nine digits at a time, or the ones left over first
+        size_t digits = (length - i) % DECIMAL_DIGITS;
+        if (digits == 0) {
+            digits = DECIMAL_DIGITS;
+        }
+        uint32_t scale = 1;
+        uint32_t chunk = 0;
+        for (size_t end = i + digits; i < end; i++) {
+            scale *= 10;
+            chunk = chunk * 10 + (uint32_t)(chars[i] - '0');
+        }
+        uint64_t carry = chunk;
+        for (int j = 0; j < count; j++) {
+            uint64_t product = (uint64_t)big->limbs[j] * scale + carry;
+            big->limbs[j] = (uint32_t)product;
+            carry = product >> LIMB_BITS;
+        }
+        if (carry != 0) {
+            big->limbs[count++] = (uint32_t)carry;
+        }
+    }
+    *result = finishBigInt(freeList, big, count, negative);
+    return true;
+}
+
+int bigCompare(Value a, Value b) {
+    Operand aOperand;
+    Operand bOperand;
+    toOperand(a, &aOperand);
+    toOperand(b, &bOperand);
+    if (aOperand.negative != bOperand.negative) {
+        return aOperand.negative ? -1 : 1;
+    }
+    int order = compareMagnitudes(aOperand.limbs, aOperand.count,
+        bOperand.limbs, bOperand.count);
+    return aOperand.negative ? -order : order;
+}
+
+bool bigIntsEqual(ObjBigInt* a, ObjBigInt* b) {
+    return a->hash == b->hash && a->negative == b->negative &&
+        compareMagnitudes(a->limbs, a->count, b->limbs, b->count) == 0;
+}
+
+double bigIntToFloat(ObjBigInt* big) {
+    // The top 64 bits, with the lowest set if any below them are, round the
+    // same way as the whole magnitude. Big integers have at least two limbs.
+    int count = big->count;
+    uint64_t top = ((uint64_t)big->limbs[count - 1] << LIMB_BITS) |
+        big->limbs[count - 2];
+    int shift = __builtin_clzll(top);
+    uint32_t next = count > 2 ? big->limbs[count - 3] : 0;
+    bool sticky = shift > 0 ? (uint32_t)(next << shift) != 0 : next != 0;
+    if (shift > 0) {
+        top = (top << shift) | (next >> (LIMB_BITS - shift));
+    }
+    for (int i = count - 4; !sticky && i >= 0; i--) {
+        sticky = big->limbs[i] != 0;
+    }
+    if (sticky) {
+        top |= 1;
+    }
+
+    // Scaling by powers of two is exact until it overflows to infinity
+    double value = (double)top / (double)((uint64_t)1 << shift);
+    for (int i = 2; i < count && value <= 1.7976931348623157e308; i++) {
+        value *= (double)LIMB_BASE;
+    }
+    return big->negative ? -value : value;
+}
+
+size_t bigIntTextSize(ObjBigInt* big) {
+    // Each limb is less than ten digits
+    return (size_t)big->count * 10 + 2;
+}
+
+int formatBigInt(char* buffer, ObjBigInt* big) {
+    uint32_t local[SCRATCH_LIMBS];
+    uint32_t* scratch = takeScratch(local, big->count);
+    if (scratch == NULL) {
+        return -1;
+    }
+    memcpy(scratch, big->limbs, sizeof(uint32_t) * (size_t)big->count);
+
+    // Digits are found from the least significant, so they are written
+    // backward from the end of the buffer and moved to its start after
+    char* end = buffer + bigIntTextSize(big) - 1;
+    char* start = end;
+    int count = big->count;
+    while (count > 0) {
+        uint32_t chunk = divideBySmall(scratch, count, DECIMAL_BASE);
+        count = trim(scratch, count);
+        for (int i = 0; i < DECIMAL_DIGITS && (count > 0 || chunk != 0);
+                i++) {
+            *--start = (char)('0' + chunk % 10);
+            chunk /= 10;
+        }
+    }
+    if (big->negative) {
+        *--start = '-';
+    }
+    releaseScratch(local, scratch, big->count);
+
+    int length = (int)(end - start);
+    memmove(buffer, start, (size_t)length);
+    buffer[length] = '\0';
+    return length;
+}
+
+#endif
\ No newline at end of file
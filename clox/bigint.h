@@ -0,0 +1,42 @@
+#ifndef clox_bigint_h
+#define clox_bigint_h
+
+#include "common.h"
+#include "object.h"
+#include "value.h"
+
+#ifdef CLOX_BIG_INTEGERS
+typedef enum {
+    BIG_ADD,
+    BIG_SUBTRACT,
+    BIG_MULTIPLY,
+    BIG_DIVIDE,
+} BigOp;
+
+// Operands are integers, small or big. Results are small wherever they fit
+// in an int64_t, so that equal integers always have the same type.
+// Each returns false for failed allocation
+
+// Division truncates toward zero, as it does for small integers, and b must
+// not be zero
+bool bigArithmetic(FreeList* freeList, BigOp op, Value a, Value b,
+    Value* result);
+bool bigNegate(FreeList* freeList, Value a, Value* result);
+// Returns the decimal integer made of an optional '-' and digits, which
+// are all that chars may hold
+bool parseBigInt(FreeList* freeList, const char* chars, size_t length,
+    Value* result);
+
+// Returns less than, equal to or greater than 0 as a is to b
+int bigCompare(Value a, Value b);
+bool bigIntsEqual(ObjBigInt* a, ObjBigInt* b);
+// Correctly rounded, or an infinity if out of range
+double bigIntToFloat(ObjBigInt* big);
+
+// Room formatBigInt needs, with the sign and terminator
+size_t bigIntTextSize(ObjBigInt* big);
+// Writes big in decimal, returning its length, or -1 for failed allocation
+int formatBigInt(char* buffer, ObjBigInt* big);
+#endif
+
+#endif
\ No newline at end of file
@@ -4,7 +4,8 @@
 #define CONVERT_CAPACITY(capacity) (((capacity) + 7) / 8)
 
 void initBitfield(Bitfield* bitfield, size_t capacity) {
-    bitfield->data = ALLOCATE(uint8_t, CONVERT_CAPACITY(capacity), true);
+    bitfield->data = ALLOCATE(uint8_t, CONVERT_CAPACITY(capacity), true,
+        MEM_COMPILER);
     if (bitfield->data == NULL) {
         // TODO out of memory
         return;
@@ -13,7 +14,8 @@ void initBitfield(Bitfield* bitfield, size_t capacity) {
 }
 
 void freeBitfield(Bitfield* bitfield) {
-    FREE_ARRAY(uint8_t, bitfield->data, CONVERT_CAPACITY(bitfield->capacity));
+    FREE_ARRAY(uint8_t, bitfield->data, CONVERT_CAPACITY(bitfield->capacity),
+        MEM_COMPILER);
     bitfield->data = NULL;
     bitfield->capacity = 0;
 }
@@ -23,7 +25,7 @@ void resizeBitfield(Bitfield* bitfield, size_t capacity) {
         bitfield->data,
         uint8_t,
         CONVERT_CAPACITY(bitfield->capacity),
-        CONVERT_CAPACITY(capacity));
+        CONVERT_CAPACITY(capacity), MEM_COMPILER);
     if (bitfield->data == NULL) {
         // TODO out of memory
         return;
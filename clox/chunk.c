@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <string.h>
 
 #include "settings.h"
 #include "chunk.h"
@@ -21,8 +22,8 @@ void initChunk(Chunk* chunk) {
 
 // Frees a Chunk, resetting its values to initialization
 void freeChunk(Chunk* chunk) {
-    FREE_ARRAY(uint8_t, chunk->code, chunk->capacity);
-    FREE_ARRAY(int, chunk->lines, chunk->capacity);
+    FREE_ARRAY(uint8_t, chunk->code, chunk->capacity, MEM_CODE);
+    FREE_ARRAY(uint16_t, chunk->lines, chunk->line_capacity, MEM_CODE);
     freeValueArray(&chunk->constants);
 #ifdef CLOX_CONST_CACHE
     freeTable(&chunk->constantTable);
@@ -34,23 +35,25 @@ void freeChunk(Chunk* chunk) {
 // Returns -1 for failed allocation, 0 otherwise
 int writeChunk(Chunk* chunk, uint8_t byte, size_t line) {
     if (chunk->capacity < chunk->count + 1) {
-        size_t oldCapacity = chunk->capacity;
-        chunk->capacity = GROW_CAPACITY(oldCapacity);
-        chunk->code = GROW_ARRAY(chunk->code, uint8_t,
-            oldCapacity, chunk->capacity);
-        if (chunk->code == NULL) {
+        size_t newCapacity = GROW_CAPACITY(chunk->capacity);
+        uint8_t* code = GROW_ARRAY(chunk->code, uint8_t,
+            chunk->capacity, newCapacity, MEM_CODE);
+        if (code == NULL) {
             return -1;
         }
+        chunk->code = code;
+        chunk->capacity = newCapacity;
     }
 
     while (chunk->line_capacity < line) {
-        size_t oldLineCapacity = chunk->line_capacity;
-        chunk->line_capacity = GROW_CAPACITY(oldLineCapacity);
-        chunk->lines = GROW_ARRAY_ZERO(chunk->lines, uint16_t,
-            oldLineCapacity, chunk->line_capacity);
-        if (chunk->lines == NULL) {
+        size_t newLineCapacity = GROW_CAPACITY(chunk->line_capacity);
+        uint16_t* lines = GROW_ARRAY_ZERO(chunk->lines, uint16_t,
+            chunk->line_capacity, newLineCapacity, MEM_CODE);
+        if (lines == NULL) {
             return -1;
         }
+        chunk->lines = lines;
+        chunk->line_capacity = newLineCapacity;
     }
 
     chunk->code[chunk->count] = byte;
@@ -59,6 +62,12 @@ int writeChunk(Chunk* chunk, uint8_t byte, size_t line) {
     return 0;
 }
 
+// Removes the last byte added to the Chunk, which was written with line
+void unwriteChunk(Chunk* chunk, size_t line) {
+    chunk->count--;
+    chunk->lines[line - 1]--;
+}
+
 // Adds a single constant to the Chunk
 // Returns index where Value was added
 // Returns -1 if failed to add
@@ -87,7 +96,7 @@ int addConstant(Chunk* chunk, Value value) {
     // constants?
     Value idValue = FLOAT_VAL((double)constantId);
 #endif
-    tableSet(&chunk->constantTable, value, idValue);
+    ERROR_GUARD(tableSet(&chunk->constantTable, value, idValue));
 #endif
     return constantId;
 }
@@ -99,8 +108,9 @@ int writeConstant(Chunk* chunk, Value value, size_t line) {
     ERROR_GUARD(index);
 #ifdef CLOX_LONG_CONSTANTS
     if (index > CHUNK_SHORT_CONSTANTS) {
-        ERROR_GUARD(writeChunk(chunk, OP_CONSTANT_LONG, line));
-        for (int i = 0; i < 3; i++) {
+        ERROR_GUARD(writeChunk(chunk, OP_WIDE, line));
+        ERROR_GUARD(writeChunk(chunk, OP_CONSTANT, line));
+        for (int i = 0; i < WIDE_INDEX_BYTES; i++) {
             ERROR_GUARD(writeChunk(chunk, BYTE_FROM_3WORD(index, i), line));
         }
     }
@@ -117,6 +127,54 @@ int writeConstant(Chunk* chunk, Value value, size_t line) {
     return 0;
 }
 
+// Makes room for count bytes before offset, moving the code after it along
+// The new bytes are left for the caller to fill in and belong to the same
+// line as the byte previously at offset
+// Returns -1 for failed allocation, 0 otherwise
+int insertChunk(Chunk* chunk, size_t offset, size_t count) {
+    if (chunk->capacity < chunk->count + count) {
+        size_t newCapacity = chunk->capacity;
+        while (newCapacity < chunk->count + count) {
+            newCapacity = GROW_CAPACITY(newCapacity);
+        }
+        uint8_t* code = GROW_ARRAY(chunk->code, uint8_t,
+            chunk->capacity, newCapacity, MEM_CODE);
+        if (code == NULL) {
+            return -1;
+        }
+        chunk->code = code;
+        chunk->capacity = newCapacity;
+    }
+    size_t line = getLine(chunk, offset);
+    memmove(chunk->code + offset + count, chunk->code + offset,
+        chunk->count - offset);
+    chunk->lines[line - 1] = (uint16_t)(chunk->lines[line - 1] + count);
+    chunk->count += count;
+    return 0;
+}
+
+// Returns the number of bytes taken up by the instruction at offset,
+// including its operand and any OP_WIDE prefix
+size_t instructionSize(Chunk* chunk, size_t offset) {
+    bool wide = chunk->code[offset] == OP_WIDE;
+    switch (chunk->code[offset + wide]) {
+        case OP_CONSTANT:
+        case OP_DEFINE_GLOBAL:
+        case OP_DEFINE_GLOBAL_CONST:
+        case OP_GET_GLOBAL:
+        case OP_SET_GLOBAL:
+        case OP_GET_LOCAL:
+        case OP_SET_LOCAL:
+            return wide ? 2 + WIDE_INDEX_BYTES : 1 + SHORT_INDEX_BYTES;
+        case OP_JUMP:
+        case OP_JUMP_IF_FALSE:
+        case OP_LOOP:
+            return wide ? 2 + WIDE_JUMP_BYTES : 1 + SHORT_JUMP_BYTES;
+        default:
+            return 1;
+    }
+}
+
 size_t getLine(Chunk* chunk, size_t index) {
     size_t remaining = index;
     size_t line = 0;
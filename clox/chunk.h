@@ -7,47 +7,42 @@
 
 typedef enum {
     // Complex instructions (take arguments)
-    
+
+    // Prefix that widens the operand of the instruction after it, which must
+    // be one of the complex instructions below. Index operands become
+    // WIDE_INDEX_BYTES long and jump offsets WIDE_JUMP_BYTES long, in the
+    // byte order given by endian.h. Used when there are more than 255
+    // constants or locals, or when a jump is longer than JUMP_MAX.
+    // OP_WIDE opcode operand1 ... operandN
+    OP_WIDE,
     // Pushes the nth constant onto the stack.
     // opcode index
     OP_CONSTANT,
-    // Pushes the nth constant onto the stack. Used when there are more than
-    // 255 constants. Similar long varients exist for other constant-related
-    // instructions.
-    // little endian
-    // opcode index1 index2 index3
-    OP_CONSTANT_LONG,
     // Defines a global variable with the given constant name, popping a value
     // off of the stack to get its value
     // opcode nameIndex
     OP_DEFINE_GLOBAL,
-    OP_DEFINE_GLOBAL_LONG,
     // Defines a global constant with the given constant name, popping a value
     // off of the stack to get its value. Note that the constant cannot be
     // changed.
     // Only useful when CLOX_CONST_KEYWORD is defined.
     // opcode nameIndex
     OP_DEFINE_GLOBAL_CONST,
-    OP_DEFINE_GLOBAL_CONST_LONG,
     // Gets the value of a global variable and pushes it onto the stack
     // opcode nameIndex
     OP_GET_GLOBAL,
-    OP_GET_GLOBAL_LONG,
     // Sets a global variable to the top value of the stack, without popping
     // it off the stack
     // opcode nameIndex
     OP_SET_GLOBAL,
-    OP_SET_GLOBAL_LONG,
 
     // Gets the value of a local variable and pushes it onto the stack
     // opcode localIndex
     OP_GET_LOCAL,
-    OP_GET_LOCAL_LONG,
     // Sets the value of a local variable to the top value of the stack,
     // without popping it off the stack
     // opcode localIndex
     OP_SET_LOCAL,
-    OP_SET_LOCAL_LONG,
 
     // Jumps to the specified offset.
     // opcode jumpIndex1 jumpIndex2
@@ -112,10 +107,23 @@ void initChunk(Chunk* chunk);
 void freeChunk(Chunk* chunk);
 int addConstant(Chunk* chunk, Value value);
 int writeChunk(Chunk* chunk, uint8_t byte, size_t line);
+void unwriteChunk(Chunk* chunk, size_t line);
 // size_t addConstant(Chunk* chunk, Value value);
 int writeConstant(Chunk* chunk, Value value, size_t line);
+int insertChunk(Chunk* chunk, size_t offset, size_t count);
+size_t instructionSize(Chunk* chunk, size_t offset);
 size_t getLine(Chunk* chunk, size_t index);
 
+// Operand sizes of instructions with and without the OP_WIDE prefix
+#define SHORT_INDEX_BYTES 1
+#define SHORT_JUMP_BYTES 2
+#define WIDE_INDEX_BYTES 3
+#define WIDE_JUMP_BYTES 4
+
+// Largest offset a jump can cover without and with the OP_WIDE prefix
+#define JUMP_MAX UINT16_MAX
+#define WIDE_JUMP_MAX UINT32_MAX
+
 // Maximum 2**8-1 constants
 #define CHUNK_SHORT_CONSTANTS 255
 // Maximum 2**24-2 constants
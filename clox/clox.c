@@ -0,0 +1,272 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "bigint.h"
+#include "clox.h"
+#include "common.h"
+#include "memory.h"
+#include "object.h"
+#include "snapshot.h"
+#include "vm.h"
+
+struct CloxVM {
+    VM vm;
+};
+
+struct CloxScript {
+    Program program;
+};
+
+static CloxResult toCloxResult(InterpretResult result) {
+    switch (result) {
+        case INTERPRET_COMPILE_ERROR: return CLOX_COMPILE_ERROR;
+        case INTERPRET_RUNTIME_ERROR: return CLOX_RUNTIME_ERROR;
+        case INTERPRET_BUDGET_EXCEEDED: return CLOX_BUDGET_EXCEEDED;
+        case INTERPRET_INTERRUPTED: return CLOX_INTERRUPTED;
+        default: return CLOX_OK;
+    }
+}
+
+#ifndef CLOX_BIG_INTEGERS
+// Reads the digits of a big integer as the nearest number this build has
+// Returns false if they are not digits
+static bool parseNumber(const char* chars, size_t length, Value* converted) {
+    bool negative = length > 0 && chars[0] == '-';
+    size_t start = negative ? 1 : 0;
+    double number = 0;
+    for (size_t i = start; i < length; i++) {
+        if (chars[i] < '0' || chars[i] > '9') {
+            return false;
+        }
+        number = number * 10 + (chars[i] - '0');
+    }
+    *converted = FLOAT_VAL(negative ? -number : number);
+    return length > start;
+}
+#endif
+
+// Returns false for failed allocation, or a big integer that is not one
+static bool fromCloxValue(VM* vm, CloxValue value, Value* converted) {
+    switch (value.type) {
+        case CLOX_NIL: *converted = NIL_VAL; return true;
+        case CLOX_BOOL: *converted = BOOL_VAL(value.as.boolean); return true;
+        case CLOX_NUMBER: *converted = FLOAT_VAL(value.as.number); return true;
+        case CLOX_INTEGER:
+#ifdef CLOX_INTEGER_TYPE
+            *converted = INT_VAL(value.as.integer);
+#else
+            *converted = FLOAT_VAL((double)value.as.integer);
+#endif
+            return true;
+        case CLOX_STRING: {
+            ObjString* string = copyString(&vm->freeList, &vm->strings,
+                value.as.string.chars, (int)value.as.string.length);
+            if (string == NULL) {
+                return false;
+            }
+            *converted = OBJ_VAL(string);
+            return true;
+        }
+        case CLOX_BIG_INTEGER:
+#ifdef CLOX_BIG_INTEGERS
+            return parseBigInt(&vm->freeList, value.as.string.chars,
+                value.as.string.length, converted);
+#else
+            return parseNumber(value.as.string.chars,
+                value.as.string.length, converted);
+#endif
+    }
+    return false;
+}
+
+#ifdef CLOX_BIG_INTEGERS
+// The digits are interned like any other string, so that they last as long
+// as the VM's strings do
+// Returns false for failed allocation
+static bool bigIntText(VM* vm, ObjBigInt* big, CloxValue* converted) {
+    size_t size = bigIntTextSize(big);
+    char* text = ALLOCATE(char, size, false, MEM_BIG_INTEGERS);
+    int length = text == NULL ? -1 : formatBigInt(text, big);
+    ObjString* string = length < 0 ? NULL :
+        copyString(&vm->freeList, &vm->strings, text, length);
+    FREE_ARRAY(char, text, size, MEM_BIG_INTEGERS);
+    if (string == NULL) {
+        return false;
+    }
+    converted->type = CLOX_BIG_INTEGER;
+    converted->as.string.chars = string->chars;
+    converted->as.string.length = (size_t)string->length;
+    return true;
+}
+#endif
+
+// Returns false for failed allocation
+static bool toCloxValue(VM* vm, Value value, CloxValue* converted) {
+#ifdef CLOX_BIG_INTEGERS
+    if (IS_BIGINT(value)) {
+        useHeap(&vm->heap);
+        return bigIntText(vm, AS_BIGINT(value), converted);
+    }
+#else
+    UNUSED(vm);
+#endif
+    switch (value.type) {
+        case VAL_BOOL:
+            converted->type = CLOX_BOOL;
+            converted->as.boolean = AS_BOOL(value);
+            break;
+        case VAL_FLOAT:
+            converted->type = CLOX_NUMBER;
+            converted->as.number = AS_FLOAT(value);
+            break;
+#ifdef CLOX_INTEGER_TYPE
+        case VAL_INT:
+            converted->type = CLOX_INTEGER;
+            converted->as.integer = AS_INT(value);
+            break;
+#endif
+        case VAL_OBJ:
+            converted->type = CLOX_STRING;
+            converted->as.string.chars = AS_CSTRING(value);
+            converted->as.string.length = (size_t)AS_STRING(value)->length;
+            break;
+        default:
+            converted->type = CLOX_NIL;
+            break;
+    }
+    return true;
+}
+
+CloxVM* cloxNewVM(void) {
+    CloxVM* clox = (CloxVM*)malloc(sizeof(CloxVM));
+    if (clox != NULL) {
+        initVM(&clox->vm);
+    }
+    return clox;
+}
+
+void cloxFreeVM(CloxVM* clox) {
+    if (clox != NULL) {
+        freeVM(&clox->vm);
+        free(clox);
+    }
+}
+
+void cloxResetVM(CloxVM* clox) {
+    resetVM(&clox->vm);
+}
+
+void cloxSetOutput(CloxVM* clox, CloxWriteFn write, void* context) {
+    clox->vm.write = write;
+    clox->vm.writeContext = context;
+}
+
+void cloxSetFlush(CloxVM* clox, CloxFlush flush) {
+    switch (flush) {
+        case CLOX_FLUSH_LINE: clox->vm.flush = FLUSH_LINE; break;
+        case CLOX_FLUSH_SIZE: clox->vm.flush = FLUSH_SIZE; break;
+        case CLOX_FLUSH_EXIT: clox->vm.flush = FLUSH_EXIT; break;
+    }
+}
+
+void cloxSetErrorFile(CloxVM* clox, FILE* file) {
+    clox->vm.err = file;
+}
+
+void cloxSetHeapLimit(CloxVM* clox, size_t bytes) {
+    clox->vm.heap.limit = bytes;
+}
+
+void cloxSetInstructionLimit(CloxVM* clox, uint64_t instructions) {
+    clox->vm.instructionLimit = instructions;
+}
+
+CloxResult cloxInterpret(CloxVM* clox, const char* source) {
+    return toCloxResult(interpret(&clox->vm, source));
+}
+
+CloxScript* cloxCompile(CloxVM* clox, const char* source) {
+    CloxScript* script = (CloxScript*)malloc(sizeof(CloxScript));
+    if (script == NULL) {
+        return NULL;
+    }
+    if (compileProgram(&clox->vm, &script->program, source) != INTERPRET_OK) {
+        free(script);
+        return NULL;
+    }
+    return script;
+}
+
+CloxResult cloxRun(CloxVM* clox, CloxScript* script) {
+    return toCloxResult(runProgram(&clox->vm, &script->program));
+}
+
+CloxResult cloxResume(CloxVM* clox) {
+    return toCloxResult(resumeProgram(&clox->vm));
+}
+
+void cloxInterrupt(CloxVM* clox) {
+    interruptVM(&clox->vm);
+}
+
+void cloxFreeScript(CloxScript* script) {
+    if (script != NULL) {
+        freeProgram(&script->program);
+        free(script);
+    }
+}
+
+bool cloxSetGlobal(CloxVM* clox, const char* name, CloxValue value) {
+    VM* vm = &clox->vm;
+    useHeap(&vm->heap);
+    ObjString* key = copyString(&vm->freeList, &vm->strings, name,
+        (int)strlen(name));
+    Value converted;
+    if (key == NULL || !fromCloxValue(vm, value, &converted)) {
+        return false;
+    }
+#ifdef CLOX_CONST_KEYWORD
+    Value placeholder;
+    if (tableGet(&vm->constGlobals, OBJ_VAL(key), &placeholder)) {
+        return false;
+    }
+#endif
+    return tableSet(&vm->globals, OBJ_VAL(key), converted) >= 0;
+}
+
+bool cloxGetGlobal(CloxVM* clox, const char* name, CloxValue* value) {
+    // Globals can be named by strings of any script the VM has run, which
+    // are only equal to this one by their contents
+    ObjString key;
+    key.obj.type = OBJ_STRING;
+    key.obj.next = NULL;
+    key.length = (int)strlen(name);
+    key.chars = (char*)name;
+    key.hash = hashString(name, key.length);
+
+    Value found;
+    if (!tableGet(&clox->vm.globals, OBJ_VAL(&key), &found)) {
+        return false;
+    }
+    return toCloxValue(&clox->vm, found, value);
+}
+
+bool cloxSaveSnapshot(CloxVM* clox, const char* path) {
+#ifdef CLOX_SNAPSHOT
+    return saveSnapshot(&clox->vm, path);
+#else
+    UNUSED(path);
+    fprintf(clox->vm.err, "Snapshots are not supported on this platform.\n");
+    return false;
+#endif
+}
+
+bool cloxLoadSnapshot(CloxVM* clox, const char* path) {
+#ifdef CLOX_SNAPSHOT
+    return loadSnapshot(&clox->vm, path);
+#else
+    UNUSED(path);
+    fprintf(clox->vm.err, "Snapshots are not supported on this platform.\n");
+    return false;
+#endif
+}
\ No newline at end of file
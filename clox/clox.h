@@ -0,0 +1,133 @@
+#ifndef clox_h
+#define clox_h
+
+// The interface for programs that embed clox, built into libclox.a and
+// libclox.so by "make lib". Nothing else in this directory is part of it.
+//
+// A VM must only be used by one thread at a time. A compiled script can be
+// run by any number of VMs at once, on any threads, and must outlive every
+// VM that has run it until that VM is reset or freed.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#if defined(__GNUC__) && !defined(_WIN32)
+#define CLOX_API __attribute__((visibility("default")))
+#else
+#define CLOX_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct CloxVM CloxVM;
+typedef struct CloxScript CloxScript;
+
+typedef enum {
+    CLOX_OK,
+    CLOX_COMPILE_ERROR,
+    CLOX_RUNTIME_ERROR,
+    // A run of a script paused, and can be continued by cloxResume
+    CLOX_BUDGET_EXCEEDED,
+    CLOX_INTERRUPTED
+} CloxResult;
+
+typedef enum {
+    CLOX_NIL,
+    CLOX_BOOL,
+    CLOX_NUMBER,
+    // Only returned by builds with integers, and set as a number otherwise
+    CLOX_INTEGER,
+    CLOX_STRING,
+    // Integers past int64_t, as decimal digits after an optional '-' in
+    // string. Only returned by builds with big integers, and set as a number
+    // otherwise.
+    CLOX_BIG_INTEGER
+} CloxType;
+
+// Strings returned by cloxGetGlobal, including the digits of big integers,
+// belong to the VM, and are only valid until it next runs, is reset or is
+// freed
+typedef struct {
+    CloxType type;
+    union {
+        bool boolean;
+        double number;
+        int64_t integer;
+        struct {
+            const char* chars;
+            size_t length;
+        } string;
+    } as;
+} CloxValue;
+
+// When what print statements write is handed on. Whatever policy is
+// chosen, all of it has been handed on by the time a run returns.
+typedef enum {
+    CLOX_FLUSH_LINE,  // After each print statement
+    CLOX_FLUSH_SIZE,  // Once several kilobytes have built up, the default
+    CLOX_FLUSH_EXIT   // Only as the run returns
+} CloxFlush;
+
+// Receives length bytes of output, which are not terminated
+typedef void (*CloxWriteFn)(void* context, const char* text, size_t length);
+
+// Returns NULL if out of memory
+CLOX_API CloxVM* cloxNewVM(void);
+CLOX_API void cloxFreeVM(CloxVM* vm);
+// Forgets every global, keeping the VM's options
+CLOX_API void cloxResetVM(CloxVM* vm);
+
+// Hands what print statements write to write instead of stdout, or goes
+// back to stdout if write is NULL
+CLOX_API void cloxSetOutput(CloxVM* vm, CloxWriteFn write, void* context);
+CLOX_API void cloxSetFlush(CloxVM* vm, CloxFlush flush);
+// Where compile and runtime errors are written, stderr by default
+CLOX_API void cloxSetErrorFile(CloxVM* vm, FILE* file);
+// Scripts fail with a runtime error instead of allocating more than bytes,
+// or without limit if bytes is 0
+CLOX_API void cloxSetHeapLimit(CloxVM* vm, size_t bytes);
+// Each run, or resumed run, pauses with CLOX_BUDGET_EXCEEDED once its
+// loops have run this many bytes of bytecode, or never if it is 0. Loops
+// are counted at each jump back, by the bytes jumped over. cloxInterpret reports the pause as an error, since its
+// run cannot be resumed.
+CLOX_API void cloxSetInstructionLimit(CloxVM* vm, uint64_t instructions);
+
+// Compiles and runs source once
+CLOX_API CloxResult cloxInterpret(CloxVM* vm, const char* source);
+
+// Returns NULL after writing errors to the VM's error file if source does
+// not compile. The VM is only used for its options.
+CLOX_API CloxScript* cloxCompile(CloxVM* vm, const char* source);
+// Gives up on any run that paused
+CLOX_API CloxResult cloxRun(CloxVM* vm, CloxScript* script);
+// Continues the run that paused, returning CLOX_OK if none did. Several
+// VMs can take turns on a thread this way.
+CLOX_API CloxResult cloxResume(CloxVM* vm);
+// Makes the run in progress pause with CLOX_INTERRUPTED at its next loop.
+// Safe to call from any thread or signal handler.
+CLOX_API void cloxInterrupt(CloxVM* vm);
+CLOX_API void cloxFreeScript(CloxScript* script);
+
+// Defines or overwrites a global. Returns false if it is a const, a big
+// integer that is not one, or out of memory.
+CLOX_API bool cloxSetGlobal(CloxVM* vm, const char* name, CloxValue value);
+// Returns false if there is no such global, or out of memory
+CLOX_API bool cloxGetGlobal(CloxVM* vm, const char* name, CloxValue* value);
+
+// Saves the globals, consts and strings scripts have defined in the VM to
+// an image file at path
+CLOX_API bool cloxSaveSnapshot(CloxVM* vm, const char* path);
+// Forgets every global, then maps in an image saved by the same build of
+// clox, which is much faster than running the scripts that defined it
+// again. Both return false after writing why to the VM's error file.
+CLOX_API bool cloxLoadSnapshot(CloxVM* vm, const char* path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
\ No newline at end of file
@@ -25,6 +25,66 @@
 # define PLATFORM_UNIX
 #endif
 
+// Big integers take over from int64_t arithmetic, which is checked for
+// overflow with GCC-style builtins
+#if defined(CLOX_BIG_INTEGERS) && \
+    (!defined(CLOX_INTEGER_TYPE) || !defined(__GNUC__))
+# undef CLOX_BIG_INTEGERS
+#endif
+
+// Pipelined scanning needs pthreads and GCC-style atomics
+#if defined(CLOX_PIPELINED_SCANNER) && \
+    (!defined(PLATFORM_UNIX) || defined(__EMSCRIPTEN__))
+# undef CLOX_PIPELINED_SCANNER
+#endif
+
+// Running scripts on several threads needs pthreads and open_memstream
+#if defined(CLOX_PARALLEL_JOBS) && \
+    (!defined(PLATFORM_UNIX) || defined(__EMSCRIPTEN__))
+# undef CLOX_PARALLEL_JOBS
+#endif
+
+// Serving needs pthreads and Unix domain sockets
+#if defined(CLOX_SERVE) && \
+    (!defined(PLATFORM_UNIX) || defined(__EMSCRIPTEN__))
+# undef CLOX_SERVE
+#endif
+
+// Snapshots are restored with mmap
+#if defined(CLOX_SNAPSHOT) && \
+    (!defined(PLATFORM_UNIX) || defined(__EMSCRIPTEN__))
+# undef CLOX_SNAPSHOT
+#endif
+
+// Sampling needs SIGPROF and setitimer
+#if defined(CLOX_SAMPLING_PROFILER) && \
+    (!defined(PLATFORM_UNIX) || defined(__EMSCRIPTEN__))
+# undef CLOX_SAMPLING_PROFILER
+#endif
+
+// Stats are dumped on SIGUSR1
+#if defined(CLOX_LIVE_STATS) && \
+    (!defined(PLATFORM_UNIX) || defined(__EMSCRIPTEN__))
+# undef CLOX_LIVE_STATS
+#endif
+
+// Hardware counters are read through perf_event_open, which only Linux has
+#if defined(CLOX_PERF_COUNTERS) && \
+    (!defined(__linux__) || defined(__EMSCRIPTEN__))
+# undef CLOX_PERF_COUNTERS
+#endif
+
+// Probes are USDT notes from systemtap's sys/sdt.h
+#if defined(CLOX_PROBES) && (!defined(__linux__) || \
+    !defined(__has_include) || defined(__EMSCRIPTEN__))
+# undef CLOX_PROBES
+#endif
+#ifdef CLOX_PROBES
+# if !__has_include(<sys/sdt.h>)
+#  undef CLOX_PROBES
+# endif
+#endif
+
 // Attempt at platform-independent print format modifiers
 #ifdef PLATFORM_WINDOWS
 #define FORMAT_SIZE_T "Iu"
@@ -1,3 +1,4 @@
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,6 +8,8 @@
 #include "compiler.h"
 #include "endian.h"
 #include "memory.h"
+#include "number.h"
+#include "probes.h"
 
 #ifdef DEBUG_PRINT_CODE
 #include "debug.h"
@@ -29,19 +32,20 @@ static void errorAt(Compiler* compiler, Token* token, const char* message) {
         return;
     }
     compiler->parser.panicMode = true;
-    fprintf(stderr, "[line %" FORMAT_SIZE_T "] Error", token->line);
+    fprintf(compiler->errors, "[line %" FORMAT_SIZE_T "] Error",
+        token->line);
 
     if (token->type == TOKEN_EOF) {
-        fprintf(stderr, " at end");
+        fprintf(compiler->errors, " at end");
     }
     else if (token->type == TOKEN_ERROR) {
         // Do nothing
     }
     else {
-        fprintf(stderr, " at '%.*s'", token->length, token->start);
+        fprintf(compiler->errors, " at '%.*s'", token->length, token->start);
     }
 
-    fprintf(stderr, ": %s\n", message);
+    fprintf(compiler->errors, ": %s\n", message);
     compiler->parser.hadError = true;
 }
 
@@ -57,6 +61,12 @@ static void advance(Compiler* compiler) {
     compiler->parser.previous = compiler->parser.current;
 
     while (1) {
+#ifdef CLOX_PIPELINED_SCANNER
+        if (compiler->parser.pipeline != NULL) {
+            nextToken(compiler->parser.pipeline, &compiler->parser.current);
+        }
+        else
+#endif
         scanToken(compiler->parser.scanner, &compiler->parser.current);
         if (compiler->parser.current.type != TOKEN_ERROR) {
             break;
@@ -106,33 +116,87 @@ static void emitBytes(Compiler* compiler, uint8_t byte1, uint8_t byte2) {
 }
 
 #if defined(CLOX_LONG_CONSTANTS) || defined(CLOX_LONG_LOCALS)
-// Remainder is expected to be 3-bytes-long
-static void emitBytesLong(Compiler* compiler, uint8_t byte1, size_t remainder) {
-    emitByte(compiler, byte1);
-    for (int i = 0; i < 3; i++) {
-        emitByte(compiler, BYTE_FROM_3WORD(remainder, i));
+// Emits instruction behind an OP_WIDE prefix, with a wide index operand
+static void emitWide(Compiler* compiler, uint8_t instruction, size_t index) {
+    emitBytes(compiler, OP_WIDE, instruction);
+    for (int i = 0; i < WIDE_INDEX_BYTES; i++) {
+        emitByte(compiler, BYTE_FROM_3WORD(index, i));
     }
 }
 #endif
 
+// Remembers an offset that has to be kept up to date when code is inserted
+// before it
+// Returns a handle to pass to releaseMark, or NO_MARK after reporting an
+// error if there is no room for it
+static size_t addMark(Compiler* compiler, size_t offset) {
+    if (compiler->markCount == compiler->markCapacity) {
+        size_t newCapacity = GROW_CAPACITY(compiler->markCapacity);
+        size_t* marks = GROW_ARRAY(
+            compiler->marks,
+            size_t,
+            compiler->markCapacity,
+            newCapacity, MEM_COMPILER);
+        if (marks == NULL) {
+            error(compiler, "Out of memory.");
+            return NO_MARK;
+        }
+        compiler->marks = marks;
+        compiler->markCapacity = newCapacity;
+    }
+    compiler->marks[compiler->markCount] = offset;
+    return compiler->markCount++;
+}
+
+// Forgets a mark, returning its current offset
+static size_t releaseMark(Compiler* compiler, size_t mark) {
+    if (mark == NO_MARK) {
+        // The offset was lost, but the code is never run anyway
+        return 0;
+    }
+    size_t offset = compiler->marks[mark];
+    compiler->marks[mark] = NO_MARK;
+    while (compiler->markCount > 0 &&
+            compiler->marks[compiler->markCount - 1] == NO_MARK) {
+        compiler->markCount--;
+    }
+    return offset;
+}
+
+static size_t markLoopStart(Compiler* compiler) {
+    return addMark(compiler, currentChunk(compiler)->count);
+}
+
 static void emitLoop(Compiler* compiler, size_t loopStart) {
-    emitByte(compiler, OP_LOOP);
+    size_t start = releaseMark(compiler, loopStart);
+    size_t count = currentChunk(compiler)->count;
+
+    size_t offset = count - start + 1 + SHORT_JUMP_BYTES;
+    if (offset <= JUMP_MAX) {
+        emitByte(compiler, OP_LOOP);
+        emitByte(compiler, BYTE_FROM_2WORD(offset, 0));
+        emitByte(compiler, BYTE_FROM_2WORD(offset, 1));
+        return;
+    }
 
-    size_t offset = currentChunk(compiler)->count - loopStart + 2;
-    if (offset > JUMP_MAX) {
+    offset = count - start + 2 + WIDE_JUMP_BYTES;
+    if (offset > WIDE_JUMP_MAX) {
         error(compiler, "Loop body too large.");
     }
-
-    emitByte(compiler, BYTE_FROM_2WORD(offset, 0));
-    emitByte(compiler, BYTE_FROM_2WORD(offset, 1));
+    emitBytes(compiler, OP_WIDE, OP_LOOP);
+    for (int i = 0; i < WIDE_JUMP_BYTES; i++) {
+        emitByte(compiler, BYTE_FROM_4WORD(offset, i));
+    }
 }
 
+// Jumps are emitted short and widened by patchJump if they turn out not to
+// fit, so the handle returned is a mark rather than an offset
 static size_t emitJump(Compiler* compiler, uint8_t instruction) {
     emitByte(compiler, instruction);
     // To be pached
     emitByte(compiler, 0xFF);
     emitByte(compiler, 0xFF);
-    return currentChunk(compiler)->count - 2;
+    return addMark(compiler, currentChunk(compiler)->count - 2);
 }
 
 static void emitReturn(Compiler* compiler) {
@@ -163,32 +227,213 @@ static void endScope(Compiler* compiler) {
     }
 }
 
+// Reports why a constant could not be added to the current chunk
+static void constantError(Compiler* compiler) {
+    if (currentChunk(compiler)->constants.count > CHUNK_MAX_CONSTANTS) {
+        error(compiler, "Too many constants in one chunk.");
+    }
+    else {
+        error(compiler, "Out of memory.");
+    }
+}
+
 static void emitConstant(Compiler* compiler, Value value) {
     int constant = writeConstant(
         currentChunk(compiler), value, compiler->parser.previous.line);
     if (constant < 0) {
-        error(compiler, "Too many constants in one chunk.");
+        constantError(compiler);
     }
 }
 
-static void patchJump(Compiler* compiler, size_t offset) {
-    size_t jump = currentChunk(compiler)->count - offset - 2;
-    if (jump > JUMP_MAX) {
-        error(compiler, "Too much code to jump over.");
+// A jump found while widening another one
+typedef struct {
+    // Offset of the instruction, including any OP_WIDE prefix
+    size_t start;
+    // Offset the jump lands on
+    size_t target;
+    bool wide;
+} JumpSite;
+
+// Returns true if the short jump at offset has not been patched yet
+static bool isPendingJump(Compiler* compiler, size_t offset) {
+    for (size_t i = 0; i < compiler->markCount; i++) {
+        if (compiler->marks[i] == offset + 1) {
+            return true;
+        }
     }
+    return false;
+}
 
-    currentChunk(compiler)->code[offset] = BYTE_FROM_2WORD(jump, 0);
-    currentChunk(compiler)->code[offset + 1] = BYTE_FROM_2WORD(jump, 1);
+// Reads the patched jump at offset, if there is one other than at skip
+static bool readJump(Compiler* compiler, size_t offset, size_t skip,
+        JumpSite* jump) {
+    Chunk* chunk = currentChunk(compiler);
+    bool wide = chunk->code[offset] == OP_WIDE;
+    uint8_t* operand = &chunk->code[offset + wide + 1];
+    uint8_t instruction = operand[-1];
+    if ((instruction != OP_JUMP && instruction != OP_JUMP_IF_FALSE &&
+            instruction != OP_LOOP) || offset == skip ||
+            (!wide && isPendingJump(compiler, offset))) {
+        return false;
+    }
+
+    size_t next = offset + instructionSize(chunk, offset);
+    size_t distance;
+    if (wide) {
+        distance = COMBINE_4WORD(
+            operand[0], operand[1], operand[2], operand[3]);
+    }
+    else {
+        distance = COMBINE_2WORD(operand[0], operand[1]);
+    }
+    jump->start = offset;
+    jump->target = instruction == OP_LOOP ?
+        next - distance : next + distance;
+    jump->wide = wide;
+    return true;
+}
+
+// Collects the patched jumps of the current top-level declaration, and
+// last the short one at skip, which lands on target
+// Returns NULL after reporting an error if there is no room for them
+static JumpSite* findJumps(Compiler* compiler, size_t skip, size_t target,
+        size_t* count) {
+    Chunk* chunk = currentChunk(compiler);
+    JumpSite jump;
+    *count = 1;
+    for (size_t offset = compiler->declarationStart; offset < chunk->count;
+            offset += instructionSize(chunk, offset)) {
+        *count += readJump(compiler, offset, skip, &jump);
+    }
+
+    JumpSite* jumps = ALLOCATE(JumpSite, *count, false, MEM_COMPILER);
+    if (jumps == NULL) {
+        error(compiler, "Out of memory.");
+        return NULL;
+    }
+    size_t found = 0;
+    for (size_t offset = compiler->declarationStart; offset < chunk->count;
+            offset += instructionSize(chunk, offset)) {
+        found += readJump(compiler, offset, skip, &jumps[found]);
+    }
+    jumps[found].start = skip;
+    jumps[found].target = target;
+    jumps[found].wide = false;
+    return jumps;
+}
+
+// Turns the short jump at offset into a wide one that lands on target,
+// moving the code after it along. Jumps across the inserted bytes are
+// re-encoded, and widened in turn if they no longer fit.
+static void widenJump(Compiler* compiler, size_t offset, size_t target) {
+    Chunk* chunk = currentChunk(compiler);
+    size_t count;
+    JumpSite* jumps = findJumps(compiler, offset, target, &count);
+    if (jumps == NULL) {
+        return;
+    }
+
+    // Each pass widens at most one jump, since every widening moves code
+    const size_t growth = 1 + WIDE_JUMP_BYTES - SHORT_JUMP_BYTES;
+    bool widened = true;
+    while (widened) {
+        widened = false;
+        for (size_t i = 0; i < count && !widened; i++) {
+            JumpSite* jump = &jumps[i];
+            size_t next = jump->start + 1 + SHORT_JUMP_BYTES;
+            size_t distance = jump->target > next ?
+                jump->target - next : next - jump->target;
+            if (jump->wide || distance <= JUMP_MAX) {
+                continue;
+            }
+
+            uint8_t instruction = chunk->code[jump->start];
+            if (insertChunk(chunk, jump->start, growth) < 0) {
+                error(compiler, "Failed chunk allocation.");
+                FREE_ARRAY(JumpSite, jumps, count, MEM_COMPILER);
+                return;
+            }
+            chunk->code[jump->start] = OP_WIDE;
+            chunk->code[jump->start + 1] = instruction;
+            jump->wide = true;
+            widened = true;
+
+            size_t at = jump->start;
+            for (size_t j = 0; j < count; j++) {
+                if (jumps[j].start > at) {
+                    jumps[j].start += growth;
+                }
+                if (jumps[j].target > at) {
+                    jumps[j].target += growth;
+                }
+            }
+            for (size_t j = 0; j < compiler->markCount; j++) {
+                if (compiler->marks[j] != NO_MARK && compiler->marks[j] > at) {
+                    compiler->marks[j] += growth;
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        JumpSite* jump = &jumps[i];
+        size_t next = jump->start + instructionSize(chunk, jump->start);
+        size_t distance = jump->target > next ?
+            jump->target - next : next - jump->target;
+        uint8_t* operand = &chunk->code[jump->start + jump->wide + 1];
+        if (!jump->wide) {
+            operand[0] = BYTE_FROM_2WORD(distance, 0);
+            operand[1] = BYTE_FROM_2WORD(distance, 1);
+        }
+        else if (distance > WIDE_JUMP_MAX) {
+            error(compiler, "Too much code to jump over.");
+        }
+        else {
+            for (int j = 0; j < WIDE_JUMP_BYTES; j++) {
+                operand[j] = BYTE_FROM_4WORD(distance, j);
+            }
+        }
+    }
+    FREE_ARRAY(JumpSite, jumps, count, MEM_COMPILER);
+}
+
+static void patchJump(Compiler* compiler, size_t jump) {
+    size_t offset = releaseMark(compiler, jump);
+    if (compiler->parser.hadError) {
+        // The jump itself may be missing if the chunk could not grow, and
+        // the code is never run anyway
+        return;
+    }
+    Chunk* chunk = currentChunk(compiler);
+    size_t distance = chunk->count - offset - SHORT_JUMP_BYTES;
+    if (distance > JUMP_MAX) {
+        widenJump(compiler, offset - 1, chunk->count);
+        return;
+    }
+
+    chunk->code[offset] = BYTE_FROM_2WORD(distance, 0);
+    chunk->code[offset + 1] = BYTE_FROM_2WORD(distance, 1);
+}
+
+// Returns NULL after reporting an error if the string could not be made
+static ObjString* internString(Compiler* compiler, const char* chars,
+        int length) {
+    ObjString* string = copyString(
+        compiler->freeList, compiler->strings, chars, length);
+    if (string == NULL) {
+        error(compiler, "Out of memory.");
+    }
+    return string;
 }
 
 static size_t identifierConstant(Compiler* compiler, Token* name) {
-    int result = addConstant(
-        compiler->parser.currentChunk,
-        OBJ_VAL(copyString(
-            compiler->freeList, compiler->strings, name->start, name->length))
-    );
+    ObjString* string = internString(compiler, name->start, name->length);
+    if (string == NULL) {
+        return 0;
+    }
+    int result = addConstant(compiler->parser.currentChunk, OBJ_VAL(string));
     if (result < 0) {
-        error(compiler, "Too many constants in one chunk.");
+        constantError(compiler);
     }
     return (size_t) result;
 }
@@ -230,12 +475,26 @@ static void addLocal(Compiler* compiler, Token name, bool constDecl) {
             compiler->locals,
             Local,
             compiler->localCapacity,
-            newCapacity);
+            newCapacity, MEM_COMPILER);
         compiler->localCapacity = newCapacity;
     }
 #endif
     Local* local = &compiler->locals[compiler->localCount++];
     local->name = name;
+#ifdef CLOX_STREAMING_SOURCE
+    if (compiler->parser.scanner->file != NULL) {
+        // Token text only lives until the scanner moves on, so keep the
+        // name in the interned string instead
+        ObjString* string = internString(compiler, name.start, name.length);
+        if (string == NULL) {
+            // Keep the slot, under a name nothing can refer to
+            local->name.length = 0;
+        }
+        else {
+            local->name.start = string->chars;
+        }
+    }
+#endif
     local->depth = -1;
 #ifdef CLOX_CONST_KEYWORD
     local->constant = constDecl;
@@ -289,12 +548,12 @@ static void defineVariable(Compiler* compiler, size_t global, bool constDecl) {
     if (global > CHUNK_SHORT_CONSTANTS) {
         uint8_t opcode;
         if (constDecl) {
-            opcode = OP_DEFINE_GLOBAL_CONST_LONG;
+            opcode = OP_DEFINE_GLOBAL_CONST;
         }
         else {
-            opcode = OP_DEFINE_GLOBAL_LONG;
+            opcode = OP_DEFINE_GLOBAL;
         }
-        emitBytesLong(compiler, opcode, global);
+        emitWide(compiler, opcode, global);
     }
     #else
     if (global > CHUNK_SHORT_CONSTANTS) {
@@ -337,15 +596,34 @@ static void or_(Compiler* compiler, bool canAssign) {
 
 static void number(Compiler* compiler, bool canAssign) {
     UNUSED(canAssign);
-    TokenType numberType = compiler->parser.previous.type;
+    Token* token = &compiler->parser.previous;
+    TokenType numberType = token->type;
     Value value;
     if (numberType == TOKEN_NUMBER) {
-        double vfloat = strtod(compiler->parser.previous.start, NULL);
+#ifdef CLOX_FAST_NUMBER_PARSE
+        double vfloat = parseFloatLiteral(
+            token->start, token->length, token->point);
+#else
+        double vfloat = strtod(token->start, NULL);
+#endif
         value = FLOAT_VAL(vfloat);
     }
 #ifdef CLOX_INTEGER_TYPE
     else if (numberType == TOKEN_INTEGER) {
-        int64_t vint = strtoll(compiler->parser.previous.start, NULL, 10);
+        int64_t vint;
+#ifdef CLOX_FAST_NUMBER_PARSE
+        if (!parseIntegerLiteral(token->start, token->length, &vint)) {
+            error(compiler, "Integer literal too large.");
+            return;
+        }
+#else
+        errno = 0;
+        vint = strtoll(token->start, NULL, 10);
+        if (errno == ERANGE) {
+            error(compiler, "Integer literal too large.");
+            return;
+        }
+#endif
         value = INT_VAL(vint);
     }
 #endif
@@ -358,11 +636,13 @@ static void number(Compiler* compiler, bool canAssign) {
 
 static void string(Compiler* compiler, bool canAssign) {
     UNUSED(canAssign);
-    emitConstant(compiler, OBJ_VAL(copyString(
-        compiler->freeList,
-        compiler->strings,
+    ObjString* string = internString(compiler,
         compiler->parser.previous.start + 1,
-        compiler->parser.previous.length - 2)));
+        compiler->parser.previous.length - 2);
+    if (string == NULL) {
+        return;
+    }
+    emitConstant(compiler, OBJ_VAL(string));
 }
 
 static void namedVariable(Compiler* compiler, Token name, bool canAssign) {
@@ -375,8 +655,8 @@ static void namedVariable(Compiler* compiler, Token name, bool canAssign) {
 #ifdef CLOX_LONG_LOCALS
         if (arg >= DEFAULT_LOCAL_COUNT) {
             shortOp = false;
-            setOp = OP_SET_LOCAL_LONG;
-            getOp = OP_GET_LOCAL_LONG;
+            setOp = OP_SET_LOCAL;
+            getOp = OP_GET_LOCAL;
         }
 #else
         if (arg > DEFAULT_LOCAL_COUNT) {
@@ -394,8 +674,8 @@ static void namedVariable(Compiler* compiler, Token name, bool canAssign) {
 #ifdef CLOX_LONG_CONSTANTS
         if (arg > CHUNK_SHORT_CONSTANTS) {
             shortOp = false;
-            setOp = OP_SET_GLOBAL_LONG;
-            getOp = OP_GET_GLOBAL_LONG;
+            setOp = OP_SET_GLOBAL;
+            getOp = OP_GET_GLOBAL;
         }
 #else
         if (arg > CHUNK_SHORT_CONSTANTS) {
@@ -430,10 +710,10 @@ static void namedVariable(Compiler* compiler, Token name, bool canAssign) {
                     "Cannot overwrite the value of a local const.");
                 return;
             }
-            emitBytesLong(compiler, setOp, arg);
+            emitWide(compiler, setOp, arg);
         }
         else {
-            emitBytesLong(compiler, getOp, arg);
+            emitWide(compiler, getOp, arg);
         }
     }
 }
@@ -614,7 +894,7 @@ static void printStatement(Compiler* compiler) {
 }
 
 static void whileStatement(Compiler* compiler) {
-    size_t loopStart = currentChunk(compiler)->count;
+    size_t loopStart = markLoopStart(compiler);
 
     consume(compiler, TOKEN_LEFT_PAREN, "Expect '(' after 'while'.");
     expression(compiler);
@@ -685,7 +965,7 @@ static void forStatement(Compiler* compiler) {
         expressionStatement(compiler);
     }
 
-    size_t loopStart = currentChunk(compiler)->count;
+    size_t loopStart = markLoopStart(compiler);
 
     size_t exitJump = (size_t) -1;
 
@@ -701,7 +981,7 @@ static void forStatement(Compiler* compiler) {
     if (!match(compiler, TOKEN_RIGHT_PAREN)) {
         size_t bodyJump = emitJump(compiler, OP_JUMP);
 
-        size_t incrementStart = currentChunk(compiler)->count;
+        size_t incrementStart = markLoopStart(compiler);
         expression(compiler);
         emitByte(compiler, OP_POP);
         consume(compiler, TOKEN_RIGHT_PAREN,
@@ -793,45 +1073,144 @@ static void initCompiler(Compiler* compiler) {
     compiler->scopeDepth = 0;
 #ifdef CLOX_LONG_LOCALS
     compiler->localCapacity = DEFAULT_LOCAL_COUNT;
-    compiler->locals = ALLOCATE(Local, compiler->localCapacity, false);
+    compiler->locals = ALLOCATE(Local, compiler->localCapacity, false,
+        MEM_COMPILER);
 #endif
+    compiler->marks = NULL;
+    compiler->markCount = 0;
+    compiler->markCapacity = 0;
+    compiler->declarationStart = 0;
 }
 
 static void freeCompiler(Compiler* compiler) {
 #ifdef CLOX_LONG_LOCALS
-    FREE_ARRAY(Local, compiler->locals, compiler->localCapacity);
+    FREE_ARRAY(Local, compiler->locals, compiler->localCapacity,
+        MEM_COMPILER);
     compiler->locals = NULL;
-#else
-    UNUSED(compiler);
 #endif
+    FREE_ARRAY(size_t, compiler->marks, compiler->markCapacity, MEM_COMPILER);
+    compiler->marks = NULL;
 }
 
-bool compile(VM* vm, const char* source, Chunk* chunk) {
-    Scanner scanner;
-    initScanner(&scanner, source);
+// Runs the code compiled since the last batch, leaving the chunk ready
+// for more code to be added after it
+// Returns INTERPRET_COMPILE_ERROR after reporting an error if the batch
+// cannot be ended with a return, in which case nothing is run
+static InterpretResult flushBatch(Compiler* compiler, VM* vm,
+        BatchFn onBatch, size_t* batchStart) {
+    Chunk* chunk = currentChunk(compiler);
+    // Written directly, since a batch without its return must not run
+    if (writeChunk(chunk, OP_RETURN, compiler->parser.previous.line) < 0) {
+        error(compiler, "Failed chunk allocation.");
+        return INTERPRET_COMPILE_ERROR;
+    }
+    InterpretResult result = onBatch(vm, chunk, *batchStart);
+    unwriteChunk(chunk, compiler->parser.previous.line);
+    *batchStart = chunk->count;
+    return result;
+}
 
+static InterpretResult compileScanner(VM* vm, Scanner* scanner, Chunk* chunk,
+        Table* strings, FreeList* objects, size_t sourceSize,
+        BatchFn onBatch) {
+    PROBE1(compile__start, sourceSize);
     Compiler compiler;
     initCompiler(&compiler);
 
     Parser* parser = &compiler.parser;
-    parser->scanner = &scanner;
+    parser->scanner = scanner;
+#ifdef CLOX_PIPELINED_SCANNER
+    Pipeline pipeline;
+    parser->pipeline = NULL;
+    if (sourceSize >= vm->pipelineThreshold &&
+            startPipeline(&pipeline, scanner)) {
+        parser->pipeline = &pipeline;
+    }
+#else
+    UNUSED(sourceSize);
+#endif
     parser->currentChunk = chunk;
     parser->hadError = false;
     parser->panicMode = false;
     parser->previous.type = TOKEN_ERROR;
     parser->current.type = TOKEN_ERROR;
 
-    compiler.strings = &vm->strings;
-    compiler.freeList = &vm->freeList;
+    compiler.strings = strings;
+    compiler.freeList = objects;
+    compiler.errors = vm->err;
 
     advance(&compiler);
 
+    InterpretResult result = INTERPRET_OK;
+    size_t batchStart = 0;
     while(!match(&compiler, TOKEN_EOF)) {
+        compiler.declarationStart = chunk->count;
         declaration(&compiler);
+        // Top-level declarations leave no jumps to patch, so everything
+        // before here can already run
+        if (onBatch != NULL && !parser->hadError &&
+                chunk->count - batchStart >= BATCH_SIZE) {
+            result = flushBatch(&compiler, vm, onBatch, &batchStart);
+            if (result != INTERPRET_OK) {
+                break;
+            }
+        }
     }
 
     endCompiler(&compiler);
     freeCompiler(&compiler);
+#ifdef CLOX_PIPELINED_SCANNER
+    if (parser->pipeline != NULL) {
+        stopPipeline(parser->pipeline);
+    }
+#endif
+
+    if (parser->hadError) {
+        PROBE1(compile__end, (int)INTERPRET_COMPILE_ERROR);
+        return INTERPRET_COMPILE_ERROR;
+    }
+    PROBE1(compile__end, (int)result);
+    if (onBatch != NULL && result == INTERPRET_OK) {
+        result = onBatch(vm, chunk, batchStart);
+    }
+    return result;
+}
 
-    return !compiler.parser.hadError;
-}
\ No newline at end of file
+// Compiles source into chunk, interning the strings it uses into strings
+// and keeping them in objects
+// If onBatch is not NULL, code is handed to it in batches while compiling
+// continues, stopping at the first batch that does not return INTERPRET_OK
+InterpretResult compile(VM* vm, const char* source, Chunk* chunk,
+        Table* strings, FreeList* objects, BatchFn onBatch) {
+    Scanner scanner;
+    initScanner(&scanner, source);
+    InterpretResult result = compileScanner(vm, &scanner, chunk, strings,
+        objects, strlen(source), onBatch);
+    freeScanner(&scanner);
+    return result;
+}
+
+#ifdef CLOX_STREAMING_SOURCE
+// Returns the number of bytes left to read in the file, or 0 if it cannot
+// be determined
+static size_t remainingSize(FILE* file) {
+    long position = ftell(file);
+    if (position < 0 || fseek(file, 0L, SEEK_END) != 0) {
+        return 0;
+    }
+    long end = ftell(file);
+    fseek(file, position, SEEK_SET);
+    return end < position ? 0 : (size_t)(end - position);
+}
+
+// Compiles directly from a file without reading all of it into memory
+InterpretResult compileFile(VM* vm, FILE* file, Chunk* chunk,
+        Table* strings, FreeList* objects, BatchFn onBatch) {
+    Scanner scanner;
+    initFileScanner(&scanner, file);
+    InterpretResult result = compileScanner(vm, &scanner, chunk, strings,
+        objects, remainingSize(file), onBatch);
+    freeScanner(&scanner);
+    return result;
+}
+#endif
\ No newline at end of file
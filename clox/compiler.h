@@ -7,6 +7,7 @@
 #include "table.h"
 #include "bitfield.h"
 #include "common.h"
+#include "pipeline.h"
 
 typedef struct {
     Token current;
@@ -14,6 +15,10 @@ typedef struct {
     bool hadError;
     bool panicMode;
     Scanner* scanner;
+#ifdef CLOX_PIPELINED_SCANNER
+    // NULL when scanning on the compiling thread
+    Pipeline* pipeline;
+#endif
     Chunk* currentChunk;
 } Parser;
 
@@ -33,8 +38,6 @@ typedef struct {
     #define MAX_LOCAL_COUNT DEFAULT_LOCAL_COUNT
 #endif
 
-#define JUMP_MAX UINT16_MAX
-
 typedef struct Compiler {
 #ifdef CLOX_LONG_LOCALS
     Local* locals;
@@ -46,11 +49,24 @@ typedef struct Compiler {
     Parser parser;
     FreeList* freeList;
     Table* strings;
+    // Where compile errors are written
+    FILE* errors;
 #ifdef CLOX_LONG_LOCALS
     size_t localCapacity;
 #endif
+    // Offsets that move along with the code when a jump is widened: the
+    // operands of jumps not patched yet and the starts of loops not closed
+    // yet. Released entries are NO_MARK.
+    size_t* marks;
+    size_t markCount;
+    size_t markCapacity;
+    // Start of the top-level declaration being compiled. No jump crosses it,
+    // so widening a jump never has to look at the code before it.
+    size_t declarationStart;
 } Compiler;
 
+#define NO_MARK ((size_t) -1)
+
 typedef void (*ParseFn)(Compiler *, bool);
 
 typedef enum {
@@ -73,6 +89,18 @@ typedef struct {
     Precedence precedence;
 } ParseRule;
 
-bool compile(VM* vm, const char* source, Chunk* chunk);
+// Minimum number of bytes of top-level code to run at once when compiling
+// incrementally
+#define BATCH_SIZE 256
+
+// Runs the code in chunk from offset start up to its final OP_RETURN
+typedef InterpretResult (*BatchFn)(VM* vm, Chunk* chunk, size_t start);
+
+InterpretResult compile(VM* vm, const char* source, Chunk* chunk,
+    Table* strings, FreeList* objects, BatchFn onBatch);
+#ifdef CLOX_STREAMING_SOURCE
+InterpretResult compileFile(VM* vm, FILE* file, Chunk* chunk,
+    Table* strings, FreeList* objects, BatchFn onBatch);
+#endif
 
 #endif
\ No newline at end of file
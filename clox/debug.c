@@ -17,50 +17,46 @@ static size_t simpleInstruction(const char* name, size_t offset) {
     return offset + 1;
 }
 
-static size_t byteInstruction(const char* name, Chunk* chunk, size_t offset, bool longConstant) {
-    size_t constant;
-    size_t newOffset;
-    if (longConstant) {
-        constant = COMBINE_3WORD(
-            chunk->code[offset + 1],
+// Reads the index operand of the instruction at offset
+static size_t readIndex(Chunk* chunk, size_t offset, bool wide) {
+    if (wide) {
+        return COMBINE_3WORD(
             chunk->code[offset + 2],
-            chunk->code[offset + 3]
+            chunk->code[offset + 3],
+            chunk->code[offset + 4]
         );
-        newOffset = offset + 4;
-    }
-    else {
-        constant = chunk->code[offset + 1];
-        newOffset = offset + 2;
     }
+    return chunk->code[offset + 1];
+}
+
+static size_t byteInstruction(const char* name, Chunk* chunk, size_t offset,
+        bool wide) {
+    size_t constant = readIndex(chunk, offset, wide);
     printf("%-16s %4" FORMAT_SIZE_T "\n", name, constant);
-    return newOffset;
+    return offset + instructionSize(chunk, offset);
 }
 
 static size_t jumpInstruction(const char* name, int sign, Chunk* chunk,
-        size_t offset) {
-    uint16_t jump = COMBINE_2WORD(
-        chunk->code[offset + 1], chunk->code[offset + 2]);
+        size_t offset, bool wide) {
+    size_t jump;
+    if (wide) {
+        jump = COMBINE_4WORD(
+            chunk->code[offset + 2], chunk->code[offset + 3],
+            chunk->code[offset + 4], chunk->code[offset + 5]);
+    }
+    else {
+        jump = COMBINE_2WORD(
+            chunk->code[offset + 1], chunk->code[offset + 2]);
+    }
+    size_t next = offset + instructionSize(chunk, offset);
     printf("%-16s %4" FORMAT_SIZE_T " -> %" FORMAT_SIZE_T "\n",
-        name, offset, offset + 3 + (size_t) (sign * (int) jump));
-    return offset + 3;
+        name, offset, sign > 0 ? next + jump : next - jump);
+    return next;
 }
 
 static size_t constantInstruction(const char* name, Chunk* chunk,
-        size_t offset, bool longConstant) {
-    size_t constant;
-    size_t newOffset;
-    if (longConstant) {
-        constant = COMBINE_3WORD(
-            chunk->code[offset + 1],
-            chunk->code[offset + 2],
-            chunk->code[offset + 3]
-        );
-        newOffset = offset + 4;
-    }
-    else {
-        constant = chunk->code[offset + 1];
-        newOffset = offset + 2;
-    }
+        size_t offset, bool wide) {
+    size_t constant = readIndex(chunk, offset, wide);
     printf("%-16s %4" FORMAT_SIZE_T " ", name, constant);
     Value value = chunk->constants.values[constant];
 #ifdef DEBUG_PRINT_VALUE_TYPE
@@ -69,35 +65,28 @@ static size_t constantInstruction(const char* name, Chunk* chunk,
     printf("'");
     printValue(value);
     printf("'\n");
-    return newOffset;
+    return offset + instructionSize(chunk, offset);
 }
 
-static const char* opName(uint8_t opcode) {
+// Returns the name of opcode, or NULL if it is not an opcode
+const char* opName(uint8_t opcode) {
     switch (opcode) {
+        case OP_WIDE:
+            return "OP_WIDE";
         case OP_CONSTANT:
             return "OP_CONSTANT";
-        case OP_CONSTANT_LONG:
-            return "OP_CONSTANT_LONG";
         case OP_DEFINE_GLOBAL:
             return "OP_DEFINE_GLOBAL";
-        case OP_DEFINE_GLOBAL_LONG:
-            return "OP_DEFINE_GLOBAL_LONG";
+        case OP_DEFINE_GLOBAL_CONST:
+            return "OP_DEFINE_GLOBAL_CONST";
         case OP_GET_GLOBAL:
             return "OP_GET_GLOBAL";
-        case OP_GET_GLOBAL_LONG:
-            return "OP_GET_GLOBAL_LONG";
         case OP_SET_GLOBAL:
             return "OP_SET_GLOBAL";
-        case OP_SET_GLOBAL_LONG:
-            return "OP_SET_GLOBAL_LONG";
         case OP_GET_LOCAL:
             return "OP_GET_LOCAL";
-        case OP_GET_LOCAL_LONG:
-            return "OP_GET_LOCAL_LONG";
         case OP_SET_LOCAL:
             return "OP_SET_LOCAL";
-        case OP_SET_LOCAL_LONG:
-            return "OP_SET_LOCAL_LONG";
         case OP_NIL:
             return "OP_NIL";
         case OP_TRUE:
@@ -150,28 +139,29 @@ size_t disassembleInstruction(Chunk* chunk, size_t offset) {
     }
 
     uint8_t instruction = chunk->code[offset];
+    bool wide = instruction == OP_WIDE;
+    if (wide) {
+        printf("%s ", opName(instruction));
+        instruction = chunk->code[offset + 1];
+    }
     switch (instruction) {
         case OP_CONSTANT:
         case OP_DEFINE_GLOBAL:
+        case OP_DEFINE_GLOBAL_CONST:
         case OP_GET_GLOBAL:
         case OP_SET_GLOBAL:
-            return constantInstruction(opName(instruction), chunk, offset, false);
-        case OP_CONSTANT_LONG:
-        case OP_DEFINE_GLOBAL_LONG:
-        case OP_GET_GLOBAL_LONG:
-        case OP_SET_GLOBAL_LONG:
-            return constantInstruction(opName(instruction), chunk, offset, true);
+            return constantInstruction(opName(instruction), chunk, offset,
+                wide);
         case OP_GET_LOCAL:
         case OP_SET_LOCAL:
-            return byteInstruction(opName(instruction), chunk, offset, false);
-        case OP_GET_LOCAL_LONG:
-        case OP_SET_LOCAL_LONG:
-            return byteInstruction(opName(instruction), chunk, offset, true);
+            return byteInstruction(opName(instruction), chunk, offset, wide);
         case OP_JUMP:
         case OP_JUMP_IF_FALSE:
-            return jumpInstruction(opName(instruction), 1, chunk, offset);
+            return jumpInstruction(opName(instruction), 1, chunk, offset,
+                wide);
         case OP_LOOP:
-            return jumpInstruction(opName(instruction), -1, chunk, offset);
+            return jumpInstruction(opName(instruction), -1, chunk, offset,
+                wide);
         default: {
             const char* name = opName(instruction);
             if (name == NULL) {
@@ -5,5 +5,6 @@
 
 void disassembleChunk(Chunk* chunk, const char* name);
 size_t disassembleInstruction(Chunk* chunk, size_t offset);
+const char* opName(uint8_t opcode);
 
 #endif
\ No newline at end of file
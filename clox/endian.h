@@ -13,6 +13,11 @@
     (uint8_t) (((size_t) (word)) >> (8 * (byteNum)) & ((uint8_t) 0xFF))
 #define COMBINE_3WORD(part1, part2, part3) \
     ((size_t)(part1) | (size_t)((part2) << 8) | (size_t)((part3) << (8 * 2)))
+#define BYTE_FROM_4WORD(word, byteNum) \
+    (uint8_t) (((uint32_t) (word)) >> (8 * (byteNum)) & ((uint8_t) 0xFF))
+#define COMBINE_4WORD(part1, part2, part3, part4) \
+    ((uint32_t)(part1) | ((uint32_t)(part2) << 8) | \
+        ((uint32_t)(part3) << (8 * 2)) | ((uint32_t)(part4) << (8 * 3)))
 #else
 // Big endian definition
 #define BYTE_FROM_2WORD(word, byteNum) \
@@ -23,6 +28,11 @@
     (((size_t) (word)) >> (8 * (2 - byteNum)) & ((uint8_t) 0xFF))
 #define COMBINE_3WORD(part1, part2, part3) \
     ((size_t)(part3) | (size_t)((part2) << 8) | (size_t)((part1) << (8 * 2)))
+#define BYTE_FROM_4WORD(word, byteNum) \
+    (((uint32_t) (word)) >> (8 * (3 - byteNum)) & ((uint8_t) 0xFF))
+#define COMBINE_4WORD(part1, part2, part3, part4) \
+    ((uint32_t)(part4) | ((uint32_t)(part3) << 8) | \
+        ((uint32_t)(part2) << (8 * 2)) | ((uint32_t)(part1) << (8 * 3)))
 #endif
 
 #endif
\ No newline at end of file
@@ -0,0 +1,156 @@
+// sigaction and clock_gettime
+#define _XOPEN_SOURCE 600
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "livestats.h"
+
+#ifdef CLOX_LIVE_STATS
+
+// Longest line writeLiveStats can produce
+#define LIVE_STATS_LINE 512
+
+// Only one VM can answer SIGUSR1
+static VM* statsVM = NULL;
+static int statsFd = -1;
+static struct timespec startTime;
+
+// Everything below runs in signal context, so it only formats into a
+// buffer on the stack and hands it to write
+
+static void appendString(char* buffer, size_t* length, const char* string) {
+    while (*string != '\0' && *length < LIVE_STATS_LINE - 1) {
+        buffer[(*length)++] = *string++;
+    }
+}
+
+static void appendField(char* buffer, size_t* length, const char* key,
+        uint64_t value) {
+    char digits[24];
+    size_t count = 0;
+    do {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    if (*length != 0) {
+        appendString(buffer, length, " ");
+    }
+    appendString(buffer, length, key);
+    appendString(buffer, length, "=");
+    while (count > 0 && *length < LIVE_STATS_LINE - 1) {
+        buffer[(*length)++] = digits[--count];
+    }
+}
+
+// Writes one line of space-separated key=value pairs describing vm to fd
+// Async-signal-safe, although the counters may be a moment apart
+void writeLiveStats(VM* vm, int fd) {
+    char buffer[LIVE_STATS_LINE];
+    size_t length = 0;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t uptime = (uint64_t)(now.tv_sec - startTime.tv_sec) * 1000u +
+        (uint64_t)((now.tv_nsec - startTime.tv_nsec) / 1000000L);
+
+#ifdef CLOX_VARIABLE_STACK
+    size_t depth = vm->stack == NULL ? 0 :
+        (size_t)(vm->stackTop - vm->stack);
+#else
+    size_t depth = (size_t)(vm->stackTop - vm->stack);
+#endif
+    // Between growths the stack may be deeper than when it last grew
+    if (depth > vm->stackHighWater) {
+        vm->stackHighWater = depth;
+    }
+
+    appendField(buffer, &length, "pid", (uint64_t)getpid());
+    appendField(buffer, &length, "uptime_ms", uptime);
+    appendField(buffer, &length, "loop_bytes", vm->loopBytes +
+        ((uint64_t)vm->fullFuel - (uint64_t)vm->fuel));
+    if (vm->countInstructions) {
+        appendField(buffer, &length, "instructions", vm->executed);
+    }
+    appendField(buffer, &length, "heap_bytes",
+        __atomic_load_n(&vm->heap.bytes, __ATOMIC_RELAXED));
+    appendField(buffer, &length, "heap_peak_bytes",
+        __atomic_load_n(&vm->heap.peakBytes, __ATOMIC_RELAXED));
+    appendField(buffer, &length, "live_objects",
+        vm->heap.categories[MEM_STRING_OBJECTS].blocks);
+    appendField(buffer, &length, "interned_strings", vm->strings.count);
+    appendField(buffer, &length, "globals", vm->globals.count);
+    appendField(buffer, &length, "stack_depth", depth);
+    appendField(buffer, &length, "stack_high_water", vm->stackHighWater);
+#ifdef CLOX_VARIABLE_STACK
+    appendField(buffer, &length, "stack_capacity",
+        vm->stack == NULL ? 0 : STACK_CAPACITY(vm));
+#else
+    appendField(buffer, &length, "stack_capacity", STACK_DEFAULT);
+#endif
+    buffer[length++] = '\n';
+
+    const char* next = buffer;
+    while (length > 0) {
+        ssize_t written = write(fd, next, length);
+        if (written <= 0) {
+            break;
+        }
+        next += written;
+        length -= (size_t)written;
+    }
+}
+
+static void dumpLiveStats(int signal) {
+    UNUSED(signal);
+    // write may set errno, which the interrupted code could be about to read
+    int savedErrno = errno;
+    if (statsVM != NULL) {
+        writeLiveStats(statsVM, statsFd);
+    }
+    errno = savedErrno;
+}
+
+// Writes a line of stats about vm to the file at path, or to stderr if
+// path is NULL, each time the process gets SIGUSR1
+// Returns false if the file could not be opened or the handler installed
+bool startLiveStats(VM* vm, const char* path) {
+    int fd = STDERR_FILENO;
+    if (path != NULL) {
+        fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd < 0) {
+            return false;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    statsVM = vm;
+    statsFd = fd;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = dumpLiveStats;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    if (sigaction(SIGUSR1, &action, NULL) != 0) {
+        stopLiveStats();
+        return false;
+    }
+    return true;
+}
+
+// Goes back to ignoring SIGUSR1 and closes any file being written
+void stopLiveStats(void) {
+    signal(SIGUSR1, SIG_IGN);
+    if (statsFd >= 0 && statsFd != STDERR_FILENO) {
+        close(statsFd);
+    }
+    statsVM = NULL;
+    statsFd = -1;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,15 @@
+#ifndef clox_livestats_h
+#define clox_livestats_h
+
+#include "common.h"
+#include "vm.h"
+
+#ifdef CLOX_LIVE_STATS
+
+bool startLiveStats(VM* vm, const char* path);
+void stopLiveStats(void);
+void writeLiveStats(VM* vm, int fd);
+
+#endif
+
+#endif
\ No newline at end of file
@@ -1,3 +1,7 @@
+// For open_memstream
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,9 +11,141 @@
 #include "chunk.h"
 #include "debug.h"
 #include "vm.h"
+#include "livestats.h"
+#include "server.h"
+#include "snapshot.h"
+
+#ifdef CLOX_PARALLEL_JOBS
+#include <pthread.h>
+#endif
+#ifdef PLATFORM_UNIX
+#include <unistd.h>
+#endif
 
 VM vm;
 
+#ifdef CLOX_PROFILE_OPS
+static OpProfile opProfile;
+// Where to write the profile as JSON, or NULL to print a table to stderr
+static const char* opProfilePath = NULL;
+#endif
+
+#ifdef CLOX_SAMPLING_PROFILER
+static Sampler sampler;
+static bool sampling = false;
+static unsigned samplerRate = SAMPLER_DEFAULT_RATE;
+// Where to write collapsed stacks, or NULL to print a report to stderr
+static const char* samplerPath = NULL;
+#endif
+
+#ifdef CLOX_PERF_COUNTERS
+static PerfCounters perfCounters;
+static bool countersWanted = false;
+#endif
+
+// Set once --flush has chosen when output is written
+static bool flushChosen = false;
+static bool memStats = false;
+static bool counts = false;
+// Run every path given, or read from stdin, in the same process
+static bool batch = false;
+// Threads running a batch, each with its own VM, or 0 to run it on the
+// main thread
+static int jobCount = 0;
+// The last option given that only applies to the main VM, which cannot be
+// used with jobCount or servePath
+static const char* mainVMOption = NULL;
+#ifdef CLOX_SERVE
+// Socket to serve requests on instead of running scripts, or NULL
+static const char* servePath = NULL;
+#endif
+
+#ifdef CLOX_SNAPSHOT
+// Image to start the VM from, and to save it to after the script has run,
+// or NULL for neither
+static const char* snapshotPath = NULL;
+static const char* saveSnapshotPath = NULL;
+#endif
+
+// Starts the line written to stdout and stderr after each script in a
+// batch, followed by a tab, the script's exit code, a tab and its path
+#define BATCH_MARKER "#clox-batch"
+
+static void reportCounts(VM* counted) {
+    fflush(counted->out);
+    fprintf(counted->err, "instructions: %llu\n",
+        (unsigned long long)counted->executed);
+    fprintf(counted->err, "bytecode: %llu\n",
+        (unsigned long long)counted->emitted);
+}
+
+// Prints any profiles that were asked for
+static void report(void) {
+    // A batch reports counts for each script instead
+    if (counts && !batch) {
+        reportCounts(&vm);
+    }
+    if (memStats) {
+        fflush(stdout);
+        printHeapStats(&vm.heap, stderr);
+    }
+#ifdef CLOX_TABLE_STATS
+    if (vm.countTables) {
+        fflush(stdout);
+        printTableStats(vm.tableStats, VM_TABLE_COUNT, stderr);
+    }
+#endif
+#ifdef CLOX_PERF_COUNTERS
+    if (vm.perf != NULL) {
+        fflush(stdout);
+        printPerfCounters(vm.perf, vm.executed, stderr);
+        closePerfCounters(vm.perf);
+        vm.perf = NULL;
+    }
+#endif
+#ifdef CLOX_PROFILE_OPS
+    if (vm.opProfile != NULL) {
+        fflush(stdout);
+        if (opProfilePath == NULL) {
+            printOpProfile(vm.opProfile, stderr);
+        }
+        else {
+            FILE* file = fopen(opProfilePath, "w");
+            if (file == NULL) {
+                fprintf(stderr, "Could not open file \"%s\".\n",
+                    opProfilePath);
+            }
+            else {
+                writeOpProfileJson(vm.opProfile, file);
+                fclose(file);
+            }
+        }
+    }
+#endif
+#ifdef CLOX_SAMPLING_PROFILER
+    if (vm.sampler != NULL) {
+        stopSampler(vm.sampler);
+        fflush(stdout);
+        if (samplerPath == NULL) {
+            printSampleReport(vm.sampler, stderr);
+        }
+        else {
+            FILE* file = fopen(samplerPath, "w");
+            if (file == NULL) {
+                fprintf(stderr, "Could not open file \"%s\".\n",
+                    samplerPath);
+            }
+            else {
+                writeCollapsedStacks(vm.sampler, file);
+                fclose(file);
+            }
+        }
+        freeSampler(vm.sampler);
+        vm.sampler = NULL;
+    }
+#endif
+}
+
 void repl() {
     char line[1024];
     memset(line, 0, sizeof(line));
@@ -24,12 +160,13 @@ void repl() {
     }
 }
 
+#ifndef CLOX_STREAMING_SOURCE
 static char* readFile(const char* path) {
     FILE* file = fopen(path, "rb");
 
     if (file == NULL) {
         fprintf(stderr, "Could not open file \"%s\".\n", path);
-        exit(74);
+        return NULL;
     }
 
     fseek(file, 0L, SEEK_END);
@@ -56,33 +193,756 @@ static char* readFile(const char* path) {
     return buffer;
 }
 
+#endif
+
+// The exit code clox gives for result
+int exitCode(InterpretResult result) {
+    switch (result) {
+        case INTERPRET_COMPILE_ERROR: return 65;
+        case INTERPRET_RUNTIME_ERROR:
+        case INTERPRET_BUDGET_EXCEEDED:
+        case INTERPRET_INTERRUPTED:
+            return 70;
+        default: return 0;
+    }
+}
+
+// Runs the script at path, returning the exit code for its result
+static int runScript(VM* runner, const char* path) {
+#ifdef CLOX_STREAMING_SOURCE
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(runner->err, "Could not open file \"%s\".\n", path);
+        return 74;
+    }
+    // The scanner keeps its own window over the file
+    setvbuf(file, NULL, _IONBF, 0);
+    InterpretResult result = interpretFile(runner, file);
+    fclose(file);
+#else
+    char* source = readFile(path);
+    if (source == NULL) {
+        return 74;
+    }
+    InterpretResult result = interpret(runner, source);
+    free(source);
+#endif
+    return exitCode(result);
+}
+
 void runFile(const char* path) {
+    int status = runScript(&vm, path);
+    report();
+    if (status != 0) {
+        exit(status);
+    }
+}
+
+// Longest path a batch can run, with its terminator
+#define PATH_LENGTH 4096
+
+// Scripts to run in a batch: the arguments that are not options, or each
+// line of stdin
+typedef struct {
+    int argc;
+    const char** argv;
+    int next;
+    bool fromStdin;
+} PathQueue;
+
+// Copies the next path to run into path
+// Returns false when there are none left, or if the next is too long, in
+// which case status is set to 64
+static bool nextPath(PathQueue* queue, char* path, int* status) {
+    if (!queue->fromStdin) {
+        while (queue->next < queue->argc) {
+            const char* arg = queue->argv[queue->next++];
+            if (strncmp(arg, "--", 2) == 0) {
+                continue;
+            }
+            if (strlen(arg) >= PATH_LENGTH) {
+                fprintf(stderr, "Path is too long: \"%.40s...\".\n", arg);
+                *status = 64;
+                return false;
+            }
+            strcpy(path, arg);
+            return true;
+        }
+        return false;
+    }
+
+    while (fgets(path, PATH_LENGTH, stdin) != NULL) {
+        size_t length = strlen(path);
+        if (length == PATH_LENGTH - 1 && path[length - 1] != '\n') {
+            fprintf(stderr, "Path is too long: \"%.40s...\".\n", path);
+            *status = 64;
+            return false;
+        }
+        while (length > 0 &&
+                (path[length - 1] == '\n' || path[length - 1] == '\r')) {
+            path[--length] = '\0';
+        }
+        if (length > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Ends a script of a batch that exited with status, then resets the VM for
+// the next
+static int finishBatchScript(VM* runner, const char* path, int status) {
+    if (counts) {
+        reportCounts(runner);
+        runner->executed = 0;
+        runner->emitted = 0;
+    }
+    fflush(runner->out);
+    fprintf(runner->out, BATCH_MARKER "\t%d\t%s\n", status, path);
+    fprintf(runner->err, BATCH_MARKER "\t%d\t%s\n", status, path);
+    fflush(runner->out);
+    fflush(runner->err);
+    resetVM(runner);
+    return status;
+}
+
+// Runs a script of a batch, then resets the VM for the next
+static int runBatchScript(VM* runner, const char* path) {
+    return finishBatchScript(runner, path, runScript(runner, path));
+}
+
+// Returns 0 if every script succeeded, or else the exit code of the last
+// one that failed
+static int runBatch(PathQueue* queue) {
+    char path[PATH_LENGTH];
+    int result = 0;
+    while (nextPath(queue, path, &result)) {
+        int status = runBatchScript(&vm, path);
+        result = status != 0 ? status : result;
+    }
+    return result;
+}
+
+#ifdef CLOX_PARALLEL_JOBS
+// A path of the batch compiled once for every thread that runs it
+typedef struct SharedProgram {
+    char* path;
+    Program program;
+    // Set once the first thread to run the path has compiled it
+    bool ready;
+    // Set if it could not be compiled, in which case each run compiles it
+    // again to report why
+    bool failed;
+    struct SharedProgram* next;
+} SharedProgram;
+
+#define PROGRAM_BUCKETS 256
+
+// Shared by the threads running a batch
+typedef struct {
+    PathQueue* queue;
+    // Held to take a path, to look up or add a program, or to write output
+    pthread_mutex_t lock;
+    // Signalled whenever a program is ready
+    pthread_cond_t compiled;
+    SharedProgram* programs[PROGRAM_BUCKETS];
+    // Exit code of the last script that failed, or 0
+    int status;
+} Jobs;
+
+// Compiles the script at path into program
+// Returns the exit code for the result, which is 0 if program can be run
+static int compileScript(VM* runner, const char* path, Program* program) {
+#ifdef CLOX_STREAMING_SOURCE
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(runner->err, "Could not open file \"%s\".\n", path);
+        return 74;
+    }
+    setvbuf(file, NULL, _IONBF, 0);
+    InterpretResult result = compileProgramFile(runner, program, file);
+    fclose(file);
+#else
     char* source = readFile(path);
-    InterpretResult result = interpret(&vm, source);
+    if (source == NULL) {
+        return 74;
+    }
+    InterpretResult result = compileProgram(runner, program, source);
     free(source);
+#endif
+    return exitCode(result);
+}
 
-    if (result == INTERPRET_COMPILE_ERROR) {
-        exit(65);
+// Runs the script at path, compiling it only if no other thread has
+// Returns the exit code for its result
+static int runSharedScript(Jobs* jobs, VM* runner, const char* path) {
+    if (runner->incremental) {
+        // Its code runs as it is compiled, so there is nothing to share
+        return runScript(runner, path);
     }
-    if (result == INTERPRET_RUNTIME_ERROR) {
-        exit(70);
+
+    uint32_t bucket = hashString(path, (int)strlen(path)) % PROGRAM_BUCKETS;
+    pthread_mutex_lock(&jobs->lock);
+    SharedProgram* shared = jobs->programs[bucket];
+    while (shared != NULL && strcmp(shared->path, path) != 0) {
+        shared = shared->next;
+    }
+    if (shared != NULL) {
+        while (!shared->ready) {
+            pthread_cond_wait(&jobs->compiled, &jobs->lock);
+        }
+        pthread_mutex_unlock(&jobs->lock);
+        if (shared->failed) {
+            return runScript(runner, path);
+        }
+        return exitCode(runProgram(runner, &shared->program));
+    }
+
+    shared = (SharedProgram*)malloc(sizeof(SharedProgram));
+    char* copy = shared == NULL ? NULL : strdup(path);
+    if (copy == NULL) {
+        pthread_mutex_unlock(&jobs->lock);
+        free(shared);
+        return runScript(runner, path);
+    }
+    shared->path = copy;
+    shared->ready = false;
+    shared->next = jobs->programs[bucket];
+    jobs->programs[bucket] = shared;
+    pthread_mutex_unlock(&jobs->lock);
+
+    int status = compileScript(runner, path, &shared->program);
+
+    pthread_mutex_lock(&jobs->lock);
+    shared->ready = true;
+    shared->failed = status != 0;
+    pthread_cond_broadcast(&jobs->compiled);
+    pthread_mutex_unlock(&jobs->lock);
+    if (status != 0) {
+        return status;
+    }
+    return exitCode(runProgram(runner, &shared->program));
+}
+
+static void freeSharedPrograms(Jobs* jobs) {
+    for (int i = 0; i < PROGRAM_BUCKETS; i++) {
+        SharedProgram* shared = jobs->programs[i];
+        while (shared != NULL) {
+            SharedProgram* next = shared->next;
+            if (!shared->failed) {
+                freeProgram(&shared->program);
+            }
+            free(shared->path);
+            free(shared);
+            shared = next;
+        }
     }
 }
 
+// Runs scripts from the queue in a VM of its own until there are none left.
+// Each script's output is held until it is done, so that the output of
+// different scripts is never mixed.
+static void* runJobs(void* arg) {
+    Jobs* jobs = (Jobs*)arg;
+    VM runner;
+    initVM(&runner);
+    runner.incremental = vm.incremental;
+#ifdef CLOX_PIPELINED_SCANNER
+    runner.pipelineThreshold = vm.pipelineThreshold;
+#endif
+    runner.heap.limit = vm.heap.limit;
+    runner.countInstructions = vm.countInstructions;
+    runner.instructionLimit = vm.instructionLimit;
+
+    char path[PATH_LENGTH];
+    while (true) {
+        pthread_mutex_lock(&jobs->lock);
+        bool found = nextPath(jobs->queue, path, &jobs->status);
+        pthread_mutex_unlock(&jobs->lock);
+        if (!found) {
+            break;
+        }
+
+        char* out = NULL;
+        char* err = NULL;
+        size_t outSize = 0;
+        size_t errSize = 0;
+        runner.out = open_memstream(&out, &outSize);
+        runner.err = open_memstream(&err, &errSize);
+        if (runner.out == NULL || runner.err == NULL) {
+            // Run it while holding the lock instead
+            if (runner.out != NULL) {
+                fclose(runner.out);
+            }
+            if (runner.err != NULL) {
+                fclose(runner.err);
+            }
+            free(out);
+            free(err);
+            runner.out = stdout;
+            runner.err = stderr;
+            pthread_mutex_lock(&jobs->lock);
+            int status = runBatchScript(&runner, path);
+            jobs->status = status != 0 ? status : jobs->status;
+            pthread_mutex_unlock(&jobs->lock);
+            continue;
+        }
+
+        int status = finishBatchScript(&runner, path,
+            runSharedScript(jobs, &runner, path));
+        fclose(runner.out);
+        fclose(runner.err);
+
+        pthread_mutex_lock(&jobs->lock);
+        fwrite(out, 1, outSize, stdout);
+        fflush(stdout);
+        fwrite(err, 1, errSize, stderr);
+        fflush(stderr);
+        jobs->status = status != 0 ? status : jobs->status;
+        pthread_mutex_unlock(&jobs->lock);
+        free(out);
+        free(err);
+    }
+
+    runner.out = stdout;
+    runner.err = stderr;
+    freeVM(&runner);
+    return NULL;
+}
+
+// Runs the batch on count threads at once
+// Returns the same as runBatch
+static int runParallelBatch(PathQueue* queue, int count) {
+    Jobs jobs;
+    jobs.queue = queue;
+    jobs.status = 0;
+    pthread_mutex_init(&jobs.lock, NULL);
+    pthread_cond_init(&jobs.compiled, NULL);
+    for (int i = 0; i < PROGRAM_BUCKETS; i++) {
+        jobs.programs[i] = NULL;
+    }
+
+    pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t) * (size_t)count);
+    int started = 0;
+    while (threads != NULL && started < count &&
+            pthread_create(&threads[started], NULL, runJobs, &jobs) == 0) {
+        started++;
+    }
+    if (started == 0) {
+        runJobs(&jobs);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+
+    freeSharedPrograms(&jobs);
+    pthread_cond_destroy(&jobs.compiled);
+    pthread_mutex_destroy(&jobs.lock);
+    return jobs.status;
+}
+#endif
+
+static void usage(void) {
+    fprintf(stderr, "Usage: clox [options] [path]\n");
+    fprintf(stderr, "Usage: clox --batch [options] [paths]\n");
+    fprintf(stderr, "  --batch        Run every path given, or each line of "
+        "stdin, in turn,\n");
+    fprintf(stderr, "                 writing \"" BATCH_MARKER
+        "\\t<exit code>\\t<path>\" to stdout and\n");
+    fprintf(stderr, "                 stderr after each\n");
+#ifdef CLOX_PARALLEL_JOBS
+    fprintf(stderr, "  --jobs=N       Run a batch on N threads, each with its "
+        "own VM\n");
+#endif
+#ifdef CLOX_SERVE
+    fprintf(stderr, "  --serve=PATH   Run scripts sent to the Unix socket at "
+        "PATH on VMs kept\n");
+    fprintf(stderr, "                 warm between requests, one per --jobs "
+        "thread (default\n");
+    fprintf(stderr, "                 one per CPU)\n");
+#endif
+#ifdef CLOX_SNAPSHOT
+    fprintf(stderr, "  --snapshot=FILE\n");
+    fprintf(stderr, "                 Start from the globals saved to FILE "
+        "instead of running\n");
+    fprintf(stderr, "                 the scripts that defined them\n");
+    fprintf(stderr, "  --save-snapshot=FILE\n");
+    fprintf(stderr, "                 Save the globals defined by the time "
+        "the script ends to\n");
+    fprintf(stderr, "                 FILE\n");
+#endif
+    fprintf(stderr, "  --flush=line|size|exit\n");
+    fprintf(stderr, "                 Write what print statements print after "
+        "each line, each\n");
+    fprintf(stderr, "                 %d bytes or only once the script ends "
+        "(default line if\n", OUTPUT_BUFFER_SIZE);
+    fprintf(stderr, "                 stdout is a terminal, else size)\n");
+    fprintf(stderr, "  --incremental  Run top-level code while compiling\n");
+#ifdef CLOX_PIPELINED_SCANNER
+    fprintf(stderr, "  --pipeline     Always scan on a separate thread\n");
+    fprintf(stderr, "  --no-pipeline  Never scan on a separate thread\n");
+#endif
+#ifdef CLOX_PROFILE_OPS
+    fprintf(stderr, "  --profile-ops[=file]\n");
+    fprintf(stderr, "                 Count and time each opcode, printing a "
+        "table to stderr\n");
+    fprintf(stderr, "                 or writing JSON to file\n");
+#endif
+#ifdef CLOX_EXECUTION_TRACE
+    fprintf(stderr, "  --trace[=N]    Keep the last N instructions run "
+        "(default %d) and\n", TRACE_DEFAULT_LENGTH);
+    fprintf(stderr, "                 print them on a runtime error\n");
+#endif
+    fprintf(stderr, "  --count        Report the instructions run and bytes "
+        "of bytecode\n");
+    fprintf(stderr, "                 compiled\n");
+    fprintf(stderr, "  --mem-stats    Report memory allocated by category, "
+        "with peaks\n");
+    fprintf(stderr, "  --heap-limit=N[k|m|g]\n");
+    fprintf(stderr, "                 Fail with a runtime error instead of "
+        "allocating more\n");
+    fprintf(stderr, "                 than N bytes for the script\n");
+    fprintf(stderr, "  --instruction-limit=N\n");
+    fprintf(stderr, "                 Fail with a runtime error once loops "
+        "have run N bytes\n");
+    fprintf(stderr, "                 of bytecode, counted as each loop "
+        "jumps back\n");
+#ifdef CLOX_LIVE_STATS
+    fprintf(stderr, "  --stats-signal[=file]\n");
+    fprintf(stderr, "                 Write a line of key=value stats to "
+        "stderr or file on\n");
+    fprintf(stderr, "                 each SIGUSR1\n");
+#endif
+#ifdef CLOX_TABLE_STATS
+    fprintf(stderr, "  --table-stats  Report lookups, probe lengths and "
+        "resizes per table\n");
+#endif
+#ifdef CLOX_PERF_COUNTERS
+    fprintf(stderr, "  --perf-counters\n");
+    fprintf(stderr, "                 Report hardware counters for compiling "
+        "and running\n");
+#endif
+#ifdef CLOX_SAMPLING_PROFILER
+    fprintf(stderr, "  --profile[=file]\n");
+    fprintf(stderr, "                 Sample the line being run, printing a "
+        "report to stderr\n");
+    fprintf(stderr, "                 or writing collapsed stacks to file\n");
+    fprintf(stderr, "  --profile-rate=N\n");
+    fprintf(stderr, "                 Take N samples per second of CPU time "
+        "(default %d)\n", SAMPLER_DEFAULT_RATE);
+#endif
+    exit(64);
+}
+
+// Applies a single option to the VM
+// Returns false if the option is not recognized
+static bool parseOption(const char* option) {
+    if (strcmp(option, "--batch") == 0) {
+        batch = true;
+        return true;
+    }
+#ifdef CLOX_PARALLEL_JOBS
+    if (strncmp(option, "--jobs=", 7) == 0) {
+        char* end;
+        unsigned long count = strtoul(option + 7, &end, 10);
+        if (*end != '\0' || count == 0 || count > 1024) {
+            return false;
+        }
+        jobCount = (int)count;
+        batch = true;
+        return true;
+    }
+#endif
+#ifdef CLOX_SERVE
+    if (strncmp(option, "--serve=", 8) == 0 && option[8] != '\0') {
+        servePath = option + 8;
+        return true;
+    }
+#endif
+#ifdef CLOX_SNAPSHOT
+    if (strncmp(option, "--snapshot=", 11) == 0 && option[11] != '\0') {
+        snapshotPath = option + 11;
+        mainVMOption = option;
+        return true;
+    }
+    if (strncmp(option, "--save-snapshot=", 16) == 0 && option[16] != '\0') {
+        saveSnapshotPath = option + 16;
+        mainVMOption = option;
+        return true;
+    }
+#endif
+    if (strncmp(option, "--flush=", 8) == 0) {
+        if (strcmp(option + 8, "line") == 0) {
+            vm.flush = FLUSH_LINE;
+        }
+        else if (strcmp(option + 8, "size") == 0) {
+            vm.flush = FLUSH_SIZE;
+        }
+        else if (strcmp(option + 8, "exit") == 0) {
+            vm.flush = FLUSH_EXIT;
+        }
+        else {
+            return false;
+        }
+        flushChosen = true;
+        mainVMOption = option;
+        return true;
+    }
+    if (strcmp(option, "--incremental") == 0) {
+        vm.incremental = true;
+        return true;
+    }
+#ifdef CLOX_PIPELINED_SCANNER
+    if (strcmp(option, "--pipeline") == 0) {
+        vm.pipelineThreshold = 0;
+        return true;
+    }
+    if (strcmp(option, "--no-pipeline") == 0) {
+        vm.pipelineThreshold = SIZE_MAX;
+        return true;
+    }
+#endif
+#ifdef CLOX_PROFILE_OPS
+    if (strncmp(option, "--profile-ops", 13) == 0 &&
+            (option[13] == '\0' || option[13] == '=')) {
+        initOpProfile(&opProfile);
+        vm.opProfile = &opProfile;
+        mainVMOption = option;
+        opProfilePath = option[13] == '=' ? option + 14 : NULL;
+        return true;
+    }
+#endif
+    if (strcmp(option, "--count") == 0) {
+        counts = true;
+        vm.countInstructions = true;
+        return true;
+    }
+    if (strcmp(option, "--mem-stats") == 0) {
+        memStats = true;
+        mainVMOption = option;
+        return true;
+    }
+    if (strncmp(option, "--heap-limit=", 13) == 0) {
+        // strtoull would also take a sign, wrapping a negative limit around
+        if (!isdigit((unsigned char)option[13])) {
+            return false;
+        }
+        char* end;
+        unsigned long long limit = strtoull(option + 13, &end, 10);
+        int shift = 0;
+        switch (*end) {
+            case 'k': case 'K': shift = 10; end++; break;
+            case 'm': case 'M': shift = 20; end++; break;
+            case 'g': case 'G': shift = 30; end++; break;
+        }
+        if (*end != '\0' || end == option + 13 || limit == 0 ||
+                limit > (SIZE_MAX >> shift)) {
+            return false;
+        }
+        vm.heap.limit = (size_t)(limit << shift);
+        return true;
+    }
+    if (strncmp(option, "--instruction-limit=", 20) == 0) {
+        // Like --heap-limit=, a sign must not reach strtoull
+        if (!isdigit((unsigned char)option[20])) {
+            return false;
+        }
+        char* end;
+        unsigned long long limit = strtoull(option + 20, &end, 10);
+        if (*end != '\0' || limit == 0) {
+            return false;
+        }
+        vm.instructionLimit = (uint64_t)limit;
+        return true;
+    }
+#ifdef CLOX_LIVE_STATS
+    if (strncmp(option, "--stats-signal", 14) == 0 &&
+            (option[14] == '\0' || option[14] == '=')) {
+        const char* statsPath = option[14] == '=' ? option + 15 : NULL;
+        mainVMOption = option;
+        if (!startLiveStats(&vm, statsPath)) {
+            fprintf(stderr, "Could not write stats to \"%s\".\n",
+                statsPath == NULL ? "stderr" : statsPath);
+            exit(74);
+        }
+        return true;
+    }
+#endif
+#ifdef CLOX_TABLE_STATS
+    if (strcmp(option, "--table-stats") == 0) {
+        enableTableStats(&vm);
+        mainVMOption = option;
+        return true;
+    }
+#endif
+#ifdef CLOX_PERF_COUNTERS
+    if (strcmp(option, "--perf-counters") == 0) {
+        countersWanted = true;
+        mainVMOption = option;
+        return true;
+    }
+#endif
+#ifdef CLOX_EXECUTION_TRACE
+    if (strncmp(option, "--trace", 7) == 0 &&
+            (option[7] == '\0' || option[7] == '=')) {
+        unsigned long length = TRACE_DEFAULT_LENGTH;
+        if (option[7] == '=') {
+            char* end;
+            length = strtoul(option + 8, &end, 10);
+            if (*end != '\0' || length == 0 || length > 1048576) {
+                return false;
+            }
+        }
+        mainVMOption = option;
+        if (!enableTrace(&vm, (size_t)length)) {
+            fprintf(stderr, "Not enough memory to trace %lu instructions.\n",
+                length);
+            exit(74);
+        }
+        return true;
+    }
+#endif
+#ifdef CLOX_SAMPLING_PROFILER
+    if (strncmp(option, "--profile", 9) == 0 &&
+            (option[9] == '\0' || option[9] == '=')) {
+        sampling = true;
+        mainVMOption = option;
+        samplerPath = option[9] == '=' ? option + 10 : NULL;
+        return true;
+    }
+    if (strncmp(option, "--profile-rate=", 15) == 0) {
+        char* end;
+        unsigned long rate = strtoul(option + 15, &end, 10);
+        if (*end != '\0' || rate == 0 || rate > 1000000) {
+            return false;
+        }
+        samplerRate = (unsigned)rate;
+        return true;
+    }
+#endif
+    return false;
+}
+
 int main(int argc, const char* argv[]) {
     initVM(&vm);
 
-    if (argc == 1) {
-        repl();
+    const char* path = NULL;
+    int paths = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--", 2) == 0) {
+            if (!parseOption(argv[i])) {
+                usage();
+            }
+        }
+        else {
+            path = path == NULL ? argv[i] : path;
+            paths++;
+        }
     }
-    else if (argc == 2) {
-        runFile(argv[1]);
+    if (paths > 1 && !batch) {
+        usage();
     }
-    else {
-        fprintf(stderr, "Usage: clox [path]\n");
+    if (jobCount > 0 && mainVMOption != NULL) {
+        fprintf(stderr, "%s cannot be used with --jobs.\n", mainVMOption);
         exit(64);
     }
-    
+#ifdef CLOX_SERVE
+    if (servePath != NULL) {
+        if (paths > 0) {
+            usage();
+        }
+        if (mainVMOption != NULL) {
+            fprintf(stderr, "%s cannot be used with --serve.\n",
+                mainVMOption);
+            exit(64);
+        }
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        int workers = jobCount > 0 ? jobCount : cpus > 0 ? (int)cpus : 1;
+        int status = serve(servePath, workers, &vm);
+        freeVM(&vm);
+        return status;
+    }
+#endif
+
+#ifdef PLATFORM_UNIX
+    if (!flushChosen && isatty(fileno(stdout))) {
+        // Each line shows up as it is printed, as stdio would have it
+        vm.flush = FLUSH_LINE;
+    }
+#endif
+
+#ifdef CLOX_SNAPSHOT
+    if (snapshotPath != NULL || saveSnapshotPath != NULL) {
+        // Each script of a batch starts from an empty VM
+        if (batch) {
+            fprintf(stderr, "Snapshots cannot be used with --batch.\n");
+            exit(64);
+        }
+        if (snapshotPath != NULL && !loadSnapshot(&vm, snapshotPath)) {
+            exit(74);
+        }
+    }
+#endif
+
+#ifdef CLOX_PERF_COUNTERS
+    if (countersWanted) {
+        if (openPerfCounters(&perfCounters)) {
+            vm.perf = &perfCounters;
+            vm.countInstructions = true;
+        }
+        else {
+            fprintf(stderr, "Hardware counters are unavailable: %s\n",
+                strerror(perfCounters.error));
+        }
+    }
+#endif
+#ifdef CLOX_SAMPLING_PROFILER
+    if (sampling) {
+        if (startSampler(&sampler, &vm.ip, samplerRate)) {
+            vm.sampler = &sampler;
+        }
+        else {
+            fprintf(stderr, "Could not start the sampling profiler.\n");
+        }
+    }
+#endif
+
+    int status = 0;
+    if (batch) {
+        PathQueue queue;
+        queue.argc = argc;
+        queue.argv = argv;
+        queue.next = 1;
+        queue.fromStdin = path == NULL;
+#ifdef CLOX_PARALLEL_JOBS
+        if (jobCount > 0) {
+            status = runParallelBatch(&queue, jobCount);
+        }
+        else {
+            status = runBatch(&queue);
+        }
+#else
+        status = runBatch(&queue);
+#endif
+        report();
+    }
+    else if (path == NULL) {
+        repl();
+        report();
+    }
+    else {
+        runFile(path);
+    }
+#ifdef CLOX_SNAPSHOT
+    if (saveSnapshotPath != NULL && !saveSnapshot(&vm, saveSnapshotPath)) {
+        status = 74;
+    }
+#endif
+
+#ifdef CLOX_LIVE_STATS
+    stopLiveStats();
+#endif
     freeVM(&vm);
-    return 0;
+    return status;
 }
\ No newline at end of file
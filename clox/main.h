@@ -1,7 +1,10 @@
 #ifndef clox_main_h
 #define clox_main_h
 
+#include "vm.h"
+
 void repl();
 void runFile(const char* path);
+int exitCode(InterpretResult result);
 
 #endif
\ No newline at end of file
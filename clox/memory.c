@@ -3,9 +3,105 @@
 
 #include "memory.h"
 
-void* reallocate(void* previous, size_t oldSize, size_t newSize, bool zero) {
+#define ADD_RELAXED(field, value) \
+    __atomic_add_fetch(&(field), (value), __ATOMIC_RELAXED)
+#define LOAD_RELAXED(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+// Heap that allocations on this thread are counted in, NULL for none
+static __thread Heap* current = NULL;
+
+static const char* categoryNames[MEM_CATEGORY_COUNT] = {
+    [MEM_CODE] = "code",
+    [MEM_CONSTANTS] = "constants",
+    [MEM_TABLES] = "tables",
+    [MEM_STRING_OBJECTS] = "string objects",
+    [MEM_STRING_CHARS] = "string chars",
+    [MEM_BIG_INTEGERS] = "big integers",
+    [MEM_STACK] = "stack",
+    [MEM_OUTPUT] = "output",
+    [MEM_COMPILER] = "compiler",
+    [MEM_SCANNER] = "scanner",
+    [MEM_TOOLS] = "tools",
+};
+
+void initHeap(Heap* heap) {
+    memset(heap, 0, sizeof(Heap));
+}
+
+// Makes heap the one that allocations on the calling thread are counted in
+// Returns the heap that was current before
+Heap* useHeap(Heap* heap) {
+    Heap* previous = current;
+    current = heap;
+    return previous;
+}
+
+Heap* currentHeap(void) {
+    return current;
+}
+
+static void raisePeak(size_t* peak, size_t bytes) {
+    size_t seen = LOAD_RELAXED(*peak);
+    while (bytes > seen && !__atomic_compare_exchange_n(peak, &seen, bytes,
+            true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        // seen has been refreshed, try again
+    }
+}
+
+// Records a block going from oldSize to newSize bytes
+// Shrinking relies on the subtraction wrapping around
+static void account(Heap* heap, MemoryCategory category,
+        size_t oldSize, size_t newSize) {
+    MemoryUsage* usage = &heap->categories[category];
+    size_t blocks = oldSize == 0 ? 1 : newSize == 0 ? (size_t)-1 : 0;
+    uint64_t allocations = newSize != 0;
+    if (heap->shared) {
+        size_t bytes = ADD_RELAXED(usage->bytes, newSize - oldSize);
+        size_t total = ADD_RELAXED(heap->bytes, newSize - oldSize);
+        if (category <= MEM_LAST_LIMITED) {
+            ADD_RELAXED(heap->limitedBytes, newSize - oldSize);
+        }
+        ADD_RELAXED(usage->blocks, blocks);
+        ADD_RELAXED(usage->allocations, allocations);
+        if (newSize > oldSize) {
+            raisePeak(&usage->peakBytes, bytes);
+            raisePeak(&heap->peakBytes, total);
+        }
+        return;
+    }
+    usage->bytes += newSize - oldSize;
+    heap->bytes += newSize - oldSize;
+    if (category <= MEM_LAST_LIMITED) {
+        heap->limitedBytes += newSize - oldSize;
+    }
+    usage->blocks += blocks;
+    usage->allocations += allocations;
+    if (usage->bytes > usage->peakBytes) {
+        usage->peakBytes = usage->bytes;
+    }
+    if (heap->bytes > heap->peakBytes) {
+        heap->peakBytes = heap->bytes;
+    }
+}
+
+void* reallocate(void* previous, size_t oldSize, size_t newSize, bool zero,
+        MemoryCategory category) {
+    if (previous == NULL) {
+        oldSize = 0;
+    }
+    Heap* heap = current;
+    if (heap != NULL && heap->limit != 0 && newSize > oldSize &&
+            category <= MEM_LAST_LIMITED &&
+            LOAD_RELAXED(heap->limitedBytes) + (newSize - oldSize) >
+                heap->limit) {
+        // Over the limit
+        return NULL;
+    }
     if (newSize == 0) {
         free(previous);
+        if (heap != NULL && previous != NULL) {
+            account(heap, category, oldSize, 0);
+        }
         return NULL;
     }
     void* alloc = realloc(previous, newSize);
@@ -13,6 +109,9 @@ void* reallocate(void* previous, size_t oldSize, size_t newSize, bool zero) {
         // Out of memory
         return NULL;
     }
+    if (heap != NULL) {
+        account(heap, category, oldSize, newSize);
+    }
     if (newSize > oldSize && zero) {
         memset((void *)((size_t)alloc + oldSize), 0, newSize - oldSize);
     }
@@ -23,10 +122,19 @@ static void freeObject(Obj* object) {
     switch (object->type) {
         case OBJ_STRING: {
             ObjString* string = (ObjString*)object;
-            FREE_ARRAY(char, string->chars, string->length + 1);
-            FREE(ObjString, object);
+            FREE_ARRAY(char, string->chars, string->length + 1,
+                MEM_STRING_CHARS);
+            FREE(ObjString, object, MEM_STRING_OBJECTS);
+            break;
+        }
+#ifdef CLOX_BIG_INTEGERS
+        case OBJ_BIGINT: {
+            ObjBigInt* big = (ObjBigInt*)object;
+            reallocate(object, BIGINT_SIZE(big->capacity), 0, false,
+                MEM_BIG_INTEGERS);
             break;
         }
+#endif
     }
 }
 
@@ -38,4 +146,23 @@ void freeObjects(FreeList* freeList) {
         object = next;
     }
     freeList->head = NULL;
+}
+
+// Prints what is allocated in each category now, and the most there has
+// been at once
+void printHeapStats(Heap* heap, FILE* file) {
+    fprintf(file, "%-16s %14s %14s %10s %12s\n",
+        "category", "bytes", "peak bytes", "blocks", "allocations");
+    for (int i = 0; i < MEM_CATEGORY_COUNT; i++) {
+        MemoryUsage* usage = &heap->categories[i];
+        fprintf(file, "%-16s %14" FORMAT_SIZE_T " %14" FORMAT_SIZE_T
+            " %10" FORMAT_SIZE_T " %12llu\n", categoryNames[i],
+            usage->bytes, usage->peakBytes, usage->blocks,
+            (unsigned long long)usage->allocations);
+    }
+    fprintf(file, "%-16s %14" FORMAT_SIZE_T " %14" FORMAT_SIZE_T "\n",
+        "total", heap->bytes, heap->peakBytes);
+    if (heap->limit != 0) {
+        fprintf(file, "%-16s %14" FORMAT_SIZE_T "\n", "limit", heap->limit);
+    }
 }
\ No newline at end of file
@@ -2,32 +2,86 @@
 #define clox_memory_h
 
 #include <stdbool.h>
+#include <stdio.h>
 
 #include "object.h"
 
-#define ALLOCATE(type, count, zero) \
-    (type*)reallocate(NULL, 0, sizeof(type) * (size_t)(count), (zero))
+// What an allocation is for, so that a heap can say where its bytes went
+// Every block must be freed under the category it was allocated under
+typedef enum {
+    MEM_CODE,           // Bytecode and line tables of chunks
+    MEM_CONSTANTS,      // Constant arrays of chunks
+    MEM_TABLES,         // Hash table entries
+    MEM_STRING_OBJECTS, // ObjString headers
+    MEM_STRING_CHARS,   // Characters of strings
+    MEM_BIG_INTEGERS,   // Big integers and the scratch space of their math
+    MEM_STACK,          // The VM's value stack
+    MEM_OUTPUT,         // Output of print statements not yet written
+    // The categories below are counted but never held to the heap limit,
+    // since nothing checks them for failed allocation
+    MEM_COMPILER,       // Locals, marks and jumps being widened
+    MEM_SCANNER,        // Source window and saved lexemes
+    MEM_TOOLS,          // Traces and profiles
+    MEM_CATEGORY_COUNT
+} MemoryCategory;
 
-#define FREE(type, pointer) \
-    reallocate(pointer, sizeof(type), 0, false)
+#define MEM_LAST_LIMITED MEM_OUTPUT
+
+typedef struct {
+    size_t bytes;
+    size_t peakBytes;
+    // Blocks currently allocated
+    size_t blocks;
+    // Times a block was allocated or resized
+    uint64_t allocations;
+} MemoryUsage;
+
+// Accounts for everything allocated while it is the current heap
+typedef struct {
+    MemoryUsage categories[MEM_CATEGORY_COUNT];
+    size_t bytes;
+    size_t peakBytes;
+    // Bytes in the limited categories, which are what the limit applies to
+    size_t limitedBytes;
+    // Set while another thread also allocates in the heap, such as the
+    // scanner thread, so that the counters have to be updated atomically
+    bool shared;
+    // Growing a limited category past this many bytes in total fails as if
+    // out of memory, 0 for no limit
+    size_t limit;
+} Heap;
+
+#define ALLOCATE(type, count, zero, category) \
+    (type*)reallocate(NULL, 0, sizeof(type) * (size_t)(count), (zero), \
+        (category))
+
+#define FREE(type, pointer, category) \
+    reallocate(pointer, sizeof(type), 0, false, (category))
 
 #define GROW_CAPACITY_RATIO 2
 
 #define GROW_CAPACITY(capacity) \
     ((capacity < 8) ? 8 : (capacity) * GROW_CAPACITY_RATIO);
 
-#define GROW_ARRAY(previous, type, oldCount, count) \
+#define GROW_ARRAY(previous, type, oldCount, count, category) \
     (type*)reallocate(previous, (size_t)(sizeof(type) * (oldCount)), \
-        sizeof(type) * (count), false);
+        sizeof(type) * (count), false, (category));
 
-#define GROW_ARRAY_ZERO(previous, type, oldCount, count) \
+#define GROW_ARRAY_ZERO(previous, type, oldCount, count, category) \
     (type*)reallocate(previous, (size_t)(sizeof(type) * (oldCount)), \
-        sizeof(type) * (count), true);
+        sizeof(type) * (count), true, (category));
 
-#define FREE_ARRAY(type, pointer, oldCount) \
-    reallocate(pointer, (size_t)(sizeof(type) * (size_t)(oldCount)), 0, false);
+#define FREE_ARRAY(type, pointer, oldCount, category) \
+    reallocate(pointer, (size_t)(sizeof(type) * (size_t)(oldCount)), 0, \
+        false, (category));
 
-void* reallocate(void* previous, size_t oldSize, size_t newSize, bool zero);
+void* reallocate(void* previous, size_t oldSize, size_t newSize, bool zero,
+    MemoryCategory category);
 void freeObjects(FreeList* freeList);
 
+void initHeap(Heap* heap);
+Heap* useHeap(Heap* heap);
+Heap* currentHeap(void);
+void printHeapStats(Heap* heap, FILE* file);
+
 #endif
\ No newline at end of file
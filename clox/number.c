@@ -0,0 +1,397 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "number.h"
+#include "powers.h"
+
+// Maximum number of significant digits that always fit in a uint64_t
+#define MAX_MANTISSA_DIGITS 19
+// Largest integer that a double can represent exactly
+#define MAX_EXACT_MANTISSA ((uint64_t)1 << 53)
+// Largest power of ten that a double can represent exactly
+#define MAX_EXACT_EXP10 22
+// Buffer size for the strtod fallback before resorting to the heap
+#define FALLBACK_BUFFER 64
+
+static const double exactPowersOfTen[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+bool parseIntegerLiteral(const char* start, int length, int64_t* value) {
+    uint64_t result = 0;
+    for (int i = 0; i < length; i++) {
+        uint64_t digit = (uint64_t)(start[i] - '0');
+        if (result > ((uint64_t)INT64_MAX - digit) / 10) {
+            return false;
+        }
+        result = result * 10 + digit;
+    }
+    *value = (int64_t)result;
+    return true;
+}
+
+static int leadingZeros(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_clzll(x);
+#else
+    int count = 0;
+    while (!(x & ((uint64_t)1 << 63))) {
+        x <<= 1;
+        count++;
+    }
+    return count;
+#endif
+}
+
+// Full 64x64 -> 128 bit multiplication
+static void multiply(uint64_t a, uint64_t b, uint64_t* low, uint64_t* high) {
+#ifdef __SIZEOF_INT128__
+    unsigned __int128 product = (unsigned __int128)a * b;
+    *low = (uint64_t)product;
+    *high = (uint64_t)(product >> 64);
+#else
+    uint64_t aLow = a & 0xFFFFFFFF;
+    uint64_t aHigh = a >> 32;
+    uint64_t bLow = b & 0xFFFFFFFF;
+    uint64_t bHigh = b >> 32;
+    uint64_t ll = aLow * bLow;
+    uint64_t lh = aLow * bHigh;
+    uint64_t hl = aHigh * bLow;
+    uint64_t hh = aHigh * bHigh;
+    uint64_t middle = (ll >> 32) + (lh & 0xFFFFFFFF) + (hl & 0xFFFFFFFF);
+    *low = (middle << 32) | (ll & 0xFFFFFFFF);
+    *high = hh + (lh >> 32) + (hl >> 32) + (middle >> 32);
+#endif
+}
+
+static double bitsToDouble(uint64_t bits) {
+    double result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+// Computes mantissa * 10**exp10 with correct rounding using the Eisel-Lemire
+// algorithm
+// Returns false if the result cannot be decided cheaply, in which case the
+// caller should fall back to a slower exact method
+// mantissa must be nonzero and exp10 must be within the range of powersOfTen
+static bool eiselLemire(uint64_t mantissa, int exp10, double* result) {
+    // Normalize the mantissa so its highest bit is set
+    int clz = leadingZeros(mantissa);
+    mantissa <<= clz;
+    // floor(log2(10) * exp10) + 64 + exponent bias
+    uint64_t exp2 = (uint64_t)(((217706 * exp10) >> 16) + 64 + 1023 - clz);
+
+    const uint64_t* power = powersOfTen[exp10 - POWERS_MIN_EXP10];
+    uint64_t low;
+    uint64_t high;
+    multiply(mantissa, power[1], &low, &high);
+
+    // The truncated power may have lost enough precision to matter, so
+    // widen the product using the lower half of the power
+    if ((high & 0x1FF) == 0x1FF && low + mantissa < mantissa) {
+        uint64_t wideLow;
+        uint64_t wideHigh;
+        multiply(mantissa, power[0], &wideLow, &wideHigh);
+        uint64_t mergedLow = low + wideHigh;
+        uint64_t mergedHigh = high;
+        if (mergedLow < low) {
+            mergedHigh++;
+        }
+        if ((mergedHigh & 0x1FF) == 0x1FF && mergedLow + 1 == 0 &&
+                wideLow + mantissa < mantissa) {
+            return false;
+        }
+        low = mergedLow;
+        high = mergedHigh;
+    }
+
+    // Shift down to 54 bits
+    uint64_t msb = high >> 63;
+    uint64_t bits = high >> (msb + 9);
+    exp2 -= 1 ^ msb;
+
+    // Exactly halfway between two doubles, cannot tell which way to round
+    if (low == 0 && (high & 0x1FF) == 0 && (bits & 3) == 1) {
+        return false;
+    }
+
+    // Round to 53 bits
+    bits += bits & 1;
+    bits >>= 1;
+    if (bits >> 53 > 0) {
+        bits >>= 1;
+        exp2++;
+    }
+
+    // Subnormal or infinite results are left to the fallback
+    if (exp2 - 1 >= 0x7FF - 1) {
+        return false;
+    }
+    *result = bitsToDouble(exp2 << 52 | (bits & 0x000FFFFFFFFFFFFF));
+    return true;
+}
+
+// Slow but exact path for literals the fast paths cannot decide
+// The literal is copied out since the source is not terminated after it
+static double fallbackParse(const char* start, int length) {
+    char buffer[FALLBACK_BUFFER];
+    char* copy = buffer;
+    if (length >= FALLBACK_BUFFER) {
+        copy = (char*)malloc((size_t)length + 1);
+        if (copy == NULL) {
+            return strtod(start, NULL);
+        }
+    }
+    memcpy(copy, start, (size_t)length);
+    copy[length] = '\0';
+    double result = strtod(copy, NULL);
+    if (copy != buffer) {
+        free(copy);
+    }
+    return result;
+}
+
+double parseFloatLiteral(const char* start, int length, int point) {
+    // Collect up to MAX_MANTISSA_DIGITS significant digits
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exp10 = 0;
+    bool truncated = false;
+    for (int i = 0; i < length; i++) {
+        if (i == point) {
+            continue;
+        }
+        uint64_t digit = (uint64_t)(start[i] - '0');
+        bool fraction = point >= 0 && i > point;
+        if (digits < MAX_MANTISSA_DIGITS) {
+            if (mantissa != 0 || digit != 0) {
+                mantissa = mantissa * 10 + digit;
+                digits++;
+            }
+            if (fraction) {
+                exp10--;
+            }
+        }
+        else {
+            if (digit != 0) {
+                truncated = true;
+            }
+            if (!fraction) {
+                exp10++;
+            }
+        }
+    }
+
+    if (mantissa == 0) {
+        return 0.0;
+    }
+    if (exp10 < POWERS_MIN_EXP10) {
+        return 0.0;
+    }
+    if (exp10 > POWERS_MAX_EXP10) {
+        return bitsToDouble(0x7FF0000000000000);
+    }
+
+    // Clinger's fast path: both operands are exact, so one rounding step
+    // gives the correctly rounded result
+    if (!truncated && mantissa <= MAX_EXACT_MANTISSA &&
+            exp10 >= -MAX_EXACT_EXP10 && exp10 <= MAX_EXACT_EXP10) {
+        if (exp10 < 0) {
+            return (double)mantissa / exactPowersOfTen[-exp10];
+        }
+        return (double)mantissa * exactPowersOfTen[exp10];
+    }
+
+    double result;
+    if (eiselLemire(mantissa, exp10, &result)) {
+        if (!truncated) {
+            return result;
+        }
+        // The true value lies between mantissa and mantissa + 1, so if both
+        // round to the same double then that is the answer
+        double upper;
+        if (eiselLemire(mantissa + 1, exp10, &upper) && upper == result) {
+            return result;
+        }
+    }
+    return fallbackParse(start, length);
+}
+
+#ifdef CLOX_FAST_NUMBER_FORMAT
+// Significant digits "%g" gives
+#define FLOAT_DIGITS 6
+// 10**FLOAT_DIGITS
+#define FLOAT_DIGITS_LIMIT 1000000.0
+// Scaling a double below FLOAT_DIGITS_LIMIT by an exact power of ten errs
+// by at most half an ulp, under 1.2e-10, so a fraction further than this
+// from one half rounds the same way as the exact decimal value would
+#define TIE_MARGIN 1e-9
+
+static const char digitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// Writes the digits of value so that they end just before end
+// Returns where they start
+static char* writeDigits(char* end, uint64_t value) {
+    while (value >= 100) {
+        const char* pair = &digitPairs[(value % 100) * 2];
+        value /= 100;
+        *--end = pair[1];
+        *--end = pair[0];
+    }
+    if (value >= 10) {
+        const char* pair = &digitPairs[value * 2];
+        *--end = pair[1];
+        *--end = pair[0];
+    }
+    else {
+        *--end = (char)('0' + value);
+    }
+    return end;
+}
+
+int formatInteger(char* buffer, int64_t value) {
+    char digits[20];
+    char* end = digits + sizeof(digits);
+    uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+    char* start = writeDigits(end, magnitude);
+    int length = 0;
+    if (value < 0) {
+        buffer[length++] = '-';
+    }
+    memcpy(buffer + length, start, (size_t)(end - start));
+    length += (int)(end - start);
+    buffer[length] = '\0';
+    return length;
+}
+
+// Rounds magnitude to FLOAT_DIGITS significant digits, setting exp10 to
+// the power of ten of the first
+// Returns false if that cannot be done exactly this way
+static bool roundSignificant(double magnitude, int binaryExponent,
+        uint32_t* digits, int* exp10) {
+    // floor(log10(2) * binaryExponent), which is at most one too small
+    int exponent = (binaryExponent * 78913) >> 18;
+    double scaled = FLOAT_DIGITS_LIMIT;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        int shift = FLOAT_DIGITS - 1 - exponent;
+        if (shift < -MAX_EXACT_EXP10 || shift > MAX_EXACT_EXP10) {
+            return false;
+        }
+        scaled = shift < 0 ? magnitude / exactPowersOfTen[-shift] :
+            magnitude * exactPowersOfTen[shift];
+        if (scaled < FLOAT_DIGITS_LIMIT) {
+            break;
+        }
+        exponent++;
+    }
+    if (scaled >= FLOAT_DIGITS_LIMIT) {
+        return false;
+    }
+
+    double whole = (double)(uint32_t)scaled;
+    double fraction = scaled - whole;
+    if (fraction > 0.5 - TIE_MARGIN && fraction < 0.5 + TIE_MARGIN) {
+        // Too close to a tie to know which way the exact value rounds
+        return false;
+    }
+    *digits = (uint32_t)whole + (fraction > 0.5);
+    if (*digits >= (uint32_t)FLOAT_DIGITS_LIMIT) {
+        *digits /= 10;
+        exponent++;
+    }
+    *exp10 = exponent;
+    return true;
+}
+
+int formatFloat(char* buffer, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    int biased = (int)((bits >> 52) & 0x7FF);
+    bool negative = (bits >> 63) != 0;
+    double magnitude = negative ? -value : value;
+
+    uint32_t digits;
+    int exp10;
+    if (magnitude == 0.0) {
+        digits = 0;
+        exp10 = 0;
+    }
+    else if (biased == 0 || biased == 0x7FF ||
+            !roundSignificant(magnitude, biased - 1023, &digits, &exp10)) {
+        // Subnormal, infinite, not a number or a tie
+        return snprintf(buffer, NUMBER_TEXT_SIZE, "%g", value);
+    }
+
+    char text[FLOAT_DIGITS];
+    writeDigits(text + FLOAT_DIGITS, digits);
+    int significant = FLOAT_DIGITS;
+    while (significant > 1 && text[significant - 1] == '0') {
+        significant--;
+    }
+    if (digits == 0) {
+        significant = 1;
+        text[0] = '0';
+    }
+
+    char* out = buffer;
+    if (negative) {
+        *out++ = '-';
+    }
+    if (exp10 < -4 || exp10 >= FLOAT_DIGITS) {
+        // d.ddddde+XX
+        *out++ = text[0];
+        if (significant > 1) {
+            *out++ = '.';
+            memcpy(out, text + 1, (size_t)(significant - 1));
+            out += significant - 1;
+        }
+        *out++ = 'e';
+        *out++ = exp10 < 0 ? '-' : '+';
+        int power = exp10 < 0 ? -exp10 : exp10;
+        if (power < 10) {
+            *out++ = '0';
+        }
+        char exponent[4];
+        char* start = writeDigits(exponent + sizeof(exponent),
+            (uint64_t)power);
+        memcpy(out, start, (size_t)(exponent + sizeof(exponent) - start));
+        out += exponent + sizeof(exponent) - start;
+    }
+    else if (exp10 < 0) {
+        // 0.000ddd
+        *out++ = '0';
+        *out++ = '.';
+        for (int i = -1; i > exp10; i--) {
+            *out++ = '0';
+        }
+        memcpy(out, text, (size_t)significant);
+        out += significant;
+    }
+    else {
+        // ddd.ddd
+        int integer = exp10 + 1;
+        memcpy(out, text, (size_t)integer);
+        out += integer;
+        if (significant > integer) {
+            *out++ = '.';
+            memcpy(out, text + integer, (size_t)(significant - integer));
+            out += significant - integer;
+        }
+    }
+    *out = '\0';
+    return (int)(out - buffer);
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,25 @@
+#ifndef clox_number_h
+#define clox_number_h
+
+#include "common.h"
+
+// Parses a decimal integer literal made up of only digits
+// Returns false if the value does not fit in an int64_t
+bool parseIntegerLiteral(const char* start, int length, int64_t* value);
+// Parses a decimal float literal made up of digits and an optional '.'
+// located at offset point from start (-1 if there is no '.')
+// The result is correctly rounded
+double parseFloatLiteral(const char* start, int length, int point);
+
+#ifdef CLOX_FAST_NUMBER_FORMAT
+// Room formatInteger and formatFloat need, with the terminator
+#define NUMBER_TEXT_SIZE 32
+
+// Each writes value terminated as printf would, returning its length
+// Integers as "%" PRId64
+int formatInteger(char* buffer, int64_t value);
+// Floats as "%g", which is six significant digits correctly rounded
+int formatFloat(char* buffer, double value);
+#endif
+
+#endif
\ No newline at end of file
@@ -1,15 +1,23 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "bigint.h"
 #include "memory.h"
 #include "object.h"
+#include "probes.h"
 #include "value.h"
 
-#define ALLOCATE_OBJ(vm, type, objectType) \
-    (type*)allocateObject(vm, sizeof(type), objectType)
+#define ALLOCATE_OBJ(vm, type, objectType, category) \
+    (type*)allocateObject(vm, sizeof(type), objectType, category)
 
-static Obj* allocateObject(FreeList* freeList, size_t size, ObjType type) {
-    Obj* object = (Obj*)reallocate(NULL, 0, size, true);
+// Returns NULL for failed allocation
+static Obj* allocateObject(FreeList* freeList, size_t size, ObjType type,
+        MemoryCategory category) {
+    Obj* object = (Obj*)reallocate(NULL, 0, size, true, category);
+    if (object == NULL) {
+        return NULL;
+    }
     object->type = type;
 
     object->next = freeList->head;
@@ -18,23 +26,44 @@ static Obj* allocateObject(FreeList* freeList, size_t size, ObjType type) {
     return object;
 }
 
+// Takes ownership of chars, freeing them if the string cannot be made
+// Returns NULL for failed allocation
 static ObjString* allocateString(FreeList* freeList, Table* strings, char* chars, int length,
         uint32_t hash) {
-    ObjString* string = ALLOCATE_OBJ(freeList, ObjString, OBJ_STRING);
+    ObjString* string = ALLOCATE_OBJ(freeList, ObjString, OBJ_STRING,
+        MEM_STRING_OBJECTS);
+    if (string == NULL) {
+        FREE_ARRAY(char, chars, length + 1, MEM_STRING_CHARS);
+        return NULL;
+    }
     string->length = length;
     string->chars = chars;
     string->hash = hash;
 
-    tableSet(strings, OBJ_VAL(string), NIL_VAL);
+    if (tableSet(strings, OBJ_VAL(string), NIL_VAL) < 0) {
+        // Not interned, so it must not be used. It is freed along with the
+        // other objects.
+        return NULL;
+    }
 
+    PROBE2(string__alloc, chars, length);
     return string;
 }
 
-ObjString* takeString(FreeList* freeList, Table* strings, char* chars, int length) {
+// frozen, if not NULL, holds strings interned elsewhere that are looked up
+// first and never added to
+ObjString* takeString(FreeList* freeList, Table* strings, Table* frozen,
+        char* chars, int length) {
     uint32_t hash = hashString(chars, length);
-    ObjString* interned = tableFindString(strings, chars, length, hash);
+    ObjString* interned = NULL;
+    if (frozen != NULL) {
+        interned = tableFindString(frozen, chars, length, hash);
+    }
+    if (interned == NULL) {
+        interned = tableFindString(strings, chars, length, hash);
+    }
     if (interned != NULL) {
-        FREE_ARRAY(char, chars, length + 1);
+        FREE_ARRAY(char, chars, length + 1, MEM_STRING_CHARS);
         return interned;
     }
 
@@ -49,9 +78,8 @@ ObjString* copyString(FreeList* freeList, Table* strings, const char* chars, int
         return interned;
     }
 
-    char* heapChars = ALLOCATE(char, length + 1, false);
+    char* heapChars = ALLOCATE(char, length + 1, false, MEM_STRING_CHARS);
     if (heapChars == NULL) {
-        // TODO out of memory
         return NULL;
     }
     memcpy(heapChars, chars, (size_t)length);
@@ -60,11 +88,43 @@ ObjString* copyString(FreeList* freeList, Table* strings, const char* chars, int
     return allocateString(freeList, strings, heapChars, length, hash);
 }
 
+#ifdef CLOX_BIG_INTEGERS
+ObjBigInt* allocateBigInt(FreeList* freeList, int capacity) {
+    if (capacity < 0 || capacity > BIGINT_MAX_LIMBS) {
+        return NULL;
+    }
+    ObjBigInt* big = (ObjBigInt*)allocateObject(freeList,
+        BIGINT_SIZE(capacity), OBJ_BIGINT, MEM_BIG_INTEGERS);
+    if (big != NULL) {
+        big->capacity = capacity;
+    }
+    return big;
+}
+#endif
+
 void printObject(Value value) {
+    fprintObject(stdout, value);
+}
+
+void fprintObject(FILE* file, Value value) {
     switch (OBJ_TYPE(value)) {
         case OBJ_STRING:
-            printf("%s", AS_CSTRING(value));
+            fprintf(file, "%s", AS_CSTRING(value));
             break;
+#ifdef CLOX_BIG_INTEGERS
+        case OBJ_BIGINT: {
+            ObjBigInt* big = AS_BIGINT(value);
+            char* text = (char*)malloc(bigIntTextSize(big));
+            if (text != NULL && formatBigInt(text, big) >= 0) {
+                fputs(text, file);
+            }
+            else {
+                fprintf(file, "<big integer>");
+            }
+            free(text);
+            break;
+        }
+#endif
     }
 }
 
@@ -73,5 +133,10 @@ void printObjectType(Value value) {
         case OBJ_STRING:
             printf("%-4s", "STR");
             break;
+#ifdef CLOX_BIG_INTEGERS
+        case OBJ_BIGINT:
+            printf("%-4s", "BIG");
+            break;
+#endif
     }
 }
\ No newline at end of file
@@ -12,12 +12,20 @@
 #define AS_STRING(value) ((ObjString*)AS_OBJ(value))
 #define AS_CSTRING(value) (((ObjString*)AS_OBJ(value))->chars)
 
+#ifdef CLOX_BIG_INTEGERS
+#define IS_BIGINT(value) isObjType(value, OBJ_BIGINT)
+#define AS_BIGINT(value) ((ObjBigInt*)AS_OBJ(value))
+#endif
+
 typedef struct {
     Obj* head;
 } FreeList;
 
 typedef enum {
     OBJ_STRING,
+#ifdef CLOX_BIG_INTEGERS
+    OBJ_BIGINT,
+#endif
 } ObjType;
 
 struct sObj {
@@ -32,9 +40,35 @@ struct sObjString {
     uint32_t hash;
 };
 
-ObjString* takeString(FreeList* freeList,Table* strings, char* chars, int length);
+#ifdef CLOX_BIG_INTEGERS
+// An integer outside the range of int64_t, which is never used for one
+// inside it. Like strings, big integers never change once made.
+typedef struct {
+    Obj obj;
+    bool negative;
+    // Limbs in use, the most significant of which is not zero
+    int count;
+    int capacity;
+    uint32_t hash;
+    // Magnitude in base 2^32, least significant limb first
+    uint32_t limbs[];
+} ObjBigInt;
+
+// Keeps the length of their decimal text within an int
+#define BIGINT_MAX_LIMBS (1 << 24)
+#define BIGINT_SIZE(capacity) \
+    (sizeof(ObjBigInt) + sizeof(uint32_t) * (size_t)(capacity))
+#endif
+
+ObjString* takeString(FreeList* freeList,Table* strings, Table* frozen, char* chars, int length);
 ObjString* copyString(FreeList* freeList,Table* strings, const char* chars, int length);
+#ifdef CLOX_BIG_INTEGERS
+// Makes a big integer with room for capacity limbs, for the caller to fill
+// Returns NULL for failed allocation
+ObjBigInt* allocateBigInt(FreeList* freeList, int capacity);
+#endif
 void printObject(Value value);
+void fprintObject(FILE* file, Value value);
 void printObjectType(Value value);
 
 static inline bool isObjType(Value value, ObjType type) {
@@ -0,0 +1,182 @@
+// syscall
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <string.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "perf.h"
+
+#ifdef CLOX_PERF_COUNTERS
+
+static const struct {
+    const char* name;
+    uint32_t type;
+    uint64_t config;
+} events[PERF_EVENT_COUNT] = {
+    [PERF_CYCLES] = { "cycles",
+        PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    [PERF_INSTRUCTIONS] = { "instructions",
+        PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    [PERF_BRANCH_MISSES] = { "branch-misses",
+        PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    [PERF_L1D_MISSES] = { "L1d-misses",
+        PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+            (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    [PERF_LLC_MISSES] = { "LLC-misses",
+        PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+};
+
+static const char* phaseNames[PERF_PHASE_COUNT] = { "compile", "run" };
+
+static int openEvent(PerfEvent event, int group) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[event].type;
+    attr.config = events[event].config;
+    attr.disabled = group == -1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+        PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+// Opens a counter group for each phase, leaving them all stopped
+// Events the machine or its permissions do not allow are left out
+// Returns false if no event at all could be opened
+bool openPerfCounters(PerfCounters* counters) {
+    bool any = false;
+    counters->phase = PERF_PHASE_NONE;
+    counters->error = 0;
+    for (int phase = 0; phase < PERF_PHASE_COUNT; phase++) {
+        counters->leaders[phase] = -1;
+        for (int event = 0; event < PERF_EVENT_COUNT; event++) {
+            int fd = openEvent((PerfEvent)event, counters->leaders[phase]);
+            if (fd < 0 && counters->error == 0) {
+                counters->error = errno;
+            }
+            counters->fds[phase][event] = fd;
+            if (fd >= 0 && counters->leaders[phase] == -1) {
+                counters->leaders[phase] = fd;
+            }
+            any = any || fd >= 0;
+        }
+    }
+    return any;
+}
+
+void closePerfCounters(PerfCounters* counters) {
+    for (int phase = 0; phase < PERF_PHASE_COUNT; phase++) {
+        for (int event = 0; event < PERF_EVENT_COUNT; event++) {
+            if (counters->fds[phase][event] >= 0) {
+                close(counters->fds[phase][event]);
+                counters->fds[phase][event] = -1;
+            }
+        }
+        counters->leaders[phase] = -1;
+    }
+}
+
+static void setGroup(PerfCounters* counters, PerfPhase phase, bool enable) {
+    if (phase == PERF_PHASE_NONE || counters->leaders[phase] == -1) {
+        return;
+    }
+    ioctl(counters->leaders[phase],
+        enable ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE,
+        PERF_IOC_FLAG_GROUP);
+}
+
+// Stops counting for the current phase and starts counting for phase
+// Returns the phase that was being counted, to pass back in when done
+PerfPhase enterPerfPhase(PerfCounters* counters, PerfPhase phase) {
+    PerfPhase previous = counters->phase;
+    if (phase != previous) {
+        setGroup(counters, previous, false);
+        setGroup(counters, phase, true);
+        counters->phase = phase;
+    }
+    return previous;
+}
+
+// Reads a counter, scaled up if the kernel had to multiplex it
+// Returns false if the event is not available or never got to run
+static bool readEvent(int fd, double* value) {
+    uint64_t data[3];
+    if (fd < 0 || read(fd, data, sizeof(data)) != (ssize_t)sizeof(data) ||
+            data[2] == 0) {
+        return false;
+    }
+    *value = (double)data[0] * ((double)data[1] / (double)data[2]);
+    return true;
+}
+
+// Prints each counter per phase, followed by IPC and, if executed is not
+// zero, the run counters per bytecode instruction executed
+void printPerfCounters(PerfCounters* counters, uint64_t executed,
+        FILE* file) {
+    if (counters->error != 0) {
+        fprintf(file, "Some counters are unavailable: %s\n",
+            strerror(counters->error));
+    }
+
+    double values[PERF_PHASE_COUNT][PERF_EVENT_COUNT];
+    bool valid[PERF_PHASE_COUNT][PERF_EVENT_COUNT];
+    for (int phase = 0; phase < PERF_PHASE_COUNT; phase++) {
+        for (int event = 0; event < PERF_EVENT_COUNT; event++) {
+            valid[phase][event] = readEvent(
+                counters->fds[phase][event], &values[phase][event]);
+        }
+    }
+
+    fprintf(file, "%-16s %16s %16s", "counter", phaseNames[0], phaseNames[1]);
+    if (executed > 0) {
+        fprintf(file, " %14s", "per bytecode");
+    }
+    fprintf(file, "\n");
+    for (int event = 0; event < PERF_EVENT_COUNT; event++) {
+        fprintf(file, "%-16s", events[event].name);
+        for (int phase = 0; phase < PERF_PHASE_COUNT; phase++) {
+            if (valid[phase][event]) {
+                fprintf(file, " %16.0f", values[phase][event]);
+            }
+            else {
+                fprintf(file, " %16s", "n/a");
+            }
+        }
+        if (executed > 0) {
+            if (valid[PERF_PHASE_RUN][event]) {
+                fprintf(file, " %14.3f",
+                    values[PERF_PHASE_RUN][event] / (double)executed);
+            }
+            else {
+                fprintf(file, " %14s", "n/a");
+            }
+        }
+        fprintf(file, "\n");
+    }
+
+    fprintf(file, "%-16s", "IPC");
+    for (int phase = 0; phase < PERF_PHASE_COUNT; phase++) {
+        if (valid[phase][PERF_CYCLES] && valid[phase][PERF_INSTRUCTIONS] &&
+                values[phase][PERF_CYCLES] > 0) {
+            fprintf(file, " %16.2f", values[phase][PERF_INSTRUCTIONS] /
+                values[phase][PERF_CYCLES]);
+        }
+        else {
+            fprintf(file, " %16s", "n/a");
+        }
+    }
+    fprintf(file, "\n");
+    if (executed > 0) {
+        fprintf(file, "%-16s %16s %16llu\n", "bytecode run", "",
+            (unsigned long long)executed);
+    }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,47 @@
+#ifndef clox_perf_h
+#define clox_perf_h
+
+#include <stdio.h>
+
+#include "common.h"
+
+#ifdef CLOX_PERF_COUNTERS
+
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_EVENT_COUNT
+} PerfEvent;
+
+// What the interpreter is doing, each measured by its own counter group
+typedef enum {
+    PERF_PHASE_NONE = -1,
+    PERF_PHASE_COMPILE,
+    PERF_PHASE_RUN,
+    PERF_PHASE_COUNT
+} PerfPhase;
+
+// Hardware counters for compiling and running, counting only this
+// process in user space
+typedef struct {
+    // -1 for events that could not be opened
+    int fds[PERF_PHASE_COUNT][PERF_EVENT_COUNT];
+    // First open event of each phase, which the others are grouped with
+    int leaders[PERF_PHASE_COUNT];
+    PerfPhase phase;
+    // errno of the first event that failed to open, 0 if none did
+    int error;
+} PerfCounters;
+
+bool openPerfCounters(PerfCounters* counters);
+void closePerfCounters(PerfCounters* counters);
+PerfPhase enterPerfPhase(PerfCounters* counters, PerfPhase phase);
+void printPerfCounters(PerfCounters* counters, uint64_t executed,
+    FILE* file);
+
+#endif
+
+#endif
\ No newline at end of file
@@ -0,0 +1,107 @@
+#include <sched.h>
+#include <unistd.h>
+
+#include "pipeline.h"
+
+#ifdef CLOX_PIPELINED_SCANNER
+
+// Busy-wait this many times before yielding the core
+#define PIPELINE_SPIN 64
+
+#define LOAD_ACQUIRE(field) __atomic_load_n(&(field), __ATOMIC_ACQUIRE)
+#define LOAD_RELAXED(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+#define STORE_RELEASE(field, value) \
+    __atomic_store_n(&(field), (value), __ATOMIC_RELEASE)
+
+#define RING_INDEX(position) ((position) & (PIPELINE_CAPACITY - 1))
+
+static void backOff(size_t* spins) {
+    if (++*spins >= PIPELINE_SPIN) {
+        *spins = 0;
+        sched_yield();
+    }
+}
+
+static void* scanAhead(void* arg) {
+    Pipeline* pipeline = (Pipeline*)arg;
+    useHeap(pipeline->heap);
+    size_t head = pipeline->head;
+    // Cached copy of the consumer's position, only refreshed when the ring
+    // looks full
+    size_t tail = LOAD_ACQUIRE(pipeline->tail);
+    size_t spins = 0;
+
+    while (true) {
+        while (head - tail == PIPELINE_CAPACITY) {
+            if (LOAD_RELAXED(pipeline->cancelled)) {
+                return NULL;
+            }
+            backOff(&spins);
+            tail = LOAD_ACQUIRE(pipeline->tail);
+        }
+
+        Token* token = &pipeline->tokens[RING_INDEX(head)];
+        scanToken(pipeline->scanner, token);
+        STORE_RELEASE(pipeline->head, ++head);
+
+        if (token->type == TOKEN_EOF) {
+            return NULL;
+        }
+    }
+}
+
+// Starts scanning on a new thread
+// Returns false if the thread could not be started or there is only one
+// core, in which case the scanner should be used directly
+bool startPipeline(Pipeline* pipeline, Scanner* scanner) {
+    // Both threads spin while waiting on each other, which only pays off
+    // when they can run at the same time
+    if (sysconf(_SC_NPROCESSORS_ONLN) < 2) {
+        return false;
+    }
+    pipeline->scanner = scanner;
+    pipeline->head = 0;
+    pipeline->tail = 0;
+    pipeline->cancelled = false;
+    pipeline->heap = currentHeap();
+#ifdef CLOX_STREAMING_SOURCE
+    // Every token in the ring, plus the parser's current and previous
+    // tokens, must keep its text while the scanner keeps going
+    reserveLexemes(scanner, PIPELINE_CAPACITY + SCANNER_LEXEMES);
+#endif
+    if (pipeline->heap != NULL) {
+        pipeline->heap->shared = true;
+    }
+    if (pthread_create(&pipeline->thread, NULL, scanAhead, pipeline) != 0) {
+        if (pipeline->heap != NULL) {
+            pipeline->heap->shared = false;
+        }
+        return false;
+    }
+    return true;
+}
+
+// Takes the next token from the ring, waiting for the scanner if needed
+void nextToken(Pipeline* pipeline, Token* token) {
+    size_t tail = pipeline->tail;
+    size_t spins = 0;
+    while (LOAD_ACQUIRE(pipeline->head) == tail) {
+        backOff(&spins);
+    }
+    *token = pipeline->tokens[RING_INDEX(tail)];
+    // Leave the end of file in the ring so it keeps being returned, like
+    // scanToken does
+    if (token->type != TOKEN_EOF) {
+        STORE_RELEASE(pipeline->tail, tail + 1);
+    }
+}
+
+void stopPipeline(Pipeline* pipeline) {
+    STORE_RELEASE(pipeline->cancelled, true);
+    pthread_join(pipeline->thread, NULL);
+    if (pipeline->heap != NULL) {
+        pipeline->heap->shared = false;
+    }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,37 @@
+#ifndef clox_pipeline_h
+#define clox_pipeline_h
+
+#include "common.h"
+#include "scanner.h"
+#include "memory.h"
+
+#ifdef CLOX_PIPELINED_SCANNER
+#include <pthread.h>
+
+// Number of tokens the scanner thread may run ahead, must be a power of 2
+#define PIPELINE_CAPACITY 1024
+// Sources smaller than this are not worth starting a thread for
+#define PIPELINE_THRESHOLD (1024 * 1024)
+
+// Single-producer single-consumer ring of tokens, filled by a scanner
+// running on its own thread
+typedef struct {
+    Scanner* scanner;
+    Token tokens[PIPELINE_CAPACITY];
+    // Only written by the scanner thread
+    size_t head;
+    // Only written by the compiling thread
+    size_t tail;
+    // Set by the compiling thread to stop the scanner early
+    bool cancelled;
+    // Heap of the compiling thread, which the scanner thread allocates in
+    Heap* heap;
+    pthread_t thread;
+} Pipeline;
+
+bool startPipeline(Pipeline* pipeline, Scanner* scanner);
+void nextToken(Pipeline* pipeline, Token* token);
+void stopPipeline(Pipeline* pipeline);
+#endif
+
+#endif
\ No newline at end of file
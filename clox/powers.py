@@ -0,0 +1,41 @@
+# Generates powers.h, the table of 128-bit truncated powers of ten used by
+# the Eisel-Lemire fast path in number.c.
+# Usage: python powers.py > powers.h
+
+MIN_EXP10 = -342
+MAX_EXP10 = 308
+
+def truncated(exp10):
+    # Returns the top 128 bits of 10**exp10, rounded down
+    if exp10 >= 0:
+        value = 10 ** exp10
+        bits = value.bit_length()
+        if bits > 128:
+            return value >> (bits - 128)
+        return value << (128 - bits)
+    divisor = 10 ** -exp10
+    return (1 << (divisor.bit_length() + 127)) // divisor
+
+def main():
+    print("#ifndef clox_powers_h")
+    print("#define clox_powers_h")
+    print()
+    print("// Generated by powers.py, do not edit")
+    print()
+    print(f"#define POWERS_MIN_EXP10 ({MIN_EXP10})")
+    print(f"#define POWERS_MAX_EXP10 {MAX_EXP10}")
+    print()
+    print("// { low 64 bits, high 64 bits } of 10**n, for n in")
+    print("// [POWERS_MIN_EXP10, POWERS_MAX_EXP10]")
+    print("static const uint64_t powersOfTen[][2] = {")
+    for exp10 in range(MIN_EXP10, MAX_EXP10 + 1):
+        value = truncated(exp10)
+        low = value & ((1 << 64) - 1)
+        high = value >> 64
+        print(f"    {{ 0x{low:016X}u, 0x{high:016X}u }}, // 1e{exp10}")
+    print("};")
+    print()
+    print("#endif")
+
+if __name__ == "__main__":
+    main()
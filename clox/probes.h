@@ -0,0 +1,30 @@
+#ifndef clox_probes_h
+#define clox_probes_h
+
+#include "common.h"
+
+// Static tracepoints for bpftrace and other USDT tools, all under the
+// "clox" provider. Each is a single nop in the code until a tracer
+// attaches, and nothing at all without CLOX_PROBES.
+//   compile__start(source size)          compile__end(result)
+//   interpret__start()                    interpret__end(result)
+//   string__alloc(chars, length)
+//   table__resize(old capacity, new capacity, count)
+//   runtime__error(message, line)
+// Arguments are always evaluated, so they should be cheap.
+
+#ifdef CLOX_PROBES
+#include <sys/sdt.h>
+
+#define PROBE0(name) DTRACE_PROBE(clox, name)
+#define PROBE1(name, a) DTRACE_PROBE1(clox, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(clox, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(clox, name, a, b, c)
+#else
+#define PROBE0(name) ((void)0)
+#define PROBE1(name, a) ((void)0)
+#define PROBE2(name, a, b) ((void)0)
+#define PROBE3(name, a, b, c) ((void)0)
+#endif
+
+#endif
\ No newline at end of file
@@ -0,0 +1,129 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "profile.h"
+#include "debug.h"
+
+#ifdef CLOX_PROFILE_OPS
+
+#ifndef PROFILE_RDTSC
+uint64_t readClock(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+#endif
+
+void initOpProfile(OpProfile* profile) {
+    memset(profile, 0, sizeof(OpProfile));
+    profile->last = PROFILE_NONE;
+}
+
+// Called when the VM starts running instructions
+void startOpSample(OpProfile* profile) {
+    profile->last = PROFILE_NONE;
+    profile->lastTime = readCycles();
+}
+
+// Called when the VM stops, charging the instruction it stopped on
+void stopOpSample(OpProfile* profile) {
+    profile->cycles[profile->last] += readCycles() - profile->lastTime;
+    profile->last = PROFILE_NONE;
+}
+
+// Writes the name of the instruction in slot to buffer
+static const char* slotName(size_t slot, char* buffer, size_t size) {
+    const char* name = opName((uint8_t)(slot % PROFILE_WIDE));
+    if (name == NULL) {
+        name = "OP_UNKNOWN";
+    }
+    if (slot >= PROFILE_WIDE) {
+        snprintf(buffer, size, "OP_WIDE %s", name);
+    }
+    else {
+        snprintf(buffer, size, "%s", name);
+    }
+    return buffer;
+}
+
+// For compareSlots, which qsort gives no context. Per thread, so profiles
+// of VMs on different threads can be sorted at once.
+static __thread OpProfile* sortedProfile;
+
+static int compareSlots(const void* a, const void* b) {
+    uint64_t cyclesA = sortedProfile->cycles[*(const size_t*)a];
+    uint64_t cyclesB = sortedProfile->cycles[*(const size_t*)b];
+    return (cyclesA < cyclesB) - (cyclesA > cyclesB);
+}
+
+// Fills slots with the executed instructions, most expensive first
+// Returns the number of slots filled
+static size_t sortSlots(OpProfile* profile, size_t* slots, uint64_t* total) {
+    size_t count = 0;
+    *total = 0;
+    for (size_t slot = 0; slot < PROFILE_NONE; slot++) {
+        if (profile->counts[slot] > 0) {
+            slots[count++] = slot;
+            *total += profile->cycles[slot];
+        }
+    }
+    sortedProfile = profile;
+    qsort(slots, count, sizeof(size_t), compareSlots);
+    return count;
+}
+
+// Prints a table of instructions sorted by the time spent in them
+// Times include the overhead of taking the samples
+void printOpProfile(OpProfile* profile, FILE* file) {
+    size_t slots[PROFILE_NONE];
+    uint64_t total;
+    size_t count = sortSlots(profile, slots, &total);
+
+    char name[64];
+    uint64_t executed = 0;
+    fprintf(file, "%-28s %14s %16s %10s %7s\n",
+        "opcode", "count", "total " PROFILE_UNIT, "mean", "share");
+    for (size_t i = 0; i < count; i++) {
+        size_t slot = slots[i];
+        uint64_t ops = profile->counts[slot];
+        uint64_t cycles = profile->cycles[slot];
+        executed += ops;
+        fprintf(file, "%-28s %14llu %16llu %10.1f %6.2f%%\n",
+            slotName(slot, name, sizeof(name)),
+            (unsigned long long)ops, (unsigned long long)cycles,
+            (double)cycles / (double)ops,
+            total == 0 ? 0.0 : 100.0 * (double)cycles / (double)total);
+    }
+    fprintf(file, "%-28s %14llu %16llu %10.1f %6.2f%%\n", "total",
+        (unsigned long long)executed, (unsigned long long)total,
+        executed == 0 ? 0.0 : (double)total / (double)executed, 100.0);
+}
+
+// Writes the same data as printOpProfile as a JSON object
+void writeOpProfileJson(OpProfile* profile, FILE* file) {
+    size_t slots[PROFILE_NONE];
+    uint64_t total;
+    size_t count = sortSlots(profile, slots, &total);
+
+    char name[64];
+    fprintf(file, "{\n  \"unit\": \"%s\",\n  \"total\": %llu,\n  \"ops\": [",
+        PROFILE_UNIT, (unsigned long long)total);
+    for (size_t i = 0; i < count; i++) {
+        size_t slot = slots[i];
+        uint64_t ops = profile->counts[slot];
+        uint64_t cycles = profile->cycles[slot];
+        fprintf(file, "%s\n    {\"op\": \"%s\", \"count\": %llu, "
+            "\"total\": %llu, \"mean\": %.1f, \"share\": %.4f}",
+            i == 0 ? "" : ",",
+            slotName(slot, name, sizeof(name)),
+            (unsigned long long)ops, (unsigned long long)cycles,
+            (double)cycles / (double)ops,
+            total == 0 ? 0.0 : (double)cycles / (double)total);
+    }
+    fprintf(file, "\n  ]\n}\n");
+}
+
+#endif
\ No newline at end of file
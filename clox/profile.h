@@ -0,0 +1,66 @@
+#ifndef clox_profile_h
+#define clox_profile_h
+
+#include <stdio.h>
+
+#include "common.h"
+#include "chunk.h"
+
+#ifdef CLOX_PROFILE_OPS
+
+// One slot per opcode, then one per opcode behind OP_WIDE, then a slot for
+// time that does not belong to any instruction
+#define PROFILE_WIDE UINT8_COUNT
+#define PROFILE_NONE (2 * UINT8_COUNT)
+#define PROFILE_SLOTS (PROFILE_NONE + 1)
+
+// Executions and time spent per opcode
+typedef struct {
+    uint64_t counts[PROFILE_SLOTS];
+    uint64_t cycles[PROFILE_SLOTS];
+    // Slot of the instruction currently being timed, and when it started
+    size_t last;
+    uint64_t lastTime;
+} OpProfile;
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#include <x86intrin.h>
+
+#define PROFILE_RDTSC
+#define PROFILE_UNIT "cycles"
+
+static inline uint64_t readCycles(void) {
+    return __rdtsc();
+}
+#else
+#define PROFILE_UNIT "ns"
+
+uint64_t readClock(void);
+
+static inline uint64_t readCycles(void) {
+    return readClock();
+}
+#endif
+
+// Charges the time since the last sample to the previous instruction and
+// starts timing the one at ip
+static inline void sampleOp(OpProfile* profile, const uint8_t* ip) {
+    uint64_t now = readCycles();
+    profile->cycles[profile->last] += now - profile->lastTime;
+    profile->lastTime = now;
+    size_t slot = ip[0] == OP_WIDE ?
+        (size_t)(PROFILE_WIDE + ip[1]) : ip[0];
+    profile->counts[slot]++;
+    profile->last = slot;
+}
+
+void initOpProfile(OpProfile* profile);
+void startOpSample(OpProfile* profile);
+void stopOpSample(OpProfile* profile);
+void printOpProfile(OpProfile* profile, FILE* file);
+void writeOpProfileJson(OpProfile* profile, FILE* file);
+
+#endif
+
+#endif
\ No newline at end of file
@@ -0,0 +1,341 @@
+// The VM's dispatch loop, included by vm.c once for each variant it needs.
+// There is deliberately no include guard.
+// Before including, define:
+//   RUN_NAME         name of the function to generate
+//   RUN_PROFILE_OPS  (optional) time every instruction into vm->opProfile
+//   RUN_TRACE        (optional) record every instruction into vm->trace
+//   RUN_COUNT        (optional) count every instruction into vm->executed
+
+static InterpretResult RUN_NAME(VM* vm) {
+
+// Reads
+#define READ_BYTE() (*vm->ip++)
+#define READ_CONSTANT() (vm->chunk->constants.values[READ_BYTE()])
+#define READ_SHORT() (vm->ip += 2, \
+    (uint16_t)(COMBINE_2WORD(vm->ip[-2], vm->ip[-1])))
+#define READ_WORD() (vm->ip += 4, \
+    (uint32_t)(COMBINE_4WORD(vm->ip[-4], vm->ip[-3], vm->ip[-2], vm->ip[-1])))
+#define READ_WIDE_INDEX() (vm->ip += 3, \
+    (size_t)(COMBINE_3WORD(vm->ip[-3], vm->ip[-2], vm->ip[-1])))
+#define READ_WIDE_CONSTANT() (vm->chunk->constants.values[READ_WIDE_INDEX()])
+#define READ_STRING() AS_STRING(READ_CONSTANT())
+#define READ_WIDE_STRING() AS_STRING(READ_WIDE_CONSTANT())
+
+// Operations
+#define PUSH(value) (push(vm, (value)))
+// For instructions that leave the stack deeper than they found it, which
+// are the only ones that can need it to grow
+#define PUSH_GROW(value) \
+    do { \
+        if (!push(vm, (value))) { \
+            runtimeError(vm, "Out of memory."); \
+            return INTERPRET_RUNTIME_ERROR; \
+        } \
+    } while(false)
+#define POP() (pop(vm))
+#define PEEK(value) (peek(vm, (value)))
+#define SET_TOP(value) (vm->stackTop[-1] = (value))
+#if defined(CLOX_BIG_INTEGERS)
+    // Operations on int64_t that do not overflow, and on floats, are done
+    // inline. Everything else is left to arithmetic and compareNumbers.
+    // The result takes the place of the operands, so the stack cannot need
+    // to grow.
+    #define BINARY_OP_NUMBER(op, overflows, bigOp) \
+        do { \
+            Value b = PEEK(0); \
+            Value a = PEEK(1); \
+            int64_t vint; \
+            if (IS_INT(a) && IS_INT(b) && \
+                    !overflows(AS_INT(a), AS_INT(b), &vint)) { \
+                POP(); \
+                SET_TOP(INT_VAL(vint)); \
+            } \
+            else if ((IS_FLOAT(a) || IS_FLOAT(b)) && \
+                    IS_NUMBER(a) && IS_NUMBER(b)) { \
+                POP(); \
+                SET_TOP(FLOAT_VAL(NUMBER_TO_FLOAT(a) op NUMBER_TO_FLOAT(b))); \
+            } \
+            else if (!arithmetic(vm, bigOp)) { \
+                return INTERPRET_RUNTIME_ERROR; \
+            } \
+        } while(false)
+    #define BINARY_OP_BOOL(op) \
+        do { \
+            Value b = PEEK(0); \
+            Value a = PEEK(1); \
+            if (IS_INT(a) && IS_INT(b)) { \
+                POP(); \
+                SET_TOP(BOOL_VAL(AS_INT(a) op AS_INT(b))); \
+            } \
+            else if (IS_NUMBER(a) && IS_NUMBER(b)) { \
+                POP(); \
+                SET_TOP(BOOL_VAL(NUMBER_TO_FLOAT(a) op NUMBER_TO_FLOAT(b))); \
+            } \
+            else { \
+                int order; \
+                if (!compareNumbers(vm, &order)) { \
+                    return INTERPRET_RUNTIME_ERROR; \
+                } \
+                POP(); \
+                SET_TOP(BOOL_VAL(order op 0)); \
+            } \
+        } while(false)
+    #define BINARY_OP_DIVIDE(op, overflows, bigOp) \
+        BINARY_OP_NUMBER(op, overflows, bigOp)
+#elif defined(CLOX_INTEGER_TYPE)
+    #define BINARY_OP(fn1, fn2, op, divide) \
+        do { \
+            if (!IS_NUMBER(PEEK(0)) || !IS_NUMBER(PEEK(1))) { \
+                runtimeError(vm, "Operands must be numbers."); \
+                return INTERPRET_RUNTIME_ERROR; \
+            } \
+            Value b = POP(); \
+            Value a = POP(); \
+            if (IS_FLOAT(b) || IS_FLOAT(a)) { \
+                PUSH(fn1( \
+                    NUMBER_TO_FLOAT(a) op \
+                    NUMBER_TO_FLOAT(b) \
+                )); \
+            } \
+            else { \
+                int64_t vintb = AS_INT(b); \
+                if ((divide) && vintb == 0) { \
+                    runtimeError(vm, "Integer division by zero."); \
+                    return INTERPRET_RUNTIME_ERROR; \
+                } \
+                int64_t vinta = AS_INT(a); \
+                PUSH(fn2(vinta op vintb)); \
+            } \
+        } while(false)
+    #define BINARY_OP_NUMBER(op, overflows, bigOp) \
+        BINARY_OP(FLOAT_VAL, INT_VAL, op, false)
+    #define BINARY_OP_BOOL(op) BINARY_OP(BOOL_VAL, BOOL_VAL, op, false)
+    #define BINARY_OP_DIVIDE(op, overflows, bigOp) \
+        BINARY_OP(FLOAT_VAL, INT_VAL, op, true)
+#else
+    #define BINARY_OP(fn, op) \
+    do { \
+        if (!IS_NUMBER(PEEK(0)) || !IS_NUMBER(PEEK(1))) { \
+            runtimeError(vm, "Operands must be numbers."); \
+            return INTERPRET_RUNTIME_ERROR; \
+        } \
+        Value b = POP(); \
+        Value a = POP(); \
+        PUSH(fn(AS_FLOAT(a) op AS_FLOAT(b))); \
+    } while(false)
+    #define BINARY_OP_NUMBER(op, overflows, bigOp) BINARY_OP(FLOAT_VAL, op)
+    #define BINARY_OP_BOOL(op) BINARY_OP(BOOL_VAL, op)
+    #define BINARY_OP_DIVIDE(op, overflows, bigOp) BINARY_OP(FLOAT_VAL, op)
+#endif
+
+    // Begin VM Loop
+    while(1) {
+#ifdef DEBUG_TRACE_EXECUTION
+        // Print execution trace
+        printf("          ");
+        for (Value* slot = vm->stack; slot < vm->stackTop; slot++) {
+            printf("[ ");
+            printValue(*slot);
+            printf(" ]");
+        }
+        printf("\n");
+        disassembleInstruction(vm->chunk, (size_t)(vm->ip - vm->chunk->code));
+#endif
+#ifdef RUN_COUNT
+        vm->executed++;
+#endif
+#ifdef RUN_TRACE
+        recordTrace(vm->trace, vm->chunk->code, vm->ip,
+            vm->stack, vm->stackTop);
+#endif
+#ifdef RUN_PROFILE_OPS
+        sampleOp(vm->opProfile, vm->ip);
+#endif
+        uint8_t instruction;
+        switch (instruction = READ_BYTE()) {
+            case OP_CONSTANT: PUSH_GROW(READ_CONSTANT()); break;
+            case OP_DEFINE_GLOBAL:
+                if (!defineGlobal(vm, READ_STRING())) {
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                break;
+            case OP_DEFINE_GLOBAL_CONST:
+                if (!defineGlobalConst(vm, READ_STRING())) {
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                break;
+            case OP_GET_GLOBAL:
+                if (!getGlobal(vm, READ_STRING())) {
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                break;
+            case OP_SET_GLOBAL:
+                if (!setGlobal(vm, READ_STRING())) {
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                break;
+            case OP_GET_LOCAL: PUSH_GROW(vm->stack[READ_BYTE()]); break;
+            case OP_SET_LOCAL: vm->stack[READ_BYTE()] = PEEK(0); break;
+            case OP_NIL:   PUSH_GROW(NIL_VAL); break;
+            case OP_TRUE:  PUSH_GROW(BOOL_VAL(true)); break;
+            case OP_FALSE: PUSH_GROW(BOOL_VAL(false)); break;
+            case OP_POP:   POP(); break;
+            case OP_EQUAL: {
+                Value b = POP();
+                Value a = POP();
+                PUSH(BOOL_VAL(valuesEqual(a, b)));
+                break;
+            }
+            case OP_GREATER:  BINARY_OP_BOOL(>); break;
+            case OP_LESS:     BINARY_OP_BOOL(<); break;
+            case OP_ADD:      {
+                Value peek0 = PEEK(0);
+                Value peek1 = PEEK(1);
+                if (IS_STRING(peek0) && IS_STRING(peek1)) {
+                    if (!concatenate(vm)) {
+                        return INTERPRET_RUNTIME_ERROR;
+                    }
+                }
+                else if (IS_NUMBER(peek0) && IS_NUMBER(peek1)) {
+                    BINARY_OP_NUMBER(+, __builtin_add_overflow, BIG_ADD);
+                }
+#ifdef CLOX_BIG_INTEGERS
+                else if (!arithmetic(vm, BIG_ADD)) {
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+#else
+                else {
+                    runtimeError(vm,
+                        "Operands must be two numbers or two strings.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+#endif
+                break;
+            }
+            case OP_SUBTRACT:
+                BINARY_OP_NUMBER(-, __builtin_sub_overflow, BIG_SUBTRACT);
+                break;
+            case OP_MULTIPLY:
+                BINARY_OP_NUMBER(*, __builtin_mul_overflow, BIG_MULTIPLY);
+                break;
+            case OP_DIVIDE:
+                BINARY_OP_DIVIDE(/, divideOverflows, BIG_DIVIDE);
+                break;
+            case OP_NOT: PUSH(BOOL_VAL(isFalsey(POP()))); break;
+            case OP_NEGATE:
+#ifdef CLOX_BIG_INTEGERS
+                if (!negateNumber(vm)) {
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                break;
+#else
+                if (!IS_NUMBER(PEEK(0))) {
+                    runtimeError(vm, "Operand for negation must be a number.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                PUSH(negate(POP())); break;
+#endif
+            case OP_PRINT:
+                if (!printStatement(vm, POP())) {
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                break;
+            case OP_JUMP: {
+                uint16_t offset = READ_SHORT();
+                vm->ip += offset;
+                break;
+            }
+            case OP_JUMP_IF_FALSE: {
+                uint16_t offset = READ_SHORT();
+                if (isFalsey(PEEK(0))) {
+                    vm->ip += offset;
+                }
+                break;
+            }
+            case OP_LOOP: {
+                uint16_t offset = READ_SHORT();
+                vm->ip -= offset;
+                if (spendFuel(vm, offset)) {
+                    return pauseResult(vm);
+                }
+                break;
+            }
+            case OP_WIDE: {
+                // The same instructions as above, with wider operands
+                switch (instruction = READ_BYTE()) {
+                    case OP_CONSTANT: PUSH_GROW(READ_WIDE_CONSTANT()); break;
+                    case OP_DEFINE_GLOBAL:
+                        if (!defineGlobal(vm, READ_WIDE_STRING())) {
+                            return INTERPRET_RUNTIME_ERROR;
+                        }
+                        break;
+                    case OP_DEFINE_GLOBAL_CONST:
+                        if (!defineGlobalConst(vm, READ_WIDE_STRING())) {
+                            return INTERPRET_RUNTIME_ERROR;
+                        }
+                        break;
+                    case OP_GET_GLOBAL:
+                        if (!getGlobal(vm, READ_WIDE_STRING())) {
+                            return INTERPRET_RUNTIME_ERROR;
+                        }
+                        break;
+                    case OP_SET_GLOBAL:
+                        if (!setGlobal(vm, READ_WIDE_STRING())) {
+                            return INTERPRET_RUNTIME_ERROR;
+                        }
+                        break;
+                    case OP_GET_LOCAL:
+                        PUSH_GROW(vm->stack[READ_WIDE_INDEX()]);
+                        break;
+                    case OP_SET_LOCAL:
+                        vm->stack[READ_WIDE_INDEX()] = PEEK(0);
+                        break;
+                    case OP_JUMP: {
+                        uint32_t offset = READ_WORD();
+                        vm->ip += offset;
+                        break;
+                    }
+                    case OP_JUMP_IF_FALSE: {
+                        uint32_t offset = READ_WORD();
+                        if (isFalsey(PEEK(0))) {
+                            vm->ip += offset;
+                        }
+                        break;
+                    }
+                    case OP_LOOP: {
+                        uint32_t offset = READ_WORD();
+                        vm->ip -= offset;
+                        if (spendFuel(vm, offset)) {
+                            return pauseResult(vm);
+                        }
+                        break;
+                    }
+                }
+                break;
+            }
+            case OP_RETURN: {
+                // Exit interpreter
+                return INTERPRET_OK;
+            }
+        }
+    }
+#undef READ_BYTE
+#undef READ_CONSTANT
+#undef READ_SHORT
+#undef READ_WORD
+#undef READ_WIDE_INDEX
+#undef READ_WIDE_CONSTANT
+#undef READ_STRING
+#undef READ_WIDE_STRING
+#undef PUSH
+#undef PUSH_GROW
+#undef POP
+#undef PEEK
+#undef SET_TOP
+#undef BINARY_OP
+#undef BINARY_OP_NUMBER
+#undef BINARY_OP_BOOL
+#undef BINARY_OP_DIVIDE
+#undef DEFINE_GLOBAL
+#undef GET_CONSTANT
+}
\ No newline at end of file
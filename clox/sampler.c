@@ -0,0 +1,280 @@
+// setitimer and sigaction
+#define _XOPEN_SOURCE 600
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "sampler.h"
+#include "memory.h"
+
+#ifdef CLOX_SAMPLING_PROFILER
+
+// Give up on a sample after this many collisions
+#define SAMPLER_MAX_PROBES 64
+// Lines shown by printSampleReport
+#define SAMPLER_REPORT_LINES 40
+
+// Only one sampler can run at a time since there is only one SIGPROF
+static Sampler* activeSampler = NULL;
+
+// Returns the slot holding key, or an empty slot to put it in, or
+// SAMPLER_SLOTS if neither can be found quickly
+static size_t findSlot(Sampler* sampler, size_t key) {
+    size_t index = (key * 2654435761u) & (SAMPLER_SLOTS - 1);
+    for (int i = 0; i < SAMPLER_MAX_PROBES; i++) {
+        if (sampler->keys[index] == key || sampler->keys[index] == 0) {
+            return index;
+        }
+        index = (index + 1) & (SAMPLER_SLOTS - 1);
+    }
+    return SAMPLER_SLOTS;
+}
+
+// Runs in signal context, so it must not allocate or call into stdio
+static void takeSample(int signal) {
+    UNUSED(signal);
+    Sampler* sampler = activeSampler;
+    if (sampler == NULL) {
+        return;
+    }
+    if (!sampler->running) {
+        sampler->idle++;
+        return;
+    }
+    size_t key = (size_t)(*sampler->ip - sampler->code) + 1;
+    size_t slot = findSlot(sampler, key);
+    if (slot == SAMPLER_SLOTS) {
+        sampler->dropped++;
+        return;
+    }
+    sampler->keys[slot] = key;
+    sampler->hits[slot]++;
+}
+
+// Starts taking rate samples per second of CPU time
+// Returns false if the timer could not be set up
+bool startSampler(Sampler* sampler, uint8_t* volatile* ip, unsigned rate) {
+    memset(sampler->keys, 0, sizeof(sampler->keys));
+    memset(sampler->hits, 0, sizeof(sampler->hits));
+    sampler->running = 0;
+    sampler->code = NULL;
+    sampler->ip = ip;
+    sampler->idle = 0;
+    sampler->dropped = 0;
+    sampler->lines = NULL;
+    sampler->lineCapacity = 0;
+    sampler->rate = rate == 0 ? 1 : rate;
+    activeSampler = sampler;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = takeSample;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    if (sigaction(SIGPROF, &action, NULL) != 0) {
+        return false;
+    }
+
+    long interval = 1000000L / (long)sampler->rate;
+    struct itimerval timer;
+    timer.it_interval.tv_sec = interval / 1000000L;
+    timer.it_interval.tv_usec = interval % 1000000L;
+    if (interval == 0) {
+        timer.it_interval.tv_usec = 1;
+    }
+    timer.it_value = timer.it_interval;
+    return setitimer(ITIMER_PROF, &timer, NULL) == 0;
+}
+
+// Stops taking samples, keeping the ones taken so far
+void stopSampler(Sampler* sampler) {
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, NULL);
+    // A signal may still be pending, and the default action would end the
+    // process
+    signal(SIGPROF, SIG_IGN);
+    if (activeSampler == sampler) {
+        activeSampler = NULL;
+    }
+}
+
+void freeSampler(Sampler* sampler) {
+    FREE_ARRAY(uint64_t, sampler->lines, sampler->lineCapacity, MEM_TOOLS);
+    sampler->lines = NULL;
+    sampler->lineCapacity = 0;
+}
+
+typedef struct {
+    size_t offset;
+    uint64_t hits;
+} OffsetSample;
+
+static int compareOffsets(const void* a, const void* b) {
+    size_t offsetA = ((const OffsetSample*)a)->offset;
+    size_t offsetB = ((const OffsetSample*)b)->offset;
+    return (offsetA > offsetB) - (offsetA < offsetB);
+}
+
+// Makes room for the totals of the first count lines
+// Returns false for failed allocation, keeping the totals so far
+static bool growLines(Sampler* sampler, size_t count) {
+    size_t newCapacity = sampler->lineCapacity;
+    while (newCapacity < count) {
+        newCapacity = GROW_CAPACITY(newCapacity);
+    }
+    uint64_t* lines = GROW_ARRAY_ZERO(sampler->lines, uint64_t,
+        sampler->lineCapacity, newCapacity, MEM_TOOLS);
+    if (lines == NULL) {
+        return false;
+    }
+    sampler->lines = lines;
+    sampler->lineCapacity = newCapacity;
+    return true;
+}
+
+// Adds the samples taken in chunk to the per-line totals and clears them,
+// ready for the next chunk
+// Must be called before the chunk is freed or the samples are lost
+void resolveSamples(Sampler* sampler, Chunk* chunk) {
+    sigset_t signals;
+    sigset_t oldSignals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGPROF);
+    sigprocmask(SIG_BLOCK, &signals, &oldSignals);
+
+    // Collect the sampled offsets in order so the line table only has to
+    // be walked once
+    size_t count = 0;
+    for (size_t i = 0; i < SAMPLER_SLOTS; i++) {
+        if (sampler->keys[i] != 0) {
+            count++;
+        }
+    }
+    OffsetSample* samples = NULL;
+    if (count > 0 && chunk->count > 0) {
+        samples = ALLOCATE(OffsetSample, count, false, MEM_TOOLS);
+    }
+    if (samples == NULL) {
+        // Samples that cannot be put on a line are dropped
+        for (size_t i = 0; i < SAMPLER_SLOTS; i++) {
+            sampler->dropped += sampler->hits[i];
+        }
+    }
+    else {
+        size_t index = 0;
+        for (size_t i = 0; i < SAMPLER_SLOTS; i++) {
+            if (sampler->keys[i] != 0) {
+                size_t offset = sampler->keys[i] - 1;
+                if (offset >= chunk->count) {
+                    offset = chunk->count - 1;
+                }
+                samples[index].offset = offset;
+                samples[index].hits = sampler->hits[i];
+                index++;
+            }
+        }
+        qsort(samples, count, sizeof(OffsetSample), compareOffsets);
+
+        size_t line = 1;
+        size_t lineEnd = chunk->lines[0];
+        for (size_t i = 0; i < count; i++) {
+            while (samples[i].offset >= lineEnd) {
+                lineEnd += chunk->lines[line];
+                line++;
+            }
+            if (line > sampler->lineCapacity && !growLines(sampler, line)) {
+                sampler->dropped += samples[i].hits;
+                continue;
+            }
+            sampler->lines[line - 1] += samples[i].hits;
+        }
+        FREE_ARRAY(OffsetSample, samples, count, MEM_TOOLS);
+    }
+
+    memset(sampler->keys, 0, sizeof(sampler->keys));
+    memset(sampler->hits, 0, sizeof(sampler->hits));
+    sigprocmask(SIG_SETMASK, &oldSignals, NULL);
+}
+
+// For compareLines, which qsort gives no context
+static __thread Sampler* sortedSampler;
+
+static int compareLines(const void* a, const void* b) {
+    uint64_t hitsA = sortedSampler->lines[*(const size_t*)a];
+    uint64_t hitsB = sortedSampler->lines[*(const size_t*)b];
+    if (hitsA != hitsB) {
+        return (hitsA < hitsB) - (hitsA > hitsB);
+    }
+    return (*(const size_t*)a > *(const size_t*)b) -
+        (*(const size_t*)a < *(const size_t*)b);
+}
+
+// Prints the lines that got the most samples
+void printSampleReport(Sampler* sampler, FILE* file) {
+    size_t count = 0;
+    uint64_t running = 0;
+    for (size_t i = 0; i < sampler->lineCapacity; i++) {
+        if (sampler->lines[i] > 0) {
+            count++;
+            running += sampler->lines[i];
+        }
+    }
+    fprintf(file, "%llu samples at %u per second: %llu running, "
+        "%llu compiling or idle, %llu dropped\n",
+        (unsigned long long)(running + sampler->idle + sampler->dropped),
+        sampler->rate, (unsigned long long)running,
+        (unsigned long long)sampler->idle,
+        (unsigned long long)sampler->dropped);
+    if (count == 0) {
+        return;
+    }
+
+    size_t* order = ALLOCATE(size_t, count, false, MEM_TOOLS);
+    if (order == NULL) {
+        fprintf(file, "Not enough memory for the line report.\n");
+        return;
+    }
+    size_t index = 0;
+    for (size_t i = 0; i < sampler->lineCapacity; i++) {
+        if (sampler->lines[i] > 0) {
+            order[index++] = i;
+        }
+    }
+    sortedSampler = sampler;
+    qsort(order, count, sizeof(size_t), compareLines);
+
+    fprintf(file, "%8s %10s %8s %10s\n",
+        "line", "samples", "share", "cumulative");
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < count && i < SAMPLER_REPORT_LINES; i++) {
+        uint64_t hits = sampler->lines[order[i]];
+        cumulative += hits;
+        fprintf(file, "%8" FORMAT_SIZE_T " %10llu %7.2f%% %9.2f%%\n",
+            order[i] + 1, (unsigned long long)hits,
+            100.0 * (double)hits / (double)running,
+            100.0 * (double)cumulative / (double)running);
+    }
+    if (count > SAMPLER_REPORT_LINES) {
+        fprintf(file, "%" FORMAT_SIZE_T " more lines\n",
+            count - SAMPLER_REPORT_LINES);
+    }
+    FREE_ARRAY(size_t, order, count, MEM_TOOLS);
+}
+
+// Writes one "frame;frame count" line per sampled source line, the folded
+// format that flame graph tools take as input
+void writeCollapsedStacks(Sampler* sampler, FILE* file) {
+    for (size_t i = 0; i < sampler->lineCapacity; i++) {
+        if (sampler->lines[i] > 0) {
+            fprintf(file, "script;line %" FORMAT_SIZE_T " %llu\n",
+                i + 1, (unsigned long long)sampler->lines[i]);
+        }
+    }
+    if (sampler->idle > 0) {
+        fprintf(file, "compile %llu\n", (unsigned long long)sampler->idle);
+    }
+}
+
+#endif
\ No newline at end of file
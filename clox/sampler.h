@@ -0,0 +1,48 @@
+#ifndef clox_sampler_h
+#define clox_sampler_h
+
+#include <signal.h>
+#include <stdio.h>
+
+#include "common.h"
+#include "chunk.h"
+
+#ifdef CLOX_SAMPLING_PROFILER
+
+// Samples per second of CPU time unless asked otherwise
+#define SAMPLER_DEFAULT_RATE 997
+// Number of distinct instruction offsets that can be sampled per chunk.
+// Samples at further offsets are counted as dropped.
+#define SAMPLER_SLOTS 65536
+
+// Periodically records where the VM is from a SIGPROF handler
+typedef struct {
+    // Samples by instruction offset, filled in by the signal handler.
+    // Keys are offsets plus one so that zero means empty.
+    size_t keys[SAMPLER_SLOTS];
+    uint64_t hits[SAMPLER_SLOTS];
+    // Set by the VM while it runs code, along with the start of that code
+    volatile sig_atomic_t running;
+    uint8_t* volatile code;
+    // The VM's instruction pointer
+    uint8_t* volatile* ip;
+    // Samples taken while not running code, mostly while compiling
+    uint64_t idle;
+    uint64_t dropped;
+    // Samples by source line, gathered from the offsets after each chunk.
+    // Index 0 is line 1.
+    uint64_t* lines;
+    size_t lineCapacity;
+    unsigned rate;
+} Sampler;
+
+bool startSampler(Sampler* sampler, uint8_t* volatile* ip, unsigned rate);
+void stopSampler(Sampler* sampler);
+void freeSampler(Sampler* sampler);
+void resolveSamples(Sampler* sampler, Chunk* chunk);
+void printSampleReport(Sampler* sampler, FILE* file);
+void writeCollapsedStacks(Sampler* sampler, FILE* file);
+
+#endif
+
+#endif
\ No newline at end of file
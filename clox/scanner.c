@@ -3,13 +3,165 @@
 
 #include "common.h"
 #include "scanner.h"
+#include "memory.h"
 
 void initScanner(Scanner* scanner, const char* source) {
     scanner->start = source;
     scanner->current = source;
     scanner->line = 1;
+#ifdef CLOX_STREAMING_SOURCE
+    scanner->end = source + strlen(source);
+    scanner->file = NULL;
+    scanner->eof = true;
+    scanner->error = NULL;
+    scanner->window = NULL;
+    scanner->windowCapacity = 0;
+    scanner->lexemes = NULL;
+    scanner->lexemeCount = 0;
+    scanner->nextLexeme = 0;
+#endif
+}
+
+#ifdef CLOX_STREAMING_SOURCE
+// Scans from a file, keeping only a window of it in memory at a time
+// The file should be unbuffered, since the window already buffers it
+void initFileScanner(Scanner* scanner, FILE* file) {
+    initScanner(scanner, "");
+    scanner->window = ALLOCATE(char, SCANNER_WINDOW, false, MEM_SCANNER);
+    if (scanner->window == NULL) {
+        scanner->error = "Out of memory.";
+        return;
+    }
+    scanner->windowCapacity = SCANNER_WINDOW;
+    scanner->window[0] = '\0';
+    scanner->start = scanner->window;
+    scanner->current = scanner->window;
+    scanner->end = scanner->window;
+    scanner->file = file;
+    scanner->eof = false;
+    // Sets the error if it fails, leaving no lexemes, and saveLexeme then
+    // saves nothing
+    reserveLexemes(scanner, SCANNER_LEXEMES);
+}
+
+// Keeps the text of the last count tokens valid, for callers that hold on
+// to more tokens than the parser
+// On failed allocation the old lexemes are kept, and the next token is an
+// error
+void reserveLexemes(Scanner* scanner, size_t count) {
+    if (count <= scanner->lexemeCount) {
+        return;
+    }
+    Lexeme* lexemes = GROW_ARRAY_ZERO(scanner->lexemes, Lexeme,
+        scanner->lexemeCount, count, MEM_SCANNER);
+    if (lexemes == NULL) {
+        scanner->error = "Out of memory.";
+        return;
+    }
+    scanner->lexemes = lexemes;
+    scanner->lexemeCount = count;
+}
+#endif
+
+void freeScanner(Scanner* scanner) {
+#ifdef CLOX_STREAMING_SOURCE
+    FREE_ARRAY(char, scanner->window, scanner->windowCapacity, MEM_SCANNER);
+    for (size_t i = 0; i < scanner->lexemeCount; i++) {
+        FREE_ARRAY(char, scanner->lexemes[i].chars,
+            scanner->lexemes[i].capacity, MEM_SCANNER);
+    }
+    FREE_ARRAY(Lexeme, scanner->lexemes, scanner->lexemeCount, MEM_SCANNER);
+    initScanner(scanner, "");
+#else
+    UNUSED(scanner);
+#endif
+}
+
+#ifdef CLOX_STREAMING_SOURCE
+// Slides the window so that the token being scanned begins the buffer,
+// then reads as much of the file as fits after it
+static void refill(Scanner* scanner) {
+    size_t keep = (size_t)(scanner->end - scanner->start);
+    size_t offset = (size_t)(scanner->current - scanner->start);
+    // Tokens longer than half the window grow it instead
+    if (keep >= scanner->windowCapacity / 2) {
+        char* window = ALLOCATE(char, scanner->windowCapacity * 2, false,
+            MEM_SCANNER);
+        if (window == NULL) {
+            scanner->error = "Out of memory.";
+            scanner->eof = true;
+            return;
+        }
+        memcpy(window, scanner->start, keep);
+        FREE_ARRAY(char, scanner->window, scanner->windowCapacity,
+            MEM_SCANNER);
+        scanner->window = window;
+        scanner->windowCapacity *= 2;
+    }
+    else {
+        memmove(scanner->window, scanner->start, keep);
+    }
+    scanner->start = scanner->window;
+    scanner->current = scanner->window + offset;
+
+    size_t bytesRead = fread(scanner->window + keep, sizeof(char),
+        scanner->windowCapacity - keep - 1, scanner->file);
+    if (bytesRead == 0) {
+        scanner->eof = true;
+        if (ferror(scanner->file)) {
+            scanner->error = "Could not read file.";
+        }
+    }
+    scanner->end = scanner->window + keep + bytesRead;
+    scanner->window[keep + bytesRead] = '\0';
 }
 
+// Makes sure count characters past current are loaded, unless the file
+// ends first
+static void require(Scanner* scanner, size_t count) {
+    while ((size_t)(scanner->end - scanner->current) < count &&
+            !scanner->eof) {
+        refill(scanner);
+    }
+}
+
+// Copies the text of the token being made out of the window, ending it
+// with a '\0' as the whole source would be
+// On failed allocation the token is replaced by an error
+static const char* saveLexeme(Scanner* scanner, size_t length) {
+    if (scanner->lexemeCount == 0) {
+        // The lexemes could not be reserved, which has set the error
+        return scanner->start;
+    }
+    Lexeme* lexeme = &scanner->lexemes[scanner->nextLexeme];
+    scanner->nextLexeme = (scanner->nextLexeme + 1) % scanner->lexemeCount;
+    if (lexeme->capacity < length + 1) {
+        size_t capacity = GROW_CAPACITY(length + 1);
+        FREE_ARRAY(char, lexeme->chars, lexeme->capacity, MEM_SCANNER);
+        lexeme->chars = ALLOCATE(char, capacity, false, MEM_SCANNER);
+        lexeme->capacity = lexeme->chars == NULL ? 0 : capacity;
+        if (lexeme->chars == NULL) {
+            scanner->error = "Out of memory.";
+            return scanner->start;
+        }
+    }
+    memcpy(lexeme->chars, scanner->start, length);
+    lexeme->chars[length] = '\0';
+    return lexeme->chars;
+}
+
+// The window always ends with a '\0', so only look for more of the file
+// when one is seen
+#define REQUIRE(count) \
+    do { \
+        if (scanner->current[(count) - 1] == '\0') { \
+            require(scanner, (count)); \
+        } \
+    } while (false)
+#else
+#define REQUIRE(count) ((void)0)
+#endif
+
 static bool isAlpha(char c) {
     return (c >= 'a' && c <= 'z') ||
         (c >= 'A' && c <= 'Z') ||
@@ -21,10 +173,12 @@ static bool isDigit(char c) {
 }
 
 static bool isAtEnd(Scanner* scanner) {
+    REQUIRE(1);
     return *scanner->current == '\0';
 }
 
 static char peek(Scanner* scanner) {
+    REQUIRE(1);
     return *scanner->current;
 }
 
@@ -32,6 +186,7 @@ static char peekNext(Scanner* scanner) {
     if (isAtEnd(scanner)) {
         return '\0';
     }
+    REQUIRE(2);
     return scanner->current[1];
 }
 
@@ -53,6 +208,8 @@ static bool match(Scanner* scanner, char expected) {
 
 static void skipWhitespace(Scanner* scanner) {
     while (1) {
+        // Let the window slide past whitespace and comments
+        scanner->start = scanner->current;
         char c = peek(scanner);
         switch(c) {
             case ' ':
@@ -68,6 +225,7 @@ static void skipWhitespace(Scanner* scanner) {
                 if (peekNext(scanner) == '/') {
                     while(peek(scanner) != '\n' && !isAtEnd(scanner)) {
                         advance(scanner);
+                        scanner->start = scanner->current;
                     }
                 }
                 else {
@@ -80,14 +238,44 @@ static void skipWhitespace(Scanner* scanner) {
     }
 }
 
+#ifdef CLOX_STREAMING_SOURCE
+// Replaces the token with the error that stopped the scanner, if there is
+// one, after which the scanner is at the end
+static bool failedToken(Scanner* scanner, Token* token) {
+    if (scanner->error == NULL) {
+        return false;
+    }
+    token->type = TOKEN_ERROR;
+    token->start = scanner->error;
+    token->length = (int)strlen(scanner->error);
+    token->line = scanner->line;
+    scanner->error = NULL;
+    scanner->eof = true;
+    scanner->start = scanner->end;
+    scanner->current = scanner->end;
+    return true;
+}
+#endif
+
 static void makeToken(Scanner* scanner, Token* token, TokenType type) {
     token->type = type;
     token->start = scanner->start;
     token->length = (int)(scanner->current - scanner->start);
     token->line = scanner->line;
+#ifdef CLOX_STREAMING_SOURCE
+    if (scanner->file != NULL) {
+        token->start = saveLexeme(scanner, (size_t)token->length);
+    }
+    failedToken(scanner, token);
+#endif
 }
 
 static void errorToken(Scanner* scanner, Token* token, const char* message) {
+#ifdef CLOX_STREAMING_SOURCE
+    if (failedToken(scanner, token)) {
+        return;
+    }
+#endif
     token->type = TOKEN_ERROR;
     token->start = message;
     token->length = (int)strlen(message);
@@ -125,9 +313,11 @@ static void number(Scanner* scanner, Token* token) {
 #ifndef CLOX_INTEGER_TYPE
     isFloat = true;
 #endif
+    int point = -1;
     // Look for decimal part
     if (peek(scanner) == '.' && isDigit(peekNext(scanner))) {
         isFloat = true;
+        point = (int)(scanner->current - scanner->start);
         // Consume the '.'
         advance(scanner);
 
@@ -142,6 +332,11 @@ static void number(Scanner* scanner, Token* token) {
     else {
         MAKE_TOKEN(TOKEN_INTEGER);
     }
+#endif
+#ifdef CLOX_FAST_NUMBER_PARSE
+    token->point = point;
+#else
+    UNUSED(point);
 #endif
     return;
 }
@@ -269,4 +464,5 @@ void scanToken(Scanner* scanner, Token* token) {
 
 #undef MAKE_TOKEN
 #undef ERROR_TOKEN
-#undef MATCH
\ No newline at end of file
+#undef MATCH
+#undef REQUIRE
\ No newline at end of file
@@ -1,10 +1,43 @@
 #ifndef clox_scanner_h
 #define clox_scanner_h
 
+#include <stdio.h>
+
+#include "common.h"
+
+#ifdef CLOX_STREAMING_SOURCE
+// Initial size of the window over a streamed source file
+#define SCANNER_WINDOW 65536
+// Number of most recent tokens whose text stays valid after scanning
+#define SCANNER_LEXEMES 2
+
+typedef struct {
+    size_t capacity;
+    char* chars;
+} Lexeme;
+#endif
+
 typedef struct {
     const char* start;
     const char* current;
     size_t line;
+#ifdef CLOX_STREAMING_SOURCE
+    // One past the last valid character in the source or window
+    const char* end;
+    // NULL when scanning an in-memory string
+    FILE* file;
+    bool eof;
+    // Why the rest of the file cannot be scanned, reported in place of the
+    // next token, or NULL
+    const char* error;
+    char* window;
+    size_t windowCapacity;
+    // The window slides as the file is read, so token text is copied out
+    // into a small ring of buffers
+    Lexeme* lexemes;
+    size_t lexemeCount;
+    size_t nextLexeme;
+#endif
 } Scanner;
 
 typedef enum {
@@ -44,9 +77,18 @@ typedef struct {
     const char* start;
     int length;
     size_t line;
+#ifdef CLOX_FAST_NUMBER_PARSE
+    // Offset of the '.' from start for number tokens, -1 if there is none
+    int point;
+#endif
 } Token;
 
 void initScanner(Scanner* scanner, const char* source);
+#ifdef CLOX_STREAMING_SOURCE
+void initFileScanner(Scanner* scanner, FILE* file);
+void reserveLexemes(Scanner* scanner, size_t count);
+#endif
+void freeScanner(Scanner* scanner);
 void scanToken(Scanner* scanner, Token* token);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,650 @@
+// For open_memstream, strdup and sigaction
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.h"
+#include "main.h"
+
+#ifdef CLOX_SERVE
+
+// Runs scripts sent over a Unix stream socket on VMs that are kept between
+// requests, compiling each script only once.
+//
+// A connection can make any number of requests, one after another, and is
+// closed once it has been idle for IDLE_TIMEOUT seconds. Each request is a
+// line of one of these forms:
+//   file <instruction limit> <memory limit> <path>
+//   source <instruction limit> <memory limit> <length>
+// where a limit of 0 means the server's own, and a request can only lower
+// the server's limits. A source line is followed by length bytes of source.
+// The reply is any number of frames of
+//   out <length>\n<bytes>    what print statements wrote, sent as it is made
+//   err <length>\n<bytes>    compile and runtime errors
+// ending with
+//   exit <code>\n            the exit code clox would have given
+
+// Most programs kept compiled at once. Beyond this the least recently used
+// one that no request is running is dropped.
+#define CACHE_CAPACITY 256
+#define CACHE_BUCKETS 512
+// Longest request line
+#define REQUEST_LINE 4096
+// Most bytes of source a request can send
+#define SOURCE_LIMIT (16 * 1024 * 1024)
+// Output is sent whenever this much has been printed
+#define REPLY_BUFFER 8192
+// Seconds a connection can go without sending a request, or without
+// taking its reply, before it is closed so that its worker can move on
+#define IDLE_TIMEOUT 30
+
+// A compiled script, named by its path or by its whole source
+typedef struct Cached {
+    char* key;
+    size_t keyLength;
+    bool isFile;
+    // What the file looked like when it was compiled
+    struct stat file;
+    Program program;
+    // Requests running the program, which cannot be freed until none are
+    int users;
+    // Set once it is out of the cache, to be freed by its last user
+    bool dropped;
+    uint64_t lastUsed;
+    struct Cached* next;
+} Cached;
+
+typedef struct {
+    int listener;
+    // Options the VM of each worker starts with
+    VM* options;
+    // Held to use the cache
+    pthread_mutex_t lock;
+    Cached* buckets[CACHE_BUCKETS];
+    size_t cached;
+    // Counts lookups, to tell which program was used least recently
+    uint64_t clock;
+} Server;
+
+// Bytes read from a connection that have not been used yet
+typedef struct {
+    int fd;
+    char buffer[REQUEST_LINE];
+    size_t start;
+    size_t end;
+} Reader;
+
+// Output of the request being run
+typedef struct {
+    int fd;
+    char buffer[REPLY_BUFFER];
+    size_t length;
+    // Set once the client has gone, after which nothing more is sent
+    bool failed;
+} Reply;
+
+// Where the socket is, to be removed when the server is stopped
+static const char* socketPath = NULL;
+
+static void stopServer(int number) {
+    UNUSED(number);
+    unlink(socketPath);
+    _exit(0);
+}
+
+static void sendBytes(Reply* reply, const char* bytes, size_t length) {
+    while (length > 0 && !reply->failed) {
+        ssize_t sent = write(reply->fd, bytes, length);
+        if (sent < 0) {
+            if (errno != EINTR) {
+                reply->failed = true;
+            }
+            continue;
+        }
+        bytes += sent;
+        length -= (size_t)sent;
+    }
+}
+
+static void sendFrame(Reply* reply, const char* kind, const char* bytes,
+        size_t length) {
+    char header[32];
+    int headerLength = snprintf(header, sizeof(header),
+        "%s %" FORMAT_SIZE_T "\n", kind, length);
+    sendBytes(reply, header, (size_t)headerLength);
+    sendBytes(reply, bytes, length);
+}
+
+static void flushOutput(Reply* reply) {
+    if (reply->length > 0) {
+        sendFrame(reply, "out", reply->buffer, reply->length);
+        reply->length = 0;
+    }
+}
+
+// Given to the VM to receive what print statements write
+static void writeOutput(void* context, const char* text, size_t length) {
+    Reply* reply = (Reply*)context;
+    if (reply->length + length > REPLY_BUFFER) {
+        flushOutput(reply);
+        if (length > REPLY_BUFFER) {
+            sendFrame(reply, "out", text, length);
+            return;
+        }
+    }
+    memcpy(reply->buffer + reply->length, text, length);
+    reply->length += length;
+}
+
+// Reads a line without its newline into line, which must hold
+// REQUEST_LINE bytes
+// Returns false at the end of the connection, or if the line is too long
+static bool readLine(Reader* reader, char* line) {
+    while (true) {
+        char* newline = memchr(reader->buffer + reader->start, '\n',
+            reader->end - reader->start);
+        if (newline != NULL) {
+            size_t length = (size_t)(newline - reader->buffer) -
+                reader->start;
+            memcpy(line, reader->buffer + reader->start, length);
+            line[length] = '\0';
+            reader->start += length + 1;
+            return true;
+        }
+        if (reader->start == 0 && reader->end == REQUEST_LINE) {
+            return false;
+        }
+        memmove(reader->buffer, reader->buffer + reader->start,
+            reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+        ssize_t got = read(reader->fd, reader->buffer + reader->end,
+            REQUEST_LINE - reader->end);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        reader->end += (size_t)got;
+    }
+}
+
+// Returns false if the connection ends first
+static bool readBytes(Reader* reader, char* bytes, size_t length) {
+    size_t buffered = reader->end - reader->start;
+    if (buffered > length) {
+        buffered = length;
+    }
+    memcpy(bytes, reader->buffer + reader->start, buffered);
+    reader->start += buffered;
+    size_t done = buffered;
+    while (done < length) {
+        ssize_t got = read(reader->fd, bytes + done, length - done);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        done += (size_t)got;
+    }
+    return true;
+}
+
+#ifndef CLOX_STREAMING_SOURCE
+// Reads the rest of file into a string, which the caller frees
+// Returns NULL if it cannot be read or there is not enough memory
+static char* readSource(FILE* file) {
+    if (fseek(file, 0L, SEEK_END) != 0) {
+        return NULL;
+    }
+    long size = ftell(file);
+    if (size < 0) {
+        return NULL;
+    }
+    rewind(file);
+    char* text = (char*)malloc((size_t)size + 1);
+    if (text == NULL) {
+        return NULL;
+    }
+    size_t length = fread(text, 1, (size_t)size, file);
+    if (ferror(file)) {
+        free(text);
+        return NULL;
+    }
+    text[length] = '\0';
+    return text;
+}
+#endif
+
+static void freeCached(Cached* cached) {
+    freeProgram(&cached->program);
+    free(cached->key);
+    free(cached);
+}
+
+static bool sameFile(struct stat* a, struct stat* b) {
+    return a->st_dev == b->st_dev && a->st_ino == b->st_ino &&
+        a->st_size == b->st_size && a->st_mtime == b->st_mtime;
+}
+
+// Must be called with the lock held
+static Cached** findCached(Server* server, bool isFile, const char* key,
+        size_t keyLength) {
+    uint32_t hash = hashString(key, (int)keyLength);
+    Cached** link = &server->buckets[hash % CACHE_BUCKETS];
+    while (*link != NULL) {
+        Cached* cached = *link;
+        if (cached->isFile == isFile && cached->keyLength == keyLength &&
+                memcmp(cached->key, key, keyLength) == 0) {
+            return link;
+        }
+        link = &cached->next;
+    }
+    return link;
+}
+
+// Takes the program out of the cache, freeing it if no request is using it
+// Must be called with the lock held
+static void dropCached(Server* server, Cached** link) {
+    Cached* cached = *link;
+    *link = cached->next;
+    server->cached--;
+    cached->dropped = true;
+    if (cached->users == 0) {
+        freeCached(cached);
+    }
+}
+
+// Makes room for another program if the cache is full
+// Must be called with the lock held
+static void evictCached(Server* server) {
+    if (server->cached < CACHE_CAPACITY) {
+        return;
+    }
+    Cached** oldest = NULL;
+    for (int i = 0; i < CACHE_BUCKETS; i++) {
+        for (Cached** link = &server->buckets[i]; *link != NULL;
+                link = &(*link)->next) {
+            if ((*link)->users == 0 &&
+                    (oldest == NULL || (*link)->lastUsed < (*oldest)->lastUsed)) {
+                oldest = link;
+            }
+        }
+    }
+    if (oldest != NULL) {
+        dropCached(server, oldest);
+    }
+}
+
+// Returns the cached program for the file at path or for source, compiling
+// it if needed, or NULL after reporting why it cannot be run and setting
+// status to the exit code for that
+static Cached* acquireProgram(Server* server, VM* vm, bool isFile,
+        const char* key, size_t keyLength, int* status) {
+    struct stat file;
+    if (isFile && stat(key, &file) != 0) {
+        fprintf(vm->err, "Could not open file \"%s\".\n", key);
+        *status = 74;
+        return NULL;
+    }
+
+    pthread_mutex_lock(&server->lock);
+    Cached** link = findCached(server, isFile, key, keyLength);
+    if (*link != NULL) {
+        if (!isFile || sameFile(&(*link)->file, &file)) {
+            Cached* cached = *link;
+            cached->users++;
+            cached->lastUsed = ++server->clock;
+            pthread_mutex_unlock(&server->lock);
+            return cached;
+        }
+        // The file has changed since
+        dropCached(server, link);
+    }
+    pthread_mutex_unlock(&server->lock);
+
+    Cached* cached = (Cached*)malloc(sizeof(Cached));
+    char* copy = cached == NULL ? NULL : (char*)malloc(keyLength + 1);
+    if (copy == NULL) {
+        free(cached);
+        fprintf(vm->err, "Out of memory.\n");
+        *status = 70;
+        return NULL;
+    }
+    memcpy(copy, key, keyLength);
+    copy[keyLength] = '\0';
+    cached->key = copy;
+    cached->keyLength = keyLength;
+    cached->isFile = isFile;
+    if (isFile) {
+        cached->file = file;
+    }
+
+    // Other requests will share the program, so it is compiled under the
+    // server's limit rather than this request's
+    size_t requestLimit = vm->heap.limit;
+    vm->heap.limit = server->options->heap.limit;
+    InterpretResult result;
+    if (isFile) {
+        FILE* source = fopen(key, "rb");
+        if (source == NULL) {
+            fprintf(vm->err, "Could not open file \"%s\".\n", key);
+            vm->heap.limit = requestLimit;
+            free(copy);
+            free(cached);
+            *status = 74;
+            return NULL;
+        }
+#ifdef CLOX_STREAMING_SOURCE
+        setvbuf(source, NULL, _IONBF, 0);
+        result = compileProgramFile(vm, &cached->program, source);
+#else
+        char* text = readSource(source);
+        if (text == NULL) {
+            fprintf(vm->err, "Could not read file \"%s\".\n", key);
+            fclose(source);
+            vm->heap.limit = requestLimit;
+            free(copy);
+            free(cached);
+            *status = 74;
+            return NULL;
+        }
+        result = compileProgram(vm, &cached->program, text);
+        free(text);
+#endif
+        fclose(source);
+    }
+    else {
+        result = compileProgram(vm, &cached->program, key);
+    }
+    vm->heap.limit = requestLimit;
+    if (result != INTERPRET_OK) {
+        free(copy);
+        free(cached);
+        *status = exitCode(result);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&server->lock);
+    link = findCached(server, isFile, key, keyLength);
+    if (*link != NULL && (!isFile || sameFile(&(*link)->file, &file))) {
+        // Another worker compiled it first
+        Cached* first = *link;
+        first->users++;
+        first->lastUsed = ++server->clock;
+        pthread_mutex_unlock(&server->lock);
+        freeCached(cached);
+        return first;
+    }
+    if (*link != NULL) {
+        dropCached(server, link);
+    }
+    evictCached(server);
+    link = findCached(server, isFile, key, keyLength);
+    cached->users = 1;
+    cached->dropped = false;
+    cached->lastUsed = ++server->clock;
+    cached->next = NULL;
+    *link = cached;
+    server->cached++;
+    pthread_mutex_unlock(&server->lock);
+    return cached;
+}
+
+static void releaseProgram(Server* server, Cached* cached) {
+    pthread_mutex_lock(&server->lock);
+    cached->users--;
+    bool unused = cached->dropped && cached->users == 0;
+    pthread_mutex_unlock(&server->lock);
+    if (unused) {
+        freeCached(cached);
+    }
+}
+
+// The lower of two limits, where 0 is no limit
+static uint64_t lowerLimit(uint64_t requested, uint64_t server) {
+    if (server == 0 || (requested != 0 && requested < server)) {
+        return requested;
+    }
+    return server;
+}
+
+// Runs the program named by key, or reports why it cannot be run
+// Returns the exit code for the request
+static int runRequest(Server* server, VM* vm, bool isFile, const char* key,
+        size_t keyLength) {
+    int status = 0;
+    Cached* cached = acquireProgram(server, vm, isFile, key, keyLength,
+        &status);
+    if (cached == NULL) {
+        return status;
+    }
+    InterpretResult result = runProgram(vm, &cached->program);
+    abandonProgram(vm, result);
+    status = exitCode(result);
+    // Globals can hold the program's strings until then
+    resetVM(vm);
+    releaseProgram(server, cached);
+    return status;
+}
+
+// Answers a single request
+// Returns false once the connection should be closed
+static bool handleRequest(Server* server, VM* vm, Reader* reader,
+        Reply* reply) {
+    char line[REQUEST_LINE];
+    if (!readLine(reader, line)) {
+        return false;
+    }
+
+    // %llu would also take a sign, and wrap a negative number around, so
+    // each number has to start with a digit
+    char kind[8];
+    unsigned long long instructions;
+    unsigned long long memory;
+    int instructionsStart = 0;
+    int memoryStart = 0;
+    int consumed = 0;
+    bool valid = sscanf(line, "%7s %n%llu %n%llu %n", kind,
+        &instructionsStart, &instructions, &memoryStart, &memory,
+        &consumed) == 3 && consumed > 0 && line[consumed] != '\0' &&
+        isdigit((unsigned char)line[instructionsStart]) &&
+        isdigit((unsigned char)line[memoryStart]);
+    bool isFile = valid && strcmp(kind, "file") == 0;
+    char* source = NULL;
+    size_t sourceLength = 0;
+    if (valid && !isFile) {
+        char* end;
+        unsigned long long length = strtoull(line + consumed, &end, 10);
+        valid = strcmp(kind, "source") == 0 && *end == '\0' &&
+            isdigit((unsigned char)line[consumed]) && length <= SOURCE_LIMIT;
+        if (valid) {
+            sourceLength = (size_t)length;
+            source = (char*)malloc(sourceLength + 1);
+            if (source == NULL || !readBytes(reader, source, sourceLength)) {
+                free(source);
+                return false;
+            }
+            source[sourceLength] = '\0';
+        }
+    }
+    if (!valid) {
+        const char* message = "Malformed request.\n";
+        sendFrame(reply, "err", message, strlen(message));
+        sendBytes(reply, "exit 64\n", 8);
+        return false;
+    }
+
+    vm->instructionLimit = lowerLimit(instructions,
+        server->options->instructionLimit);
+    // The worker's heap keeps what earlier requests grew, such as table and
+    // stack capacity, so the limit counts from what it holds now
+    size_t limit = (size_t)lowerLimit(memory, server->options->heap.limit);
+    vm->heap.limit = limit == 0 ? 0 : vm->heap.limitedBytes + limit;
+
+    char* errors = NULL;
+    size_t errorsSize = 0;
+    vm->err = open_memstream(&errors, &errorsSize);
+    if (vm->err == NULL) {
+        vm->err = stderr;
+    }
+    reply->length = 0;
+    int status = isFile ?
+        runRequest(server, vm, true, line + consumed, strlen(line + consumed)) :
+        runRequest(server, vm, false, source, sourceLength);
+    free(source);
+    flushOutput(reply);
+    if (vm->err != stderr) {
+        fclose(vm->err);
+        if (errorsSize > 0) {
+            sendFrame(reply, "err", errors, errorsSize);
+        }
+        free(errors);
+    }
+    vm->err = stderr;
+
+    char footer[16];
+    int footerLength = snprintf(footer, sizeof(footer), "exit %d\n", status);
+    sendBytes(reply, footer, (size_t)footerLength);
+    return !reply->failed;
+}
+
+// Answers connections one at a time with a VM of its own
+static void* runWorker(void* arg) {
+    Server* server = (Server*)arg;
+    VM vm;
+    initVM(&vm);
+#ifdef CLOX_PIPELINED_SCANNER
+    vm.pipelineThreshold = server->options->pipelineThreshold;
+#endif
+    Reader* reader = (Reader*)malloc(sizeof(Reader));
+    Reply* reply = (Reply*)malloc(sizeof(Reply));
+    if (reader == NULL || reply == NULL) {
+        fprintf(stderr, "Not enough memory to start a worker.\n");
+        free(reader);
+        free(reply);
+        freeVM(&vm);
+        return NULL;
+    }
+    vm.write = writeOutput;
+    vm.writeContext = reply;
+
+    while (true) {
+        int client = accept(server->listener, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break;
+        }
+        struct timeval timeout = {IDLE_TIMEOUT, 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+            sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+            sizeof(timeout));
+        reader->fd = client;
+        reader->start = 0;
+        reader->end = 0;
+        reply->fd = client;
+        reply->length = 0;
+        reply->failed = false;
+        while (handleRequest(server, &vm, reader, reply)) {
+            // Until the client is done
+        }
+        close(client);
+    }
+
+    free(reader);
+    free(reply);
+    freeVM(&vm);
+    return NULL;
+}
+
+// Listens on the socket at path with workers threads, until stopped by
+// SIGINT or SIGTERM. Requests are held to the limits set in options.
+// Returns an exit code if the server cannot start.
+int serve(const char* path, int workers, VM* options) {
+    struct sockaddr_un address;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path is too long: \"%s\".\n", path);
+        return 64;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    // A socket left by a server that was not stopped cleanly is replaced
+    struct stat existing;
+    if (stat(path, &existing) == 0 && S_ISSOCK(existing.st_mode)) {
+        unlink(path);
+    }
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 ||
+            bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+            listen(listener, 128) != 0) {
+        fprintf(stderr, "Could not listen on \"%s\": %s\n", path,
+            strerror(errno));
+        if (listener >= 0) {
+            close(listener);
+        }
+        return 74;
+    }
+
+    socketPath = path;
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &action, NULL);
+    action.sa_handler = stopServer;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    Server server;
+    server.listener = listener;
+    server.options = options;
+    pthread_mutex_init(&server.lock, NULL);
+    for (int i = 0; i < CACHE_BUCKETS; i++) {
+        server.buckets[i] = NULL;
+    }
+    server.cached = 0;
+    server.clock = 0;
+
+    // The calling thread is one of the workers
+    pthread_t* threads = (pthread_t*)malloc(
+        sizeof(pthread_t) * (size_t)workers);
+    int started = 0;
+    while (threads != NULL && started < workers - 1 &&
+            pthread_create(&threads[started], NULL, runWorker, &server) == 0) {
+        started++;
+    }
+    runWorker(&server);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+
+    for (int i = 0; i < CACHE_BUCKETS; i++) {
+        while (server.buckets[i] != NULL) {
+            dropCached(&server, &server.buckets[i]);
+        }
+    }
+    pthread_mutex_destroy(&server.lock);
+    close(listener);
+    unlink(path);
+    return 0;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,13 @@
+#ifndef clox_server_h
+#define clox_server_h
+
+#include "common.h"
+#include "vm.h"
+
+#ifdef CLOX_SERVE
+
+int serve(const char* path, int workers, VM* options);
+
+#endif
+
+#endif
\ No newline at end of file
@@ -5,10 +5,25 @@
 #define CLOX_LONG_CONSTANTS
 #define CLOX_LITTLE_ENDIAN
 #define CLOX_INTEGER_TYPE
+#define CLOX_BIG_INTEGERS
 #define CLOX_CONST_CACHE
 #define CLOX_CONST_KEYWORD
 #define CLOX_LONG_LOCALS
 #define CLOX_CUSTOM_ERROR_MESSAGE
+#define CLOX_FAST_NUMBER_PARSE
+#define CLOX_FAST_NUMBER_FORMAT
+#define CLOX_STREAMING_SOURCE
+#define CLOX_PIPELINED_SCANNER
+#define CLOX_PROFILE_OPS
+#define CLOX_SAMPLING_PROFILER
+#define CLOX_EXECUTION_TRACE
+#define CLOX_PERF_COUNTERS
+#define CLOX_TABLE_STATS
+#define CLOX_LIVE_STATS
+#define CLOX_PROBES
+#define CLOX_PARALLEL_JOBS
+#define CLOX_SERVE
+#define CLOX_SNAPSHOT
 
 // #define DEBUG_TRACE_EXECUTION
 // #define DEBUG_PRINT_CODE
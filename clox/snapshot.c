@@ -0,0 +1,468 @@
+// For fstat and mmap
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+#include "memory.h"
+#include "object.h"
+#include "table.h"
+
+#ifdef CLOX_SNAPSHOT
+
+// An image is laid out as
+//   ImageHeader
+//   ObjString[stringCount]   with chars holding offsets into the image
+//   the characters of every string, each terminated
+//   the entries of each table, whose objects are offsets of strings
+// Offsets are from the start of the image, which is mapped privately and
+// relocated by adding its address. Only the string headers are written to,
+// so the characters stay shared with the page cache.
+
+#define IMAGE_MAGIC "CLOXIMG"
+#define IMAGE_VERSION 1
+
+#define IMAGE_INTEGERS 1
+#define IMAGE_CONSTS 2
+
+#ifdef CLOX_INTEGER_TYPE
+#define IMAGE_FEATURE_INTEGERS IMAGE_INTEGERS
+#else
+#define IMAGE_FEATURE_INTEGERS 0
+#endif
+#ifdef CLOX_CONST_KEYWORD
+#define IMAGE_FEATURE_CONSTS IMAGE_CONSTS
+#else
+#define IMAGE_FEATURE_CONSTS 0
+#endif
+#define IMAGE_FEATURES (IMAGE_FEATURE_INTEGERS | IMAGE_FEATURE_CONSTS)
+
+#define IMAGE_ALIGN(size) (((size) + 7) & ~(size_t)7)
+
+typedef enum {
+    IMAGE_GLOBALS,
+    IMAGE_CONST_GLOBALS,
+    IMAGE_STRINGS,
+    IMAGE_TABLE_COUNT
+} ImageTableKind;
+
+typedef struct {
+    // Offset of capacity entries, or 0 if there are none
+    uint64_t entries;
+    uint64_t capacity;
+    uint64_t count;
+    uint64_t capacityCount;
+} ImageTable;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t features;
+    // Sizes that differ between builds
+    uint32_t valueSize;
+    uint32_t stringSize;
+    uint64_t size;
+    uint64_t strings;
+    uint64_t stringCount;
+    ImageTable tables[IMAGE_TABLE_COUNT];
+} ImageHeader;
+
+// The VM's table saved as kind, or NULL if this build has none
+static Table* vmTable(VM* vm, int kind) {
+    switch (kind) {
+        case IMAGE_GLOBALS: return &vm->globals;
+#ifdef CLOX_CONST_KEYWORD
+        case IMAGE_CONST_GLOBALS: return &vm->constGlobals;
+#endif
+        case IMAGE_STRINGS: return &vm->strings;
+    }
+    return NULL;
+}
+
+// Adds value to index if it is a string with contents not already there
+// Returns false for failed allocation
+static bool indexString(Table* index, Value value) {
+    Value unused;
+    if (!IS_STRING(value) || tableGet(index, value, &unused)) {
+        return true;
+    }
+    return tableSet(index, value, NIL_VAL) >= 0;
+}
+
+// Offsets are kept in the index as numbers, which are exact up to 2^53
+static Value imageValue(Table* index, Value value) {
+    Value offset;
+    if (!IS_OBJ(value) || !tableGet(index, value, &offset)) {
+        return value;
+    }
+    return OBJ_VAL((Obj*)(uintptr_t)AS_FLOAT(offset));
+}
+
+static void writeTable(Table* index, Table* table, Entry* saved) {
+    for (size_t i = 0; i < table->capacity; i++) {
+        Entry* entry = &table->entries[i];
+        if (entry->present) {
+            saved[i].present = true;
+            saved[i].key = imageValue(index, entry->key);
+            saved[i].value = imageValue(index, entry->value);
+        }
+        else {
+            // Empty, or a tombstone
+            saved[i].present = false;
+            saved[i].key = NIL_VAL;
+            saved[i].value = IS_NIL(entry->value) ? NIL_VAL : BOOL_VAL(true);
+        }
+    }
+}
+
+// Lays out and fills the image of the VM's tables
+// Returns NULL for failed allocation
+static char* buildImage(VM* vm, Table* index, size_t* size) {
+    // Every string that can be reached, once for each contents
+    for (int kind = 0; kind < IMAGE_TABLE_COUNT; kind++) {
+        Table* table = vmTable(vm, kind);
+        for (size_t i = 0; table != NULL && i < table->capacity; i++) {
+            Entry* entry = &table->entries[i];
+            if (entry->present && (!indexString(index, entry->key) ||
+                    !indexString(index, entry->value))) {
+                return NULL;
+            }
+        }
+    }
+
+    size_t strings = IMAGE_ALIGN(sizeof(ImageHeader));
+    size_t offset = strings + index->count * sizeof(ObjString);
+    size_t chars = offset;
+    size_t next = strings;
+    for (size_t i = 0; i < index->capacity; i++) {
+        Entry* entry = &index->entries[i];
+        if (entry->present) {
+            entry->value = FLOAT_VAL((double)next);
+            next += sizeof(ObjString);
+            offset += (size_t)AS_STRING(entry->key)->length + 1;
+        }
+    }
+    ImageTable tables[IMAGE_TABLE_COUNT];
+    for (int kind = 0; kind < IMAGE_TABLE_COUNT; kind++) {
+        Table* table = vmTable(vm, kind);
+        memset(&tables[kind], 0, sizeof(ImageTable));
+        if (table != NULL && table->capacity > 0) {
+            offset = IMAGE_ALIGN(offset);
+            tables[kind].entries = offset;
+            tables[kind].capacity = table->capacity;
+            tables[kind].count = table->count;
+            tables[kind].capacityCount = table->capacityCount;
+            offset += table->capacity * sizeof(Entry);
+        }
+    }
+
+    char* image = (char*)calloc(1, offset);
+    if (image == NULL) {
+        return NULL;
+    }
+    ImageHeader* header = (ImageHeader*)image;
+    memcpy(header->magic, IMAGE_MAGIC, sizeof(header->magic));
+    header->version = IMAGE_VERSION;
+    header->features = IMAGE_FEATURES;
+    header->valueSize = (uint32_t)sizeof(Value);
+    header->stringSize = (uint32_t)sizeof(ObjString);
+    header->size = offset;
+    header->strings = strings;
+    header->stringCount = index->count;
+    memcpy(header->tables, tables, sizeof(tables));
+
+    for (size_t i = 0; i < index->capacity; i++) {
+        Entry* entry = &index->entries[i];
+        if (!entry->present) {
+            continue;
+        }
+        ObjString* string = AS_STRING(entry->key);
+        ObjString* saved =
+            (ObjString*)(image + (size_t)AS_FLOAT(entry->value));
+        saved->obj.type = OBJ_STRING;
+        saved->obj.next = NULL;
+        saved->length = string->length;
+        saved->chars = (char*)(uintptr_t)chars;
+        saved->hash = string->hash;
+        memcpy(image + chars, string->chars, (size_t)string->length);
+        chars += (size_t)string->length + 1;
+    }
+    for (int kind = 0; kind < IMAGE_TABLE_COUNT; kind++) {
+        if (tables[kind].capacity > 0) {
+            writeTable(index, vmTable(vm, kind),
+                (Entry*)(image + tables[kind].entries));
+        }
+    }
+    *size = offset;
+    return image;
+}
+
+// Writes the image to a new file that replaces path once complete, so that
+// processes which have the old one mapped are not cut short
+static bool writeImage(const char* path, const char* image, size_t size) {
+    size_t length = strlen(path);
+    char* temporary = (char*)malloc(length + 5);
+    if (temporary == NULL) {
+        return false;
+    }
+    memcpy(temporary, path, length);
+    memcpy(temporary + length, ".tmp", 5);
+
+    bool written = false;
+    FILE* file = fopen(temporary, "wb");
+    if (file != NULL) {
+        written = fwrite(image, 1, size, file) == size;
+        written = fclose(file) == 0 && written;
+        written = written && rename(temporary, path) == 0;
+        if (!written) {
+            remove(temporary);
+        }
+    }
+    free(temporary);
+    return written;
+}
+
+#ifdef CLOX_BIG_INTEGERS
+// Images only have room for strings among objects
+static bool holdsBigInt(VM* vm) {
+    for (int kind = 0; kind < IMAGE_TABLE_COUNT; kind++) {
+        Table* table = vmTable(vm, kind);
+        for (size_t i = 0; table != NULL && i < table->capacity; i++) {
+            Entry* entry = &table->entries[i];
+            if (entry->present && IS_BIGINT(entry->value)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+#endif
+
+// Saves what scripts have defined in the VM to an image at path
+// Returns false after writing why to vm->err
+bool saveSnapshot(VM* vm, const char* path) {
+    useHeap(&vm->heap);
+#ifdef CLOX_BIG_INTEGERS
+    if (holdsBigInt(vm)) {
+        fprintf(vm->err, "Snapshots cannot hold big integers.\n");
+        return false;
+    }
+#endif
+    Table index;
+    initTable(&index);
+    size_t size = 0;
+    char* image = buildImage(vm, &index, &size);
+    freeTable(&index);
+    if (image == NULL) {
+        fprintf(vm->err, "Not enough memory to save a snapshot.\n");
+        return false;
+    }
+    bool written = writeImage(path, image, size);
+    free(image);
+    if (!written) {
+        fprintf(vm->err, "Could not write file \"%s\".\n", path);
+    }
+    return written;
+}
+
+static bool validHeader(ImageHeader* header, size_t size) {
+    if (memcmp(header->magic, IMAGE_MAGIC, sizeof(header->magic)) != 0 ||
+            header->version != IMAGE_VERSION ||
+            header->features != IMAGE_FEATURES ||
+            header->valueSize != sizeof(Value) ||
+            header->stringSize != sizeof(ObjString) ||
+            header->size != size || header->strings > size ||
+            header->stringCount >
+                (size - header->strings) / sizeof(ObjString)) {
+        return false;
+    }
+    for (int kind = 0; kind < IMAGE_TABLE_COUNT; kind++) {
+        ImageTable* table = &header->tables[kind];
+        if (table->capacity == 0) {
+            continue;
+        }
+        if (table->entries % sizeof(uint64_t) != 0 || table->entries > size ||
+                table->capacity > (size - table->entries) / sizeof(Entry)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Points the strings' characters into the image
+static bool relocateStrings(char* image, ImageHeader* header) {
+    ObjString* strings = (ObjString*)(image + header->strings);
+    for (size_t i = 0; i < header->stringCount; i++) {
+        ObjString* string = &strings[i];
+        size_t chars = (size_t)(uintptr_t)string->chars;
+        if (string->obj.type != OBJ_STRING || string->length < 0 ||
+                chars >= header->size ||
+                (size_t)string->length >= header->size - chars ||
+                image[chars + (size_t)string->length] != '\0') {
+            return false;
+        }
+        string->obj.next = NULL;
+        string->chars = image + chars;
+    }
+    return true;
+}
+
+// Whether a bool read from an image holds one of the two values it can
+static bool validBool(bool* value) {
+    unsigned char byte;
+    memcpy(&byte, value, 1);
+    return byte <= 1;
+}
+
+// Whether a value read from an image is of a type this build has
+static bool validValue(Value* value) {
+    switch (value->type) {
+        case VAL_NIL:
+        case VAL_FLOAT:
+        case VAL_OBJ:
+#ifdef CLOX_INTEGER_TYPE
+        case VAL_INT:
+#endif
+            return true;
+        case VAL_BOOL:
+            return validBool(&value->as.vbool);
+    }
+    return false;
+}
+
+// Replaces an object's offset with its address, as long as it is one of
+// the image's strings
+static bool relocateValue(char* image, ImageHeader* header, Value* value) {
+    if (!IS_OBJ(*value)) {
+        return true;
+    }
+    size_t offset = (size_t)(uintptr_t)AS_OBJ(*value);
+    if (offset < header->strings ||
+            (offset - header->strings) % sizeof(ObjString) != 0 ||
+            (offset - header->strings) / sizeof(ObjString) >=
+                header->stringCount) {
+        return false;
+    }
+    ObjString* string = (ObjString*)(image + offset);
+    *value = OBJ_VAL(string);
+    return true;
+}
+
+// Copies a table out of the image, relocating it on the way, so that the
+// VM can grow and free it as its own
+static bool restoreTable(VM* vm, char* image, ImageHeader* header, int kind,
+        bool* outOfMemory) {
+    ImageTable* saved = &header->tables[kind];
+    Table* table = vmTable(vm, kind);
+    if (saved->capacity == 0) {
+        return saved->count == 0;
+    }
+    if (table == NULL) {
+        return false;
+    }
+    Entry* entries = ALLOCATE(Entry, saved->capacity, false, MEM_TABLES);
+    if (entries == NULL) {
+        *outOfMemory = true;
+        return false;
+    }
+    memcpy(entries, image + saved->entries,
+        (size_t)saved->capacity * sizeof(Entry));
+
+    // Lookups only end at an empty entry, so the counts are checked too
+    size_t count = 0;
+    size_t used = 0;
+    bool valid = true;
+    for (size_t i = 0; valid && i < saved->capacity; i++) {
+        Entry* entry = &entries[i];
+        if (!validBool(&entry->present) || !validValue(&entry->key) ||
+                !validValue(&entry->value)) {
+            valid = false;
+        }
+        else if (entry->present) {
+            count++;
+            used++;
+            valid = relocateValue(image, header, &entry->key) &&
+                relocateValue(image, header, &entry->value);
+        }
+        else if (!IS_NIL(entry->value)) {
+            // A tombstone
+            used++;
+            valid = !IS_OBJ(entry->value);
+        }
+    }
+    if (!valid || count != saved->count || used != saved->capacityCount ||
+            used >= saved->capacity) {
+        FREE_ARRAY(Entry, entries, saved->capacity, MEM_TABLES);
+        return false;
+    }
+
+    freeTable(table);
+    table->entries = entries;
+    table->capacity = (size_t)saved->capacity;
+    table->count = count;
+    table->capacityCount = used;
+    return true;
+}
+
+// Forgets everything scripts have defined in the VM, then starts it from
+// the image at path as if the scripts that made it had run
+// Returns false after writing why to vm->err, leaving the VM reset
+bool loadSnapshot(VM* vm, const char* path) {
+    resetVM(vm);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(vm->err, "Could not open file \"%s\".\n", path);
+        return false;
+    }
+    struct stat info;
+    void* mapping = MAP_FAILED;
+    size_t size = 0;
+    if (fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(ImageHeader)) {
+        size = (size_t)info.st_size;
+        mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        fprintf(vm->err, "Could not read snapshot \"%s\".\n", path);
+        return false;
+    }
+
+    vm->snapshot = mapping;
+    vm->snapshotSize = size;
+    char* image = (char*)mapping;
+    ImageHeader* header = (ImageHeader*)image;
+    bool outOfMemory = false;
+    bool restored = validHeader(header, size) &&
+        relocateStrings(image, header);
+    for (int kind = 0; restored && kind < IMAGE_TABLE_COUNT; kind++) {
+        restored = restoreTable(vm, image, header, kind, &outOfMemory);
+    }
+    if (!restored) {
+        resetVM(vm);
+        if (outOfMemory) {
+            fprintf(vm->err, "Not enough memory to load a snapshot.\n");
+        }
+        else {
+            fprintf(vm->err, "\"%s\" is not a snapshot for this build.\n",
+                path);
+        }
+    }
+    return restored;
+}
+
+// Unmaps the VM's snapshot once nothing refers to its strings any more
+void releaseSnapshot(VM* vm) {
+    if (vm->snapshot != NULL) {
+        munmap(vm->snapshot, vm->snapshotSize);
+        vm->snapshot = NULL;
+        vm->snapshotSize = 0;
+    }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,19 @@
+#ifndef clox_snapshot_h
+#define clox_snapshot_h
+
+#include "common.h"
+#include "vm.h"
+
+#ifdef CLOX_SNAPSHOT
+
+// Images of the globals, consts and interned strings scripts have defined
+// in a VM, which another VM can start from instead of running the scripts
+// again. An image only loads into a build with the same layout of values.
+
+bool saveSnapshot(VM* vm, const char* path);
+bool loadSnapshot(VM* vm, const char* path);
+void releaseSnapshot(VM* vm);
+
+#endif
+
+#endif
\ No newline at end of file
@@ -1,10 +1,14 @@
+#define _POSIX_C_SOURCE 199309L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "table.h"
 #include "memory.h"
 #include "object.h"
+#include "probes.h"
 #include "value.h"
 
 #define TABLE_MAX_LOAD 0.75
@@ -14,18 +18,82 @@ void initTable(Table* table) {
     table->capacityCount = 0;
     table->capacity = 0;
     table->entries = NULL;
+#ifdef CLOX_TABLE_STATS
+    table->stats = NULL;
+#endif
 }
 
 void freeTable(Table* table) {
-    FREE_ARRAY(Entry, table->entries, table->capacity);
+    FREE_ARRAY(Entry, table->entries, table->capacity, MEM_TABLES);
+#ifdef CLOX_TABLE_STATS
+    TableStats* stats = table->stats;
+    initTable(table);
+    table->stats = stats;
+#else
     initTable(table);
+#endif
 }
 
-static Entry* findEntry(Entry* entries, size_t capacity, Value key) {
+#ifdef CLOX_TABLE_STATS
+static uint64_t readNanos(void) {
+#ifdef PLATFORM_UNIX
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+#else
+    return (uint64_t)clock() * (1000000000u / CLOCKS_PER_SEC);
+#endif
+}
+
+// Records a lookup that looked at probes entries
+static void countLookup(Table* table, size_t probes, bool hit) {
+    TableStats* stats = table->stats;
+    if (stats == NULL) {
+        return;
+    }
+    stats->lookups++;
+    if (hit) {
+        stats->hits++;
+    }
+    else {
+        stats->misses++;
+    }
+    if (probes > 0) {
+        stats->probes += probes;
+        int bucket = 0;
+        for (size_t rest = probes - 1; rest > 0; rest >>= 1) {
+            bucket++;
+        }
+        if (bucket >= TABLE_PROBE_BUCKETS) {
+            bucket = TABLE_PROBE_BUCKETS - 1;
+        }
+        stats->probeLengths[bucket]++;
+    }
+}
+
+// Records the shape of the table after it changed
+static void countShape(Table* table) {
+    TableStats* stats = table->stats;
+    if (stats != NULL) {
+        stats->count = table->count;
+        stats->tombstones = table->capacityCount - table->count;
+        stats->capacity = table->capacity;
+    }
+}
+#else
+#define countLookup(table, probes, hit) ((void)(probes))
+#define countShape(table) ((void)(table))
+#endif
+
+// Sets probes to the number of entries looked at
+static inline Entry* findEntry(Entry* entries, size_t capacity, Value key,
+        size_t* probes) {
     size_t index = hashValue(key) % capacity;
     Entry* tombstone = NULL;
+    *probes = 0;
     while (true) {
         Entry* entry = &entries[index];
+        (*probes)++;
         if (!entry->present) {
             if (IS_NIL(entry->value)) {
                 return tombstone != NULL ? tombstone : entry;
@@ -43,13 +111,40 @@ static Entry* findEntry(Entry* entries, size_t capacity, Value key) {
     }
 }
 
-// Return false if not found, true if found
-bool tableGet(Table* table, Value key, Value* value) {
+// Each lookup below is written once with a counted flag and called with
+// a constant, so tables without stats get a copy that never counts, as
+// run.h does for dispatch
+#ifdef CLOX_TABLE_STATS
+#define COUNTED_VARIANT(call, ...) \
+    (table->stats != NULL ? call(__VA_ARGS__, true) : call(__VA_ARGS__, false))
+#else
+#define COUNTED_VARIANT(call, ...) call(__VA_ARGS__, false)
+#endif
+
+#define COUNT_LOOKUP(probes, hit) \
+    do { \
+        if (counted) { \
+            countLookup(table, (probes), (hit)); \
+        } \
+    } while (false)
+
+#define COUNT_SHAPE() \
+    do { \
+        if (counted) { \
+            countShape(table); \
+        } \
+    } while (false)
+
+static inline bool getEntry(Table* table, Value key, Value* value,
+        bool counted) {
     if (table->count == 0) {
+        COUNT_LOOKUP(0, false);
         return false;
     }
 
-    Entry* entry = findEntry(table->entries, table->capacity, key);
+    size_t probes;
+    Entry* entry = findEntry(table->entries, table->capacity, key, &probes);
+    COUNT_LOOKUP(probes, entry->present);
     if (!entry->present) {
         return false;
     }
@@ -59,12 +154,19 @@ bool tableGet(Table* table, Value key, Value* value) {
 }
 
 // Return false if not found, true if found
-bool tableDelete(Table* table, Value key) {
+bool tableGet(Table* table, Value key, Value* value) {
+    return COUNTED_VARIANT(getEntry, table, key, value);
+}
+
+static inline bool deleteEntry(Table* table, Value key, bool counted) {
     if (table->count == 0) {
+        COUNT_LOOKUP(0, false);
         return false;
     }
 
-    Entry* entry = findEntry(table->entries, table->capacity, key);
+    size_t probes;
+    Entry* entry = findEntry(table->entries, table->capacity, key, &probes);
+    COUNT_LOOKUP(probes, entry->present);
 
     if (!entry->present) {
         return false;
@@ -75,31 +177,55 @@ bool tableDelete(Table* table, Value key) {
     entry->present = false;
     entry->key = NIL_VAL;
     entry->value = BOOL_VAL(true);
+    COUNT_SHAPE();
     return true;
 }
 
-void tableAddAll(Table* src, Table* dest) {
+// Return false if not found, true if found
+bool tableDelete(Table* table, Value key) {
+    return COUNTED_VARIANT(deleteEntry, table, key);
+}
+
+// Returns -1 for failed allocation, 0 otherwise
+int tableAddAll(Table* src, Table* dest) {
     for (size_t i = 0; i < src->capacity; i++) {
         Entry* entry = &src->entries[i];
         if (entry->present) {
-            tableSet(dest, entry->key, entry->value);
+            ERROR_GUARD(tableSet(dest, entry->key, entry->value));
         }
     }
+    return 0;
 }
 
-ObjString* tableFindString(Table* table, const char* chars, int length,
-        uint32_t hash) {
+// Removes every entry, keeping the entries allocated for reuse
+void tableClear(Table* table) {
+    for (size_t i = 0; i < table->capacity; i++) {
+        table->entries[i].present = false;
+        table->entries[i].key = NIL_VAL;
+        table->entries[i].value = NIL_VAL;
+    }
+    table->count = 0;
+    table->capacityCount = 0;
+    countShape(table);
+}
+
+static inline ObjString* findString(Table* table, const char* chars,
+        int length, uint32_t hash, bool counted) {
     if (table->count == 0) {
+        COUNT_LOOKUP(0, false);
         return NULL;
     }
 
     size_t index = hash % table->capacity;
+    size_t probes = 0;
 
     while (true) {
         Entry* entry = &table->entries[index];
+        probes++;
 
         if (!entry->present) {
             if(IS_NIL(entry->value)) {
+                COUNT_LOOKUP(probes, false);
                 return NULL;
             }
         }
@@ -109,6 +235,7 @@ ObjString* tableFindString(Table* table, const char* chars, int length,
             if (string->length == length &&
                     string->hash == hash &&
                     memcmp(string->chars, chars, (size_t) length) == 0) {
+                COUNT_LOOKUP(probes, true);
                 return string;
             }
         } 
@@ -117,11 +244,19 @@ ObjString* tableFindString(Table* table, const char* chars, int length,
     }
 }
 
-static void adjustCapacity(Table* table, size_t capacity) {
-    Entry* entries = ALLOCATE(Entry, capacity, false);
+ObjString* tableFindString(Table* table, const char* chars, int length,
+        uint32_t hash) {
+    return COUNTED_VARIANT(findString, table, chars, length, hash);
+}
+
+// Returns false for failed allocation, leaving the table as it was
+static bool adjustCapacity(Table* table, size_t capacity) {
+#ifdef CLOX_TABLE_STATS
+    uint64_t start = table->stats != NULL ? readNanos() : 0;
+#endif
+    Entry* entries = ALLOCATE(Entry, capacity, false, MEM_TABLES);
     if (entries == NULL) {
-        // TODO out of memory
-        return;
+        return false;
     }
     for (size_t i = 0; i < capacity; i++) {
         entries[i].present = false;
@@ -136,7 +271,8 @@ static void adjustCapacity(Table* table, size_t capacity) {
         if (!entry->present) {
             continue;
         }
-        Entry* dest = findEntry(entries, capacity, entry->key);
+        size_t probes;
+        Entry* dest = findEntry(entries, capacity, entry->key, &probes);
         dest->present = true;
         dest->key = entry->key;
         dest->value = entry->value;
@@ -144,25 +280,36 @@ static void adjustCapacity(Table* table, size_t capacity) {
         table->capacityCount++;
     }
 
-    FREE_ARRAY(Entry, table->entries, table->capacity);
+    FREE_ARRAY(Entry, table->entries, table->capacity, MEM_TABLES);
+    PROBE3(table__resize, table->capacity, capacity, table->count);
     table->entries = entries;
     table->capacity = capacity;
+#ifdef CLOX_TABLE_STATS
+    if (table->stats != NULL) {
+        table->stats->resizes++;
+        table->stats->resizeNanos += readNanos() - start;
+    }
+#endif
+    return true;
 }
 
-// Return true if not found (i.e. is new key), false if found
-bool tableSet(Table* table, Value key, Value value) {
+static inline int setEntry(Table* table, Value key, Value value,
+        bool counted) {
     if (table->capacityCount + 1 > (size_t)
             ((double)table->capacity * TABLE_MAX_LOAD)) {
         if (table->capacity > SIZE_MAX / GROW_CAPACITY_RATIO) {
             // Hash table out of memory
-            // TODO handle error case
-            exit(100);
+            return -1;
         }
         size_t capacity = GROW_CAPACITY(table->capacity);
-        adjustCapacity(table, capacity);
+        if (!adjustCapacity(table, capacity)) {
+            return -1;
+        }
     }
 
-    Entry* entry = findEntry(table->entries, table->capacity, key);
+    size_t probes;
+    Entry* entry = findEntry(table->entries, table->capacity, key, &probes);
+    COUNT_LOOKUP(probes, entry->present);
 
     bool isNewKey = !entry->present;
     if (isNewKey) {
@@ -176,8 +323,15 @@ bool tableSet(Table* table, Value key, Value value) {
     entry->present = true;
     entry->key = key;
     entry->value = value;
+    COUNT_SHAPE();
     
-    return isNewKey;
+    return isNewKey ? 1 : 0;
+}
+
+// Returns 1 if not found (i.e. is new key), 0 if found
+// Returns -1 for failed allocation, in which case the table is unchanged
+int tableSet(Table* table, Value key, Value value) {
+    return COUNTED_VARIANT(setEntry, table, key, value);
 }
 
 void tablePrint(Table* table) {
@@ -202,4 +356,67 @@ void tablePrint(Table* table) {
 
 size_t tableSize(Table* table) {
     return table->count;
-}
\ No newline at end of file
+}
+
+#ifdef CLOX_TABLE_STATS
+void initTableStats(TableStats* stats, const char* name) {
+    memset(stats, 0, sizeof(TableStats));
+    stats->name = name;
+}
+
+// Prints a row of counters for each of count stats, then their probe
+// length histograms. Stats without a name are skipped.
+void printTableStats(TableStats* stats, size_t count, FILE* file) {
+    fprintf(file, "%-14s %12s %12s %12s %9s %8s %12s %9s %9s %10s\n",
+        "table", "lookups", "hits", "misses", "avg probe", "resizes",
+        "resize ns", "count", "capacity", "tombstones");
+    for (size_t i = 0; i < count; i++) {
+        TableStats* table = &stats[i];
+        if (table->name == NULL) {
+            continue;
+        }
+        double perLookup = table->lookups == 0 ? 0.0 :
+            (double)table->probes / (double)table->lookups;
+        double tombstones = table->capacity == 0 ? 0.0 :
+            100.0 * (double)table->tombstones / (double)table->capacity;
+        fprintf(file, "%-14s %12llu %12llu %12llu %9.2f %8llu %12llu %9"
+            FORMAT_SIZE_T " %9" FORMAT_SIZE_T " %9.1f%%\n", table->name,
+            (unsigned long long)table->lookups,
+            (unsigned long long)table->hits,
+            (unsigned long long)table->misses, perLookup,
+            (unsigned long long)table->resizes,
+            (unsigned long long)table->resizeNanos,
+            table->count, table->capacity, tombstones);
+    }
+
+    fprintf(file, "\n%-14s", "probe length");
+    for (int bucket = 0; bucket < TABLE_PROBE_BUCKETS; bucket++) {
+        char label[16];
+        size_t low = bucket == 0 ? 1 : ((size_t)1 << (bucket - 1)) + 1;
+        size_t high = (size_t)1 << bucket;
+        if (bucket == TABLE_PROBE_BUCKETS - 1) {
+            snprintf(label, sizeof(label), "%" FORMAT_SIZE_T "+", low);
+        }
+        else if (low == high) {
+            snprintf(label, sizeof(label), "%" FORMAT_SIZE_T, low);
+        }
+        else {
+            snprintf(label, sizeof(label), "%" FORMAT_SIZE_T "-%"
+                FORMAT_SIZE_T, low, high);
+        }
+        fprintf(file, " %10s", label);
+    }
+    fprintf(file, "\n");
+    for (size_t i = 0; i < count; i++) {
+        if (stats[i].name == NULL) {
+            continue;
+        }
+        fprintf(file, "%-14s", stats[i].name);
+        for (int bucket = 0; bucket < TABLE_PROBE_BUCKETS; bucket++) {
+            fprintf(file, " %10llu",
+                (unsigned long long)stats[i].probeLengths[bucket]);
+        }
+        fprintf(file, "\n");
+    }
+}
+#endif
\ No newline at end of file
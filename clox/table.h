@@ -1,6 +1,8 @@
 #ifndef clox_table_h
 #define clox_table_h
 
+#include <stdio.h>
+
 #include "common.h"
 #include "value.h"
 
@@ -15,6 +17,30 @@ typedef struct {
     Value value;
 } Entry;
 
+#ifdef CLOX_TABLE_STATS
+// Probe lengths are counted in buckets of 1, 2, 3-4, 5-8, ... and the last
+// bucket holds everything longer
+#define TABLE_PROBE_BUCKETS 8
+
+// What one or more tables have been through, to tell how well keys hash
+// and how full the tables run
+typedef struct {
+    const char* name;
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t misses;
+    // Entries looked at to answer each lookup
+    uint64_t probes;
+    uint64_t probeLengths[TABLE_PROBE_BUCKETS];
+    uint64_t resizes;
+    uint64_t resizeNanos;
+    // Shape of the table after it last changed
+    size_t count;
+    size_t tombstones;
+    size_t capacity;
+} TableStats;
+#endif
+
 typedef struct {
     // Internal count for capacity purposes
     size_t capacityCount;
@@ -24,17 +50,27 @@ typedef struct {
     size_t capacity;
     // Array of entries (size is equal to capacity)
     Entry* entries;
+#ifdef CLOX_TABLE_STATS
+    // Lookups and resizes are counted here when not NULL. Kept when the
+    // table is freed.
+    TableStats* stats;
+#endif
 } Table;
 
 void initTable(Table* table);
 void freeTable(Table* table);
 bool tableGet(Table* table, Value key, Value* value);
-bool tableSet(Table* table, Value key, Value value);
+int tableSet(Table* table, Value key, Value value);
 bool tableDelete(Table* table, Value key);
-void tableAddAll(Table* src, Table* dest);
+int tableAddAll(Table* src, Table* dest);
+void tableClear(Table* table);
 ObjString* tableFindString(Table* table, const char* chars,
     int length, uint32_t hash);
 void tablePrint(Table* table);
 size_t tableSize(Table* table);
+#ifdef CLOX_TABLE_STATS
+void initTableStats(TableStats* stats, const char* name);
+void printTableStats(TableStats* stats, size_t count, FILE* file);
+#endif
 
 #endif
\ No newline at end of file
@@ -0,0 +1,302 @@
+// Exercises the interface in clox.h the way a host program would, linked
+// against libclox.a. Run by "make api-test", which exits non-zero if any
+// check fails.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clox.h"
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "api_test.c:%d: check failed: %s\n", __LINE__, \
+                #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+// Collects what print statements write
+typedef struct {
+    char text[256];
+    size_t length;
+} Output;
+
+static void collect(void* context, const char* text, size_t length) {
+    Output* output = (Output*)context;
+    if (length > sizeof(output->text) - 1 - output->length) {
+        length = sizeof(output->text) - 1 - output->length;
+    }
+    memcpy(output->text + output->length, text, length);
+    output->length += length;
+    output->text[output->length] = '\0';
+}
+
+static void clearOutput(Output* output) {
+    output->length = 0;
+    output->text[0] = '\0';
+}
+
+static void testCompile(FILE* errors) {
+    CloxVM* vm = cloxNewVM();
+    CHECK(vm != NULL);
+    cloxSetErrorFile(vm, errors);
+    Output output;
+    clearOutput(&output);
+    cloxSetOutput(vm, collect, &output);
+
+    CloxScript* script = cloxCompile(vm, "print 1 + 2;");
+    CHECK(script != NULL);
+    // Compiling runs nothing
+    CHECK(output.length == 0);
+    CHECK(cloxRun(vm, script) == CLOX_OK);
+    CHECK(strcmp(output.text, "3\n") == 0);
+    cloxFreeScript(script);
+
+    CHECK(cloxCompile(vm, "print ;") == NULL);
+    CHECK(cloxInterpret(vm, "var = 1;") == CLOX_COMPILE_ERROR);
+    CHECK(cloxInterpret(vm, "print -nil;") == CLOX_RUNTIME_ERROR);
+    cloxFreeVM(vm);
+}
+
+// One compiled script run many times, on two VMs, each keeping its own
+// globals
+static void testRunMany(void) {
+    CloxVM* first = cloxNewVM();
+    CloxVM* second = cloxNewVM();
+    CHECK(first != NULL && second != NULL);
+    Output output;
+    clearOutput(&output);
+    cloxSetOutput(first, collect, &output);
+    cloxSetOutput(second, collect, &output);
+
+    CloxScript* script = cloxCompile(first, "count = count + 1;");
+    CHECK(script != NULL);
+    CHECK(cloxInterpret(first, "var count = 0;") == CLOX_OK);
+    CHECK(cloxInterpret(second, "var count = 100;") == CLOX_OK);
+    for (int i = 0; i < 50; i++) {
+        CHECK(cloxRun(first, script) == CLOX_OK);
+        CHECK(cloxRun(second, script) == CLOX_OK);
+    }
+    CHECK(cloxInterpret(first, "print count;") == CLOX_OK);
+    CHECK(cloxInterpret(second, "print count;") == CLOX_OK);
+    CHECK(strcmp(output.text, "50\n150\n") == 0);
+
+    // Resetting forgets the globals, but the script can still be run
+    cloxResetVM(first);
+    CHECK(cloxInterpret(first, "var count = 7;") == CLOX_OK);
+    CHECK(cloxRun(first, script) == CLOX_OK);
+    CloxValue value;
+    CHECK(cloxGetGlobal(first, "count", &value));
+    CHECK(value.type == CLOX_INTEGER && value.as.integer == 8);
+
+    cloxFreeVM(first);
+    cloxFreeVM(second);
+    cloxFreeScript(script);
+}
+
+static void testGlobals(FILE* errors) {
+    CloxVM* vm = cloxNewVM();
+    CHECK(vm != NULL);
+    cloxSetErrorFile(vm, errors);
+    Output output;
+    clearOutput(&output);
+    cloxSetOutput(vm, collect, &output);
+
+    CloxValue value;
+    value.type = CLOX_INTEGER;
+    value.as.integer = 40;
+    CHECK(cloxSetGlobal(vm, "answer", value));
+    value.type = CLOX_STRING;
+    value.as.string.chars = "host";
+    value.as.string.length = 4;
+    CHECK(cloxSetGlobal(vm, "name", value));
+    value.type = CLOX_BOOL;
+    value.as.boolean = true;
+    CHECK(cloxSetGlobal(vm, "flag", value));
+    CHECK(cloxInterpret(vm,
+        "answer = answer + 2;\n"
+        "var greeting = \"hello \" + name;\n"
+        "var half = answer / 4.0;\n"
+        "var huge = 9223372036854775807 + 1;\n"
+        "var nothing = nil;\n"
+        "print flag;\n") == CLOX_OK);
+    CHECK(strcmp(output.text, "true\n") == 0);
+
+    CHECK(cloxGetGlobal(vm, "answer", &value));
+    CHECK(value.type == CLOX_INTEGER && value.as.integer == 42);
+    CHECK(cloxGetGlobal(vm, "greeting", &value));
+    CHECK(value.type == CLOX_STRING && value.as.string.length == 10 &&
+        memcmp(value.as.string.chars, "hello host", 10) == 0);
+    CHECK(cloxGetGlobal(vm, "half", &value));
+    CHECK(value.type == CLOX_NUMBER && value.as.number == 10.5);
+    CHECK(cloxGetGlobal(vm, "huge", &value));
+    CHECK(value.type == CLOX_BIG_INTEGER &&
+        strcmp(value.as.string.chars, "9223372036854775808") == 0);
+    CHECK(cloxGetGlobal(vm, "nothing", &value));
+    CHECK(value.type == CLOX_NIL);
+    CHECK(!cloxGetGlobal(vm, "missing", &value));
+
+    CHECK(cloxInterpret(vm, "const fixed = 1;") == CLOX_OK);
+    value.type = CLOX_NUMBER;
+    value.as.number = 2.0;
+    CHECK(!cloxSetGlobal(vm, "fixed", value));
+    cloxFreeVM(vm);
+}
+
+// A run that pauses at its budget is resumed until it finishes, and one
+// that is interrupted stops there
+static void testResume(FILE* errors) {
+    CloxVM* vm = cloxNewVM();
+    CHECK(vm != NULL);
+    cloxSetErrorFile(vm, errors);
+    cloxSetInstructionLimit(vm, 1000);
+
+    CloxScript* script = cloxCompile(vm,
+        "var total = 0;\n"
+        "for (var i = 0; i < 10000; i = i + 1) { total = total + i; }\n");
+    CHECK(script != NULL);
+    CloxResult result = cloxRun(vm, script);
+    int pauses = 0;
+    while (result == CLOX_BUDGET_EXCEEDED && pauses < 100000) {
+        pauses++;
+        result = cloxResume(vm);
+    }
+    CHECK(result == CLOX_OK);
+    CHECK(pauses > 1);
+    CloxValue value;
+    CHECK(cloxGetGlobal(vm, "total", &value));
+    CHECK(value.type == CLOX_INTEGER && value.as.integer == 49995000);
+    // Nothing is left to resume
+    CHECK(cloxResume(vm) == CLOX_OK);
+
+    // A run that paused is given up on by the next one
+    CHECK(cloxRun(vm, script) == CLOX_BUDGET_EXCEEDED);
+    cloxInterrupt(vm);
+    CHECK(cloxResume(vm) == CLOX_INTERRUPTED);
+    cloxSetInstructionLimit(vm, 0);
+    CHECK(cloxRun(vm, script) == CLOX_OK);
+    CHECK(cloxResume(vm) == CLOX_OK);
+
+    cloxFreeScript(script);
+    cloxFreeVM(vm);
+}
+
+// Writes the first size bytes of image to path, with the byte at flip
+// inverted unless flip is size or more
+static bool writeImage(const char* path, const char* image, size_t size,
+        size_t flip) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    bool written = fwrite(image, 1, size, file) == size;
+    if (written && flip < size) {
+        written = fseek(file, (long)flip, SEEK_SET) == 0 &&
+            fputc(~image[flip] & 0xff, file) != EOF;
+    }
+    return fclose(file) == 0 && written;
+}
+
+// A saved image brings back the globals on another VM, and one that has
+// been cut short or changed is refused
+static void testSnapshot(FILE* errors) {
+    const char* path = "api_test_snapshot.tmp";
+    CloxVM* vm = cloxNewVM();
+    CHECK(vm != NULL);
+    cloxSetErrorFile(vm, errors);
+    CHECK(cloxInterpret(vm,
+        "var count = 41;\n"
+        "const name = \"snap\";\n"
+        "var joined = \"sn\" + \"ap\";\n") == CLOX_OK);
+    CHECK(cloxSaveSnapshot(vm, path));
+    // Big integers cannot be saved
+    CHECK(cloxInterpret(vm, "var huge = 9223372036854775807 + 1;") ==
+        CLOX_OK);
+    CHECK(!cloxSaveSnapshot(vm, "api_test_unsaved.tmp"));
+    cloxFreeVM(vm);
+
+    vm = cloxNewVM();
+    CHECK(vm != NULL);
+    cloxSetErrorFile(vm, errors);
+    Output output;
+    clearOutput(&output);
+    cloxSetOutput(vm, collect, &output);
+    CHECK(cloxLoadSnapshot(vm, path));
+    CloxValue value;
+    CHECK(cloxGetGlobal(vm, "count", &value));
+    CHECK(value.type == CLOX_INTEGER && value.as.integer == 41);
+    CHECK(cloxGetGlobal(vm, "name", &value));
+    CHECK(value.type == CLOX_STRING && value.as.string.length == 4 &&
+        memcmp(value.as.string.chars, "snap", 4) == 0);
+    CHECK(!cloxSetGlobal(vm, "name", value));
+    CHECK(!cloxGetGlobal(vm, "huge", &value));
+    CHECK(cloxInterpret(vm,
+        "count = count + 1;\n"
+        "print count;\n"
+        "print joined == name;\n") == CLOX_OK);
+    CHECK(strcmp(output.text, "42\ntrue\n") == 0);
+
+    char* image = NULL;
+    long size = -1;
+    FILE* file = fopen(path, "rb");
+    if (file != NULL && fseek(file, 0L, SEEK_END) == 0) {
+        size = ftell(file);
+        rewind(file);
+    }
+    if (size > 0) {
+        image = (char*)malloc((size_t)size);
+    }
+    CHECK(image != NULL &&
+        fread(image, 1, (size_t)size, file) == (size_t)size);
+    if (file != NULL) {
+        fclose(file);
+    }
+    if (image != NULL) {
+        size_t length = (size_t)size;
+        CHECK(writeImage(path, image, length - 1, length));
+        CHECK(!cloxLoadSnapshot(vm, path));
+        // A failed load leaves the VM reset
+        CHECK(!cloxGetGlobal(vm, "count", &value));
+        CHECK(writeImage(path, image, 16, length));
+        CHECK(!cloxLoadSnapshot(vm, path));
+        CHECK(writeImage(path, image, length, 0));
+        CHECK(!cloxLoadSnapshot(vm, path));
+        CHECK(writeImage(path, image, length, length));
+        CHECK(cloxLoadSnapshot(vm, path));
+        CHECK(cloxGetGlobal(vm, "count", &value));
+        CHECK(value.type == CLOX_INTEGER && value.as.integer == 41);
+        free(image);
+    }
+    CHECK(!cloxLoadSnapshot(vm, "api_test_missing.tmp"));
+
+    cloxFreeVM(vm);
+    remove(path);
+}
+
+int main(void) {
+    // Errors the checks provoke on purpose are not shown
+    FILE* errors = tmpfile();
+    if (errors == NULL) {
+        errors = stderr;
+    }
+
+    testCompile(errors);
+    testRunMany();
+    testGlobals(errors);
+    testResume(errors);
+    testSnapshot(errors);
+
+    if (errors != stderr) {
+        fclose(errors);
+    }
+    if (failures > 0) {
+        fprintf(stderr, "%d API checks failed.\n", failures);
+        return 1;
+    }
+    printf("All API checks passed.\n");
+    return 0;
+}
\ No newline at end of file
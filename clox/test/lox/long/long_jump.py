@@ -0,0 +1,63 @@
+# Jumps over more than 65535 bytes of code, which need the OP_WIDE form.
+# Assumes the default settings, where each line of code() compiles to 29 bytes.
+
+STEP = 8
+LINE_BYTES = 29
+
+def indent(lines, depth):
+    return ["    " * depth + line for line in lines]
+
+def code(size):
+    # Statements adding to x that compile to exactly size bytes
+    lines, remainder = divmod(size, LINE_BYTES)
+    if remainder == 1:
+        lines -= 1
+        remainder += LINE_BYTES
+    out = ["x = x" + " + 1" * STEP + ";"] * lines
+    # "x;" is 3 bytes and "nil;" is 2 bytes
+    out += ["x;"] * (remainder // 3)
+    if remainder % 3 == 1:
+        out = out[:-1] + ["nil;"] * 2
+    elif remainder % 3 == 2:
+        out += ["nil;"]
+    return out, lines * STEP
+
+def main():
+    total = 0
+    print("var x = 0;")
+
+    # The else jump is widened, pushing the then jump, which only just fit,
+    # past the short limit as well
+    then, added = code(65530)
+    total += added
+    other, added = code(70000)
+    total += added
+    print("for (var r = 0; r < 2; r = r + 1) {")
+    print("    if (r == 0) {")
+    print("\n".join(indent(then, 2)))
+    print("    } else {")
+    print("\n".join(indent(other, 2)))
+    print("    }")
+    print("}")
+    print(f"print x; // expect: {total}")
+
+    body, added = code(70000)
+    total += added * 3
+    print("var i = 0;")
+    print("while (i < 3) {")
+    print("\n".join(indent(body, 1)))
+    print("    i = i + 1;")
+    print("}")
+    print(f"print x; // expect: {total}")
+
+    terms = 22000
+    expr = ["1" + " + 1" * 19] + ["+ 1" + " + 1" * 19] * (terms // 20 - 1)
+    print("print false and")
+    print("\n".join(indent(expr, 1)) + ";")
+    print("// expect: false")
+    print("print nil or")
+    print("\n".join(indent(expr, 1)) + ";")
+    print(f"// expect: {terms}")
+
+if __name__ == "__main__":
+    main()
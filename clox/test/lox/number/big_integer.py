@@ -0,0 +1,101 @@
+# Generates big_integer.lox, which checks arithmetic and comparisons on
+# integers past int64_t against Python's
+import random
+
+CHUNK = 10 ** 18
+
+def literal(value):
+    # Lox has no literals past int64_t, so big values are built from chunks
+    if value < 0:
+        return f"-({literal(-value)})"
+    chunks = []
+    while True:
+        chunks.append(value % CHUNK)
+        value //= CHUNK
+        if value == 0:
+            break
+    expression = str(chunks.pop())
+    while chunks:
+        expression = f"({expression}) * {CHUNK} + {chunks.pop()}"
+    return expression
+
+def divide(a, b):
+    # Truncating toward zero, as clox does
+    quotient = abs(a) // abs(b)
+    return quotient if (a < 0) == (b < 0) else -quotient
+
+def lox_bool(value):
+    return "true" if value else "false"
+
+def check(a, b):
+    print(f"a = {literal(a)};")
+    print(f"b = {literal(b)};")
+    print(f"print a; // expect: {a}")
+    print(f"print a + b; // expect: {a + b}")
+    print(f"print a - b; // expect: {a - b}")
+    print(f"print a * b; // expect: {a * b}")
+    if b != 0:
+        print(f"print a / b; // expect: {divide(a, b)}")
+    print(f"print -a; // expect: {-a}")
+    print(f"print a < b; // expect: {lox_bool(a < b)}")
+    print(f"print a > b; // expect: {lox_bool(a > b)}")
+    print(f"print a == b; // expect: {lox_bool(a == b)}")
+
+def random_integer(rng, limbs):
+    value = rng.getrandbits(32 * limbs)
+    return -value if rng.random() < 0.5 else value
+
+def main():
+    rng = random.Random(50)
+    print("// Generated by big_integer.py")
+    print("var a = 0;")
+    print("var b = 0;")
+
+    # Around the edges of int64_t, where results change size
+    edges = [0, 1, -1, 2, 2 ** 31, 2 ** 32, 2 ** 62, 2 ** 63 - 1, -2 ** 63,
+             2 ** 63, -2 ** 63 - 1, 2 ** 64, -2 ** 64, 2 ** 64 - 1,
+             2 ** 96, 2 ** 127]
+    for a in edges:
+        for b in edges:
+            if abs(a) >= 2 ** 63 or abs(b) >= 2 ** 63 or rng.random() < 0.3:
+                check(a, b)
+
+    # Sizes that take each way of multiplying and dividing, and lopsided
+    # ones that are taken in pieces
+    for limbs_a, limbs_b in [(1, 1), (2, 1), (3, 2), (5, 3), (8, 8),
+                             (20, 4), (39, 39), (40, 40), (41, 40),
+                             (80, 45), (100, 100), (120, 30), (130, 41),
+                             (200, 97)]:
+        for _ in range(3):
+            check(random_integer(rng, limbs_a), random_integer(rng, limbs_b))
+
+    # Divisors whose top limb is all ones or only its top bit, where
+    # estimated quotient limbs are corrected
+    for limbs in [2, 3, 6]:
+        for top in [0xFFFFFFFF, 0x80000000, 0x80000001]:
+            divisor = (top << (32 * (limbs - 1))) | \
+                rng.getrandbits(32 * (limbs - 1))
+            check(2 ** (32 * (limbs + 3)) - 1, divisor)
+            check(divisor * rng.getrandbits(96) + divisor - 1, divisor)
+            check((2 ** (32 * limbs) - 1) * (2 ** 64), divisor)
+
+    # Results that fit again, and the same value reached two ways
+    big = 3 ** 90
+    print(f"a = {literal(big)};")
+    print(f"print a - (a - 5); // expect: 5")
+    print(f"print (a * a) / a == a; // expect: true")
+    print(f"print a - 1 + 1 == a; // expect: true")
+    print(f"print a * 0; // expect: 0")
+    print(f"print a / (a + 1); // expect: 0")
+
+    # Mixed with floats, which are written out since Lox has no exponents
+    print(f"print {literal(2 ** 70)} == {2 ** 70}.0; // expect: true")
+    print(f"print {literal(2 ** 70)} + 0.5 == {2 ** 70}.0; "
+          "// expect: true")
+    print(f"print {literal(2 ** 70)} < {2 ** 71}.0; // expect: true")
+    print(f"print {literal(2 ** 70)} > {2 ** 69}.0; // expect: true")
+    print(f"print {literal(2 ** 70 + 1)} == {2 ** 70}.0; "
+          "// expect: true")
+
+if __name__ == "__main__":
+    main()
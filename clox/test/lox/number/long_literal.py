@@ -0,0 +1,57 @@
+# Generates long_literal.lox, which checks that float literals are correctly
+# rounded by comparing different spellings of the same double
+import random
+import struct
+from decimal import Decimal, getcontext
+
+def positional(value):
+    # Lox has no exponent notation
+    text = format(Decimal(value), 'f')
+    if '.' not in text:
+        text += '.0'
+    return text
+
+def shortest(value):
+    return positional(repr(value))
+
+def exact(value):
+    return positional(value)
+
+def from_bits(bits):
+    return struct.unpack('<d', struct.pack('<Q', bits))[0]
+
+def to_bits(value):
+    return struct.unpack('<Q', struct.pack('<d', value))[0]
+
+def main():
+    getcontext().prec = 1000
+    rng = random.Random(26)
+    values = [0.1, 0.2, 0.3, 1.0 / 3.0, 2.0 ** 53, 2.0 ** 53 + 2.0,
+              1.7976931348623157e308, 2.2250738585072014e-308, 5e-324]
+    for _ in range(200):
+        values.append(rng.uniform(0, 1000))
+    for _ in range(200):
+        exp10 = rng.randint(-40, 40)
+        values.append(float(rng.randint(1, 10 ** 17)) * 10.0 ** exp10)
+
+    for value in values:
+        # Exact expansion is long enough to need the truncated path
+        print(f"print {exact(value)} == {shortest(value)}; // expect: true")
+
+    for value in values:
+        if value >= 1.7976931348623157e308:
+            continue
+        # Halfway point between two doubles rounds to even
+        bits = to_bits(value)
+        halfway = (Decimal(value) + Decimal(from_bits(bits + 1))) / 2
+        rounded = float(halfway)
+        print(f"print {positional(halfway)} == {shortest(rounded)}; "
+              "// expect: true")
+
+    for _ in range(100):
+        value = rng.randint(0, 2 ** 63 - 1)
+        print(f"print {value}; // expect: {value}")
+    print(f"print {2 ** 63 - 1}; // expect: {2 ** 63 - 1}")
+
+if __name__ == "__main__":
+    main()
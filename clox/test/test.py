@@ -4,13 +4,23 @@
 import re
 
 from collections import defaultdict
+from concurrent.futures import ThreadPoolExecutor, as_completed
+import os
 from os import listdir
 from os.path import abspath, basename, dirname, isdir, isfile, join, realpath, relpath, splitext
 import re
 from subprocess import Popen, PIPE
 import sys
+import tempfile
+import threading
 import time
 
+try:
+    import resource
+except ImportError:
+    # Windows, where tests are run without measuring them
+    resource = None
+
 import term
 
 # Runs the tests.
@@ -23,6 +33,19 @@ RUNTIME_ERROR_EXPECT = re.compile(r'// expect runtime error: (.+)')
 SYNTAX_ERROR_RE = re.compile(r'\[.*line (\d+)\] (Error.+)')
 STACK_TRACE_RE = re.compile(r'\[line (\d+)\]')
 NONTEST_RE = re.compile(r'// nontest')
+# Bounds on what clox --count reports, e.g. "// expect instructions: <= 40"
+COUNT_EXPECT = re.compile(
+    r'// expect (instructions|bytecode): ?(<=|>=|==)? ?(\d+)')
+COUNT_RE = re.compile(r'^(instructions|bytecode): (\d+)$')
+# Options clox runs the test with, e.g. "// flags: --incremental"
+FLAGS_EXPECT = re.compile(r'// flags: (.+)')
+# Ends the output of each script run by clox --batch
+BATCH_MARKER_RE = re.compile(rb'^#clox-batch\t(-?\d+)\t.*\n', re.MULTILINE)
+COUNT_COMPARE = {
+    '<=': lambda actual, bound: actual <= bound,
+    '>=': lambda actual, bound: actual >= bound,
+    '==': lambda actual, bound: actual == bound,
+}
 
 interpreter_language = 'c'
 interpreter_args = [join(REPO_DIR, 'clox', 'clox.exe')]
@@ -31,6 +54,11 @@ failed = 0
 num_skipped = 0
 expectations = 0
 
+# Tests taking longer than this many seconds are killed and fail
+time_budget = 10.0
+# Tests whose peak RSS is above this many bytes fail
+rss_budget = 256 * 1024 * 1024
+
 class Test:
     def __init__(self, path):
         self.path = path
@@ -39,7 +67,17 @@ class Test:
         self.runtime_error_line = 0
         self.runtime_error_message = None
         self.exit_code = 0
+        self.counts = []
+        self.flags = []
         self.failures = []
+        # Resource usage of the run, where the platform reports it
+        self.wall_time = 0.0
+        self.user_time = None
+        self.sys_time = None
+        self.max_rss = None
+        # Linux counts the pages a child had before exec, which are the
+        # runner's own, so peak RSS cannot be measured below this
+        self.rss_floor = 0
 
     def parse(self):
         global expectations
@@ -85,6 +123,17 @@ class Test:
                     self.exit_code = 70
                     expectations += 1
 
+                match = COUNT_EXPECT.search(line)
+                if match:
+                    self.counts.append((match.group(1),
+                        match.group(2) or '==', int(match.group(3)),
+                        line_num))
+                    expectations += 1
+
+                match = FLAGS_EXPECT.search(line)
+                if match:
+                    self.flags += match.group(1).split()
+
                 match = NONTEST_RE.search(line)
                 if match:
                     # Not a test file at all, so ignore it.
@@ -98,11 +147,65 @@ class Test:
     def run(self):
         # Invoke the interpreter and run the test.
         args = interpreter_args[:]
+        if self.counts:
+            args.append('--count')
+        args += self.flags
         args.append(self.path)
-        proc = Popen(args, stdin=PIPE, stdout=PIPE, stderr=PIPE)
-
-        out, err = proc.communicate()
-        self.validate(proc.returncode, out, err)
+        if resource is not None and hasattr(os, 'wait4'):
+            exit_code, out, err = self.run_measured(args)
+        else:
+            start = time.perf_counter()
+            proc = Popen(args, stdin=PIPE, stdout=PIPE, stderr=PIPE)
+            out, err = proc.communicate()
+            exit_code = proc.returncode
+            self.wall_time = time.perf_counter() - start
+        self.validate(exit_code, out, err)
+        self.validate_budgets()
+
+    def run_batched(self, exit_code, out, err):
+        # Checks output split from a batch run with --count, which has
+        # counts whether or not the test expects them
+        if not self.counts:
+            err = b''.join(line for line in err.splitlines(True)
+                           if not COUNT_RE.match(line.decode('utf-8').rstrip()))
+        self.validate(exit_code, out, err)
+
+    def run_measured(self, args):
+        # Output goes to files so the process can be reaped with wait4,
+        # which gives its resource usage
+        with tempfile.TemporaryFile() as out_file, \
+                tempfile.TemporaryFile() as err_file:
+            self.rss_floor = rss_bytes(
+                resource.getrusage(resource.RUSAGE_SELF).ru_maxrss)
+            start = time.perf_counter()
+            proc = Popen(args, stdin=PIPE, stdout=out_file, stderr=err_file)
+            proc.stdin.close()
+            timer = threading.Timer(time_budget, proc.kill)
+            timer.start()
+            try:
+                _, status, usage = os.wait4(proc.pid, 0)
+            finally:
+                timer.cancel()
+            self.wall_time = time.perf_counter() - start
+            # Already reaped, so Popen must not wait for it again
+            proc.returncode = exit_code = decode_status(status)
+
+            self.user_time = usage.ru_utime
+            self.sys_time = usage.ru_stime
+            self.max_rss = rss_bytes(usage.ru_maxrss)
+
+            out_file.seek(0)
+            err_file.seek(0)
+            return exit_code, out_file.read(), err_file.read()
+
+    def validate_budgets(self):
+        if self.wall_time >= time_budget:
+            self.fail('Took {0:.2f} seconds, over the budget of {1} seconds.',
+                      self.wall_time, time_budget)
+        if self.max_rss is not None and self.max_rss > rss_budget and \
+                self.max_rss > self.rss_floor:
+            self.fail('Peak RSS was {0:.1f} MB, over the budget of {1:.1f} MB.',
+                      self.max_rss / 1048576, rss_budget / 1048576)
 
     def validate(self, exit_code, out, err):
         if self.compile_errors and self.runtime_error_message:
@@ -117,6 +220,8 @@ class Test:
             self.fail('Error decoding output.')
 
         error_lines = err.split('\n')
+        if self.counts:
+            error_lines = self.validate_counts(error_lines)
 
         # Validate that an expected runtime error occurred.
         if self.runtime_error_message:
@@ -127,6 +232,25 @@ class Test:
         self.validate_exit_code(exit_code, error_lines)
         self.validate_output(out)
 
+    def validate_counts(self, error_lines):
+        # Checks the counts printed by --count, returning the other lines
+        counted = {}
+        rest = []
+        for line in error_lines:
+            match = COUNT_RE.match(line)
+            if match:
+                counted[match.group(1)] = int(match.group(2))
+            else:
+                rest.append(line)
+
+        for name, op, bound, line_num in self.counts:
+            if name not in counted:
+                self.fail('Expected a count of {0} and got none.', name)
+            elif not COUNT_COMPARE[op](counted[name], bound):
+                self.fail('Expected {0} {1} {2} on line {3} and got {4}.',
+                          name, op, bound, line_num, counted[name])
+        return rest
+
     def validate_runtime_error(self, error_lines):
         if len(error_lines) < 2:
             self.fail('Expected runtime error "{0}" and got none.',
@@ -231,6 +355,18 @@ class Test:
         self.failures.append(message)
 
 
+def rss_bytes(max_rss):
+    # ru_maxrss is in kilobytes everywhere except macOS
+    return max_rss * (1 if sys.platform == 'darwin' else 1024)
+
+
+def decode_status(status):
+    # The same exit codes as Popen.returncode, negative for signals
+    if os.WIFSIGNALED(status):
+        return -os.WTERMSIG(status)
+    return os.WEXITSTATUS(status)
+
+
 def walk(dir, callback):
     """
     Walks [dir], and executes [callback] on each file.
@@ -245,12 +381,10 @@ def walk(dir, callback):
             callback(nfile)
 
 
-def run_script(path):
+def load_script(path, tests):
     if "benchmark" in path:
         return
 
-    global passed
-    global failed
     global num_skipped
 
     if (splitext(path)[1] != '.lox'):
@@ -262,13 +396,6 @@ def run_script(path):
     # the argument to use that.
     path = relpath(path).replace("\\", "/")
 
-    # Update the status line.
-    term.print_line('Passed: {} Failed: {} Skipped: {} {}'.format(
-        term.green(passed),
-        term.red(failed),
-        term.yellow(num_skipped),
-        term.gray('({})'.format(path))))
-
     # Read the test and parse out the expectations.
     test = Test(path)
 
@@ -276,21 +403,80 @@ def run_script(path):
         # It's a skipped or non-test file.
         return
 
-    test.run()
+    tests.append(test)
+
+
+def report_test(test):
+    global passed
+    global failed
 
     # Display the results.
     if len(test.failures) == 0:
         passed += 1
     else:
         failed += 1
-        term.print_line(term.red('FAIL') + ': ' + path)
+        term.print_line(term.red('FAIL') + ': ' + test.path)
         print('')
         for failure in test.failures:
             print('      ' + term.pink(failure))
         print('')
 
-
-def run_suite():
+    # Update the status line.
+    term.print_line('Passed: {} Failed: {} Skipped: {} {}'.format(
+        term.green(passed),
+        term.red(failed),
+        term.yellow(num_skipped),
+        term.gray('({})'.format(test.path))))
+
+
+def print_slowest(tests, count):
+    slowest = sorted(tests, key=lambda test: test.wall_time, reverse=True)
+    print('Slowest tests:')
+    print('  {:>8} {:>8} {:>8} {:>9}  {}'.format(
+        'wall s', 'user s', 'sys s', 'RSS MB', 'test'))
+    for test in slowest[:count]:
+        def seconds(value):
+            return '-' if value is None else '{:.3f}'.format(value)
+        if test.max_rss is None:
+            rss = '-'
+        elif test.max_rss <= test.rss_floor:
+            rss = '<{:.1f}'.format(test.rss_floor / 1048576)
+        else:
+            rss = '{:.1f}'.format(test.max_rss / 1048576)
+        print('  {:>8} {:>8} {:>8} {:>9}  {}'.format(
+            seconds(test.wall_time), seconds(test.user_time),
+            seconds(test.sys_time), rss, test.path))
+
+
+def split_batch(output):
+    # Returns the exit code and output of each script in a batch
+    scripts = []
+    start = 0
+    for match in BATCH_MARKER_RE.finditer(output):
+        scripts.append((int(match.group(1)), output[start:match.start()]))
+        start = match.end()
+    return scripts
+
+
+def run_batch(tests):
+    # Runs tests in a single clox process, reading their paths from stdin
+    args = interpreter_args + ['--batch', '--count']
+    paths = ''.join(test.path + '\n' for test in tests).encode('utf-8')
+    proc = Popen(args, stdin=PIPE, stdout=PIPE, stderr=PIPE)
+    out, err = proc.communicate(paths)
+    outs = split_batch(out)
+    errs = split_batch(err)
+    for index, test in enumerate(tests):
+        if index >= len(outs) or index >= len(errs):
+            test.fail('Batch ended before the test ran, exiting with {0}.',
+                      proc.returncode)
+            test.failures += err.decode('utf-8').split('\n')[-10:]
+            continue
+        exit_code, test_out = outs[index]
+        test.run_batched(exit_code, test_out, errs[index][1])
+
+
+def run_suite(jobs, slowest, batch):
     global passed
     global failed
     global num_skipped
@@ -302,13 +488,35 @@ def run_suite():
     expectations = 0
 
     start_time = time.time()
-    walk(join(REPO_DIR, 'clox', 'test', 'lox'), run_script)
+    tests = []
+    walk(join(REPO_DIR, 'clox', 'test', 'lox'),
+         lambda path: load_script(path, tests))
+    # Each test waits on its own clox process, so threads are enough
+    with ThreadPoolExecutor(max_workers=jobs) as pool:
+        if batch:
+            # One batch per worker, with a share of the tests. A batch
+            # shares its options, so tests with flags of their own run alone
+            batched = [test for test in tests if not test.flags]
+            running = [pool.submit(run_batch, batched[i::jobs])
+                       for i in range(min(jobs, len(batched)))]
+            running += [pool.submit(test.run) for test in tests
+                        if test.flags]
+        else:
+            running = [pool.submit(test.run) for test in tests]
+        for future in as_completed(running):
+            future.result()
+    # Reported in a fixed order however the runs finished
+    for test in tests:
+        report_test(test)
     time_passed = time.time() - start_time
 
     term.print_line()
     
     print()
 
+    if slowest > 0 and not batch:
+        print_slowest(tests, slowest)
+
     if failed == 0:
         print('All {} tests passed ({} expectations) in {:.2f} seconds.'.format(
             term.green(passed), str(expectations), time_passed))
@@ -319,13 +527,51 @@ def run_suite():
     return failed == 0
 
 
+def usage():
+    print('Usage: test.py [options]')
+    print('  --jobs=N           run N tests at a time (default: one per core)')
+    print('  --time-budget=S    fail tests taking longer than S seconds '
+          '(default {:g})'.format(time_budget))
+    print('  --rss-budget=MB    fail tests using more than MB megabytes '
+          '(default {:g}).'.format(rss_budget / 1048576))
+    print('                     Usage below the runner\'s own RSS cannot be '
+          'measured.')
+    print('  --slowest=N        list the N slowest tests (default 5)')
+    print('  --batch            run the tests of each job in one clox process, '
+          'without')
+    print('                     measuring them or holding them to budgets')
+    sys.exit(1)
+
+
 def main(argv):
-    if len(argv) > 1:
-        print('Usage: test.py')
+    global time_budget
+    global rss_budget
+
+    jobs = os.cpu_count() or 1
+    slowest = 5
+    batch = False
+    try:
+        for arg in argv[1:]:
+            if arg.startswith('--jobs='):
+                jobs = int(arg[len('--jobs='):])
+            elif arg.startswith('--time-budget='):
+                time_budget = float(arg[len('--time-budget='):])
+            elif arg.startswith('--rss-budget='):
+                rss_budget = int(float(arg[len('--rss-budget='):]) * 1048576)
+            elif arg.startswith('--slowest='):
+                slowest = int(arg[len('--slowest='):])
+            elif arg == '--batch':
+                batch = True
+            else:
+                usage()
+    except ValueError:
+        usage()
+    if jobs < 1 or time_budget <= 0 or rss_budget <= 0 or slowest < 0:
+        usage()
+
+    if not run_suite(jobs, slowest, batch):
         sys.exit(1)
 
-    run_suite()
-
 
 if __name__ == '__main__':
     main(sys.argv)
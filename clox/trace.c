@@ -0,0 +1,67 @@
+#include "trace.h"
+#include "debug.h"
+#include "memory.h"
+
+#ifdef CLOX_EXECUTION_TRACE
+
+// Sets up a trace keeping at least the last length instructions
+// Returns false for failed allocation
+bool initTrace(Trace* trace, size_t length) {
+    trace->capacity = 1;
+    while (trace->capacity < length) {
+        trace->capacity *= 2;
+    }
+    trace->count = 0;
+    trace->entries = ALLOCATE(TraceEntry, trace->capacity, false, MEM_TOOLS);
+    return trace->entries != NULL;
+}
+
+void freeTrace(Trace* trace) {
+    FREE_ARRAY(TraceEntry, trace->entries, trace->capacity, MEM_TOOLS);
+    trace->entries = NULL;
+    trace->capacity = 0;
+    trace->count = 0;
+}
+
+// Forgets every recorded instruction
+void resetTrace(Trace* trace) {
+    trace->count = 0;
+}
+
+// Prints the recorded instructions, oldest first
+// chunk is used to show line numbers and may be NULL if it is gone
+void printTrace(Trace* trace, Chunk* chunk, FILE* file) {
+    size_t kept = trace->count < trace->capacity ?
+        trace->count : trace->capacity;
+    fprintf(file, "== last %" FORMAT_SIZE_T " of %" FORMAT_SIZE_T
+        " instructions ==\n", kept, trace->count);
+    for (size_t i = trace->count - kept; i < trace->count; i++) {
+        TraceEntry* entry = &trace->entries[i & (trace->capacity - 1)];
+        fprintf(file, "%04" FORMAT_SIZE_T " ", entry->offset);
+        if (chunk != NULL && entry->offset < chunk->count) {
+            fprintf(file, "%4" FORMAT_SIZE_T " ",
+                getLine(chunk, entry->offset));
+        }
+        else {
+            fprintf(file, "   ? ");
+        }
+
+        const char* name = opName(entry->opcode);
+        fprintf(file, "%-8s%-16s ", entry->wide ? "OP_WIDE" : "",
+            name == NULL ? "OP_UNKNOWN" : name);
+        if (entry->operand == TRACE_NO_OPERAND) {
+            fprintf(file, "%8s", "");
+        }
+        else {
+            fprintf(file, "%8" FORMAT_SIZE_T, entry->operand);
+        }
+        fprintf(file, " depth %4" FORMAT_SIZE_T, entry->depth);
+        if (entry->depth > 0) {
+            fprintf(file, " top ");
+            fprintValue(file, entry->top);
+        }
+        fprintf(file, "\n");
+    }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,82 @@
+#ifndef clox_trace_h
+#define clox_trace_h
+
+#include <stdio.h>
+
+#include "common.h"
+#include "chunk.h"
+#include "endian.h"
+#include "value.h"
+
+#ifdef CLOX_EXECUTION_TRACE
+
+// Number of instructions kept unless asked otherwise
+#define TRACE_DEFAULT_LENGTH 32
+// Operand of instructions that do not take one
+#define TRACE_NO_OPERAND ((size_t) -1)
+
+// An executed instruction and the state of the stack just before it ran
+typedef struct {
+    size_t offset;
+    size_t operand;
+    size_t depth;
+    // Only meaningful when depth is not 0
+    Value top;
+    uint8_t opcode;
+    bool wide;
+} TraceEntry;
+
+// Ring buffer of the most recently executed instructions
+typedef struct {
+    TraceEntry* entries;
+    // Always a power of two
+    size_t capacity;
+    // Total number of instructions recorded, including overwritten ones
+    size_t count;
+} Trace;
+
+static inline void recordTrace(Trace* trace, const uint8_t* code,
+        const uint8_t* ip, const Value* stack, const Value* stackTop) {
+    TraceEntry* entry = &trace->entries[trace->count++ & (trace->capacity - 1)];
+    entry->offset = (size_t)(ip - code);
+    entry->wide = ip[0] == OP_WIDE;
+    entry->opcode = ip[entry->wide];
+    entry->depth = (size_t)(stackTop - stack);
+    if (entry->depth > 0) {
+        entry->top = stackTop[-1];
+    }
+
+    const uint8_t* operand = ip + entry->wide + 1;
+    switch (entry->opcode) {
+        case OP_CONSTANT:
+        case OP_DEFINE_GLOBAL:
+        case OP_DEFINE_GLOBAL_CONST:
+        case OP_GET_GLOBAL:
+        case OP_SET_GLOBAL:
+        case OP_GET_LOCAL:
+        case OP_SET_LOCAL:
+            entry->operand = entry->wide ?
+                COMBINE_3WORD(operand[0], operand[1], operand[2]) :
+                operand[0];
+            break;
+        case OP_JUMP:
+        case OP_JUMP_IF_FALSE:
+        case OP_LOOP:
+            entry->operand = entry->wide ?
+                COMBINE_4WORD(operand[0], operand[1], operand[2], operand[3]) :
+                COMBINE_2WORD(operand[0], operand[1]);
+            break;
+        default:
+            entry->operand = TRACE_NO_OPERAND;
+            break;
+    }
+}
+
+bool initTrace(Trace* trace, size_t length);
+void freeTrace(Trace* trace);
+void resetTrace(Trace* trace);
+void printTrace(Trace* trace, Chunk* chunk, FILE* file);
+
+#endif
+
+#endif
\ No newline at end of file
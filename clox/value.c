@@ -3,9 +3,11 @@
 #include <inttypes.h>
 #include <string.h>
 
+#include "bigint.h"
 #include "object.h"
 #include "value.h"
 #include "memory.h"
+#include "number.h"
 #include "math.h"
 
 // Initializes an empty value array with capacity 0
@@ -17,7 +19,7 @@ void initValueArray(ValueArray* array) {
 
 // Frees a value array, resetting its values to initialization
 void freeValueArray(ValueArray* array) {
-    FREE_ARRAY(Value, array->values, array->capacity);
+    FREE_ARRAY(Value, array->values, array->capacity, MEM_CONSTANTS);
     initValueArray(array);
 }
 
@@ -25,14 +27,15 @@ void freeValueArray(ValueArray* array) {
 // Returns -1 for failed allocation, 0 otherwise
 int writeValueArray(ValueArray* array, Value value) {
     if (array->capacity < array->count + 1) {
-        size_t oldCapacity = array->capacity;
-        array->capacity = GROW_CAPACITY(oldCapacity);
-        array->values = GROW_ARRAY(array->values, Value,
-            oldCapacity, array->capacity);
-        if (array->values == NULL) {
+        size_t newCapacity = GROW_CAPACITY(array->capacity);
+        Value* values = GROW_ARRAY(array->values, Value,
+            array->capacity, newCapacity, MEM_CONSTANTS);
+        if (values == NULL) {
             // Out of memory
             return -1;
         }
+        array->values = values;
+        array->capacity = newCapacity;
     }
 
     array->values[array->count] = value;
@@ -42,15 +45,67 @@ int writeValueArray(ValueArray* array, Value value) {
 
 // Prints a single value
 void printValue(Value value) {
+    fprintValue(stdout, value);
+}
+
+// Prints a single value to file
+void fprintValue(FILE* file, Value value) {
     switch (value.type) {
-        case VAL_BOOL: printf(AS_BOOL(value) ? "true" : "false"); break;
-        case VAL_NIL: printf("nil"); break;
-        case VAL_FLOAT: printf("%g", AS_FLOAT(value)); break;
-        case VAL_OBJ: printObject(value); break;
+        case VAL_BOOL: fprintf(file, AS_BOOL(value) ? "true" : "false"); break;
+        case VAL_NIL: fprintf(file, "nil"); break;
+        case VAL_FLOAT: fprintf(file, "%g", AS_FLOAT(value)); break;
+        case VAL_OBJ: fprintObject(file, value); break;
 #ifdef CLOX_INTEGER_TYPE
-        case VAL_INT: printf("%" PRId64, AS_INT(value)); break;
+        case VAL_INT: fprintf(file, "%" PRId64, AS_INT(value)); break;
+#endif
+    }
+}
+
+#ifdef CLOX_BIG_INTEGERS
+static int formatBigIntValue(char* buffer, size_t size, ObjBigInt* big) {
+    char* text = ALLOCATE(char, bigIntTextSize(big), false, MEM_BIG_INTEGERS);
+    if (text == NULL) {
+        return snprintf(buffer, size, "<big integer>");
+    }
+    int length = formatBigInt(text, big);
+    length = length < 0 ? snprintf(buffer, size, "<big integer>") :
+        snprintf(buffer, size, "%s", text);
+    FREE_ARRAY(char, text, bigIntTextSize(big), MEM_BIG_INTEGERS);
+    return length;
+}
+#endif
+
+// Writes value into buffer like snprintf, returning its full length
+int formatValue(char* buffer, size_t size, Value value) {
+    switch (value.type) {
+        case VAL_BOOL:
+            return snprintf(buffer, size, AS_BOOL(value) ? "true" : "false");
+        case VAL_NIL: return snprintf(buffer, size, "nil");
+        case VAL_FLOAT:
+#ifdef CLOX_FAST_NUMBER_FORMAT
+            if (size >= NUMBER_TEXT_SIZE) {
+                return formatFloat(buffer, AS_FLOAT(value));
+            }
+#endif
+            return snprintf(buffer, size, "%g", AS_FLOAT(value));
+        case VAL_OBJ:
+#ifdef CLOX_BIG_INTEGERS
+            if (IS_BIGINT(value)) {
+                return formatBigIntValue(buffer, size, AS_BIGINT(value));
+            }
+#endif
+            return snprintf(buffer, size, "%s", AS_CSTRING(value));
+#ifdef CLOX_INTEGER_TYPE
+        case VAL_INT:
+#ifdef CLOX_FAST_NUMBER_FORMAT
+            if (size >= NUMBER_TEXT_SIZE) {
+                return formatInteger(buffer, AS_INT(value));
+            }
+#endif
+            return snprintf(buffer, size, "%" PRId64, AS_INT(value));
 #endif
     }
+    return 0;
 }
 
 #ifdef CLOX_INTEGER_TYPE
@@ -66,6 +121,28 @@ double numberToFloat(Value in) {
 }
 #endif
 
+// Strings interned in the same table are equal only if they are the same
+// object. Strings of a program and of the VM running it, or set by a host,
+// can be equal without being the same object.
+static bool objectsEqual(Value a, Value b) {
+    if (AS_OBJ(a) == AS_OBJ(b)) {
+        return true;
+    }
+#ifdef CLOX_BIG_INTEGERS
+    if (OBJ_TYPE(a) != OBJ_TYPE(b)) {
+        return false;
+    }
+    if (IS_BIGINT(a)) {
+        return bigIntsEqual(AS_BIGINT(a), AS_BIGINT(b));
+    }
+#endif
+    ObjString* stringA = AS_STRING(a);
+    ObjString* stringB = AS_STRING(b);
+    return stringA->hash == stringB->hash &&
+        stringA->length == stringB->length &&
+        memcmp(stringA->chars, stringB->chars, (size_t)stringA->length) == 0;
+}
+
 bool valuesEqual(Value a, Value b) {
     if (a.type != b.type) {
 #ifdef CLOX_INTEGER_TYPE
@@ -75,6 +152,15 @@ bool valuesEqual(Value a, Value b) {
             double vfloatb = NUMBER_TO_FLOAT(b);
             return vfloata == vfloatb;
         }
+#ifdef CLOX_BIG_INTEGERS
+        // A big integer is never equal to a small one, but can be to a float
+        else if (IS_FLOAT(a) && IS_BIGINT(b)) {
+            return AS_FLOAT(a) == bigIntToFloat(AS_BIGINT(b));
+        }
+        else if (IS_BIGINT(a) && IS_FLOAT(b)) {
+            return bigIntToFloat(AS_BIGINT(a)) == AS_FLOAT(b);
+        }
+#endif
         else {
             return false;
         }
@@ -87,7 +173,7 @@ bool valuesEqual(Value a, Value b) {
         case VAL_BOOL:  return AS_BOOL(a) == AS_BOOL(b);
         case VAL_NIL:   return true;
         case VAL_FLOAT: return AS_FLOAT(a) == AS_FLOAT(b);
-        case VAL_OBJ:   return AS_OBJ(a) == AS_OBJ(b);
+        case VAL_OBJ:   return objectsEqual(a, b);
 #ifdef CLOX_INTEGER_TYPE
         case VAL_INT:   return AS_INT(a) == AS_INT(b);
 #endif
@@ -124,45 +210,46 @@ uint32_t hashString(const char* key, int length) {
     return hash;
 }
 
-bool initHash = false;
-uint32_t hashNil = 0;
-uint32_t hashFalse = 0;
-uint32_t hashTrue = 0;
-
 uint32_t hashInt(vint_t number) {
     return hashString((const char*) &number, VINT_SIZE);
 }
 
+// Hashes of the values with no payload, which are what hashInt(hashInt(k)
+// + 1) gives for k = 0, 1 and 2 on little-endian machines, written out so
+// that nothing is computed or cached for them
+#define HASH_NIL 0x56b39548u
+#define HASH_TRUE 0xdb47df7eu
+#define HASH_FALSE 0x2901de67u
+
 uint32_t hashValue(Value value) {
-    if (!initHash) {
-        initHash = true;
-        hashNil = hashInt(hashInt(0) + 1);
-        hashFalse = hashInt(hashInt(1) + 1);
-        hashTrue = hashInt(hashInt(2) + 1);
-    }
     switch (value.type) {
         case VAL_BOOL: {
             bool b = AS_BOOL(value);
             if (b) {
-                return hashFalse;
+                return HASH_TRUE;
             }
             else {
-                return hashTrue;
+                return HASH_FALSE;
             }
         }
         case VAL_NIL:
-            return hashNil;
+            return HASH_NIL;
         case VAL_FLOAT: {
             double d = AS_FLOAT(value);
             // Cast raw bits
             vint_t i = *((vint_t *)&d);
-            return hashInt(i ^ (hashNil + 1));
+            return hashInt(i ^ (HASH_NIL + 1));
         }
         case VAL_OBJ:   {
             if (IS_STRING(value)) {
                 ObjString* string = AS_STRING(value);
                 return string->hash;
             }
+#ifdef CLOX_BIG_INTEGERS
+            else if (IS_BIGINT(value)) {
+                return AS_BIGINT(value)->hash;
+            }
+#endif
             else {
                 // TODO add support for other object types
                 Obj* obj = AS_OBJ(value);
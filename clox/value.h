@@ -1,6 +1,8 @@
 #ifndef clox_value_h
 #define clox_value_h
 
+#include <stdio.h>
+
 #include "settings.h"
 #include "common.h"
 
@@ -69,6 +71,10 @@ void initValueArray(ValueArray* array);
 void freeValueArray(ValueArray* array);
 int writeValueArray(ValueArray* array, Value value);
 void printValue(Value value);
+void fprintValue(FILE* file, Value value);
+// Room formatValue needs for any value but a string, with the terminator
+#define VALUE_TEXT_SIZE 32
+int formatValue(char* buffer, size_t size, Value value);
 void printValueType(Value value);
 
 uint32_t hashInt(vint_t number);
@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "bigint.h"
 #include "common.h"
 #include "compiler.h"
 #include "vm.h"
@@ -10,40 +11,93 @@
 #include "debug.h"
 #include "object.h"
 #include "memory.h"
+#include "profile.h"
+#include "probes.h"
+#include "snapshot.h"
 
 #define UNUSED(x) (void)(x)
 
-static void resetStack(VM* vm) {
+// Returns false for failed allocation, leaving the VM without a stack
+// until it is reset again
+static bool resetStack(VM* vm) {
 #ifdef CLOX_VARIABLE_STACK
-    FREE_ARRAY(Value, vm->stack, STACK_CAPACITY(vm));
-    vm->stack = GROW_ARRAY(NULL, Value, 0, STACK_DEFAULT);
-    if (vm->stack == NULL) {
-        // Out of memory
-        // TODO handle error case
-        exit(100);
+    // A stack that has grown goes back to the default size
+    if (vm->stack == NULL || STACK_CAPACITY(vm) != STACK_DEFAULT) {
+        FREE_ARRAY(Value, vm->stack, STACK_CAPACITY(vm), MEM_STACK);
+        vm->stack = GROW_ARRAY(NULL, Value, 0, STACK_DEFAULT, MEM_STACK);
+        vm->stackMax = vm->stack == NULL ? NULL : vm->stack + STACK_DEFAULT;
     }
-    vm->stackMax = vm->stack + STACK_DEFAULT;
 #endif
     vm->stackTop = vm->stack;
+#ifdef CLOX_VARIABLE_STACK
+    return vm->stack != NULL;
+#else
+    return true;
+#endif
+}
+
+// Forgets a paused run of a program, leaving the stack empty
+static void discardPaused(VM* vm) {
+    if (vm->paused != NULL) {
+        vm->paused = NULL;
+        vm->frozenStrings = NULL;
+        vm->chunk = NULL;
+        resetStack(vm);
+    }
+}
+
+// Hands everything print statements have written so far to write or out
+static void flushOutput(VM* vm) {
+    if (vm->outputCount == 0) {
+        return;
+    }
+    if (vm->write != NULL) {
+        vm->write(vm->writeContext, vm->output, vm->outputCount);
+    }
+    else {
+        // Left in out's own buffer it would wait there, and could come
+        // after errors written since
+        fwrite(vm->output, 1, vm->outputCount, vm->out);
+        fflush(vm->out);
+    }
+    vm->outputCount = 0;
 }
 
 static void runtimeError(VM* vm, const char* format, ...) {
+    // What was printed before the error is written before it
+    flushOutput(vm);
     va_list args;
     va_start(args, format);
-    vfprintf(stderr, format, args);
+#ifdef CLOX_PROBES
+    char message[256];
+    va_list probeArgs;
+    va_copy(probeArgs, args);
+    vsnprintf(message, sizeof(message), format, probeArgs);
+    va_end(probeArgs);
+#endif
+    vfprintf(vm->err, format, args);
     va_end(args);
-    fputs("\n", stderr);
+    fputs("\n", vm->err);
 
     size_t instruction = (size_t)(vm->ip - vm->chunk->code);
     size_t line = getLine(vm->chunk, instruction);
-    fprintf(stderr, "[line %" FORMAT_SIZE_T "] in script\n", line);
+    fprintf(vm->err, "[line %" FORMAT_SIZE_T "] in script\n", line);
+    PROBE2(runtime__error, message, line);
+#ifdef CLOX_EXECUTION_TRACE
+    if (vm->trace != NULL) {
+        printTrace(vm->trace, vm->chunk, vm->err);
+    }
+#endif
 
     resetStack(vm);
 }
 
 void initVM(VM* vm) {
+    initHeap(&vm->heap);
+    useHeap(&vm->heap);
 #ifdef CLOX_VARIABLE_STACK
     vm->stack = NULL;
+    vm->stackMax = NULL;
 #endif
     resetStack(vm);
     vm->freeList.head = NULL;
@@ -52,46 +106,193 @@ void initVM(VM* vm) {
     initTable(&vm->constGlobals);
 #endif
     initTable(&vm->strings);
+    vm->frozenStrings = NULL;
+#ifdef CLOX_PIPELINED_SCANNER
+    vm->pipelineThreshold = PIPELINE_THRESHOLD;
+#endif
+    vm->incremental = false;
+    vm->out = stdout;
+    vm->err = stderr;
+    vm->write = NULL;
+    vm->writeContext = NULL;
+    vm->output = NULL;
+    vm->outputCount = 0;
+    vm->outputCapacity = 0;
+    vm->flush = FLUSH_SIZE;
+#ifdef CLOX_PROFILE_OPS
+    vm->opProfile = NULL;
+#endif
+#ifdef CLOX_SAMPLING_PROFILER
+    vm->sampler = NULL;
+#endif
+#ifdef CLOX_EXECUTION_TRACE
+    vm->trace = NULL;
+#endif
+#ifdef CLOX_PERF_COUNTERS
+    vm->perf = NULL;
+#endif
+    vm->countInstructions = false;
+    vm->executed = 0;
+    vm->instructionLimit = 0;
+    vm->fuel = INT64_MAX;
+    vm->interrupted = 0;
+    vm->paused = NULL;
+    vm->emitted = 0;
+#ifdef CLOX_LIVE_STATS
+    vm->loopBytes = 0;
+    vm->fullFuel = INT64_MAX;
+    vm->stackHighWater = 0;
+#endif
+    vm->chunk = NULL;
+#ifdef CLOX_SNAPSHOT
+    vm->snapshot = NULL;
+    vm->snapshotSize = 0;
+#endif
+#ifdef CLOX_TABLE_STATS
+    for (int i = 0; i < VM_TABLE_COUNT; i++) {
+        initTableStats(&vm->tableStats[i], NULL);
+    }
+    vm->countTables = false;
+#endif
 }
 
 void freeVM(VM* vm) {
+    useHeap(&vm->heap);
+    flushOutput(vm);
+    FREE_ARRAY(char, vm->output, vm->outputCapacity, MEM_OUTPUT);
     freeObjects(&vm->freeList);
 #ifdef CLOX_VARIABLE_STACK
     size_t capacity = STACK_CAPACITY(vm);
-    FREE_ARRAY(Value, vm->stack, capacity);
+    FREE_ARRAY(Value, vm->stack, capacity, MEM_STACK);
 #endif
     freeTable(&vm->globals);
 #ifdef CLOX_CONST_KEYWORD
     freeTable(&vm->constGlobals);
 #endif
     freeTable(&vm->strings);
+#ifdef CLOX_SNAPSHOT
+    releaseSnapshot(vm);
+#endif
+#ifdef CLOX_EXECUTION_TRACE
+    disableTrace(vm);
+#endif
+    useHeap(NULL);
+}
+
+// Forgets everything scripts have defined, so the next one runs as if in a
+// new VM. Options, stats and allocations that can be reused are kept.
+// Reports when there is not enough memory left for a stack, which the next
+// run then tries again to allocate
+void resetVM(VM* vm) {
+    useHeap(&vm->heap);
+    flushOutput(vm);
+    discardPaused(vm);
+    freeObjects(&vm->freeList);
+    tableClear(&vm->globals);
+#ifdef CLOX_CONST_KEYWORD
+    tableClear(&vm->constGlobals);
+#endif
+    tableClear(&vm->strings);
+#ifdef CLOX_SNAPSHOT
+    releaseSnapshot(vm);
+#endif
+    if (!resetStack(vm)) {
+        fprintf(vm->err, "Out of memory.\n");
+    }
 }
 
+#ifdef CLOX_TABLE_STATS
+// Starts counting lookups and resizes in each of the VM's tables into
+// vm->tableStats
+void enableTableStats(VM* vm) {
+    initTableStats(&vm->tableStats[VM_TABLE_GLOBALS], "globals");
+    vm->globals.stats = &vm->tableStats[VM_TABLE_GLOBALS];
+#ifdef CLOX_CONST_KEYWORD
+    initTableStats(&vm->tableStats[VM_TABLE_CONST_GLOBALS], "constGlobals");
+    vm->constGlobals.stats = &vm->tableStats[VM_TABLE_CONST_GLOBALS];
+#endif
+    initTableStats(&vm->tableStats[VM_TABLE_STRINGS], "strings");
+    vm->strings.stats = &vm->tableStats[VM_TABLE_STRINGS];
+#ifdef CLOX_CONST_CACHE
+    // Attached to each chunk's table as it is compiled
+    initTableStats(&vm->tableStats[VM_TABLE_CONSTANTS], "constants");
+#endif
+    vm->countTables = true;
+}
+#endif
+
+#ifdef CLOX_EXECUTION_TRACE
+// Starts recording the last length instructions executed, which are
+// printed on a runtime error or by dumpTrace
+// Returns false for failed allocation
+bool enableTrace(VM* vm, size_t length) {
+    disableTrace(vm);
+    useHeap(&vm->heap);
+    Trace* trace = ALLOCATE(Trace, 1, false, MEM_TOOLS);
+    if (trace == NULL) {
+        return false;
+    }
+    if (!initTrace(trace, length)) {
+        FREE(Trace, trace, MEM_TOOLS);
+        return false;
+    }
+    vm->trace = trace;
+    return true;
+}
+
+void disableTrace(VM* vm) {
+    if (vm->trace != NULL) {
+        freeTrace(vm->trace);
+        FREE(Trace, vm->trace, MEM_TOOLS);
+        vm->trace = NULL;
+    }
+}
+
+// Prints the instructions recorded since the last call to interpret
+void dumpTrace(VM* vm, FILE* file) {
+    if (vm->trace != NULL) {
+        printTrace(vm->trace, vm->chunk, file);
+    }
+}
+#endif
+
 
 #ifdef CLOX_VARIABLE_STACK
-static void growStack(VM* vm) {
+// Returns false for failed allocation, leaving the stack as it was
+static bool growStack(VM* vm) {
     size_t position = STACK_POSITION(vm);
+#ifdef CLOX_LIVE_STATS
+    // The stack is full, so this is as deep as it has been since it last
+    // grew
+    if (position > vm->stackHighWater) {
+        vm->stackHighWater = position;
+    }
+#endif
     size_t capacity = STACK_CAPACITY(vm);
     size_t newCapacity = GROW_CAPACITY(capacity);
-    vm->stack = GROW_ARRAY(vm->stack, Value, capacity, newCapacity);
-    if (vm->stack == NULL) {
-        // Out of memory
-        // TODO handle error case
-        exit(100);
+    Value* stack = GROW_ARRAY(vm->stack, Value, capacity, newCapacity,
+        MEM_STACK);
+    if (stack == NULL) {
+        return false;
     }
+    vm->stack = stack;
     vm->stackTop = vm->stack + position;
     vm->stackMax = vm->stack + newCapacity;
+    return true;
 }
 #endif
 
-void push(VM* vm, Value value) {
+// Returns false if the stack is now full and could not be grown, in which
+// case the value was still pushed but nothing more can be
+bool push(VM* vm, Value value) {
     *vm->stackTop = value;
     vm->stackTop++;
 #ifdef CLOX_VARIABLE_STACK
     if (vm->stackTop == vm->stackMax) {
-        growStack(vm);
+        return growStack(vm);
     }
 #endif
+    return true;
 }
 
 Value pop(VM* vm) {
@@ -103,6 +304,7 @@ static Value peek(VM* vm, int distance) {
     return vm->stackTop[-1 - distance];
 }
 
+#ifndef CLOX_BIG_INTEGERS
 static Value negate(Value input) {
 #ifdef CLOX_INTEGER_TYPE
     if (IS_FLOAT(input)) {
@@ -115,336 +317,651 @@ static Value negate(Value input) {
     return FLOAT_VAL(-AS_FLOAT(input));
 #endif
 }
+#endif
+
+#ifdef CLOX_BIG_INTEGERS
+// Division has no int64_t result for a divisor of 0, or for INT64_MIN / -1
+static inline bool divideOverflows(int64_t a, int64_t b, int64_t* result) {
+    if (b == 0 || (b == -1 && a == INT64_MIN)) {
+        return true;
+    }
+    *result = a / b;
+    return false;
+}
+
+static bool isAnyNumber(Value value) {
+    return IS_NUMBER(value) || IS_BIGINT(value);
+}
+
+static double toFloat(Value value) {
+    if (IS_BIGINT(value)) {
+        return bigIntToFloat(AS_BIGINT(value));
+    }
+    return NUMBER_TO_FLOAT(value);
+}
+
+// The arithmetic instructions do what they can inline, and leave the rest
+// to these: big integers, int64_t results that overflow, and operands of the
+// wrong type
+// Each returns false after reporting a runtime error
+static bool arithmetic(VM* vm, BigOp op) {
+    Value b = peek(vm, 0);
+    Value a = peek(vm, 1);
+    if (!isAnyNumber(a) || !isAnyNumber(b)) {
+        runtimeError(vm, op == BIG_ADD ?
+            "Operands must be two numbers or two strings." :
+            "Operands must be numbers.");
+        return false;
+    }
+    Value result;
+    if (IS_FLOAT(a) || IS_FLOAT(b)) {
+        double vfloata = toFloat(a);
+        double vfloatb = toFloat(b);
+        switch (op) {
+            case BIG_ADD: result = FLOAT_VAL(vfloata + vfloatb); break;
+            case BIG_SUBTRACT: result = FLOAT_VAL(vfloata - vfloatb); break;
+            case BIG_MULTIPLY: result = FLOAT_VAL(vfloata * vfloatb); break;
+            default: result = FLOAT_VAL(vfloata / vfloatb); break;
+        }
+    }
+    else if (op == BIG_DIVIDE && IS_INT(b) && AS_INT(b) == 0) {
+        runtimeError(vm, "Integer division by zero.");
+        return false;
+    }
+    else if (!bigArithmetic(&vm->freeList, op, a, b, &result)) {
+        runtimeError(vm, "Out of memory.");
+        return false;
+    }
+    pop(vm);
+    pop(vm);
+    push(vm, result);
+    return true;
+}
+
+// Sets order to less than, equal to or greater than 0 as the first operand
+// is to the second, leaving them on the stack
+static bool compareNumbers(VM* vm, int* order) {
+    Value b = peek(vm, 0);
+    Value a = peek(vm, 1);
+    if (!isAnyNumber(a) || !isAnyNumber(b)) {
+        runtimeError(vm, "Operands must be numbers.");
+        return false;
+    }
+    if (IS_FLOAT(a) || IS_FLOAT(b)) {
+        // Neither less nor greater when either is NaN
+        double vfloata = toFloat(a);
+        double vfloatb = toFloat(b);
+        *order = (vfloata > vfloatb) - (vfloata < vfloatb);
+    }
+    else {
+        *order = bigCompare(a, b);
+    }
+    return true;
+}
+
+static bool negateNumber(VM* vm) {
+    Value value = peek(vm, 0);
+    if (IS_INT(value) && AS_INT(value) != INT64_MIN) {
+        vm->stackTop[-1] = INT_VAL(-AS_INT(value));
+    }
+    else if (IS_FLOAT(value)) {
+        vm->stackTop[-1] = FLOAT_VAL(-AS_FLOAT(value));
+    }
+    else if (!isAnyNumber(value)) {
+        runtimeError(vm, "Operand for negation must be a number.");
+        return false;
+    }
+    else if (!bigNegate(&vm->freeList, value, &vm->stackTop[-1])) {
+        runtimeError(vm, "Out of memory.");
+        return false;
+    }
+    return true;
+}
+#endif
 
 static bool isFalsey(Value value) {
     return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value));
 }
 
-static void concatenate(VM* vm) {
+// Returns false after reporting a runtime error
+static bool concatenate(VM* vm) {
     ObjString* b = AS_STRING(pop(vm));
     ObjString* a = AS_STRING(pop(vm));
     int length = a->length + b->length;
-    char* chars = ALLOCATE(char, length + 1, false);
+    char* chars = ALLOCATE(char, length + 1, false, MEM_STRING_CHARS);
+    if (chars == NULL) {
+        runtimeError(vm, "Out of memory.");
+        return false;
+    }
     memcpy(chars, a->chars, (size_t) a->length);
     memcpy(chars + a->length, b->chars, (size_t) b->length);
     chars[length] = '\0';
 
-    ObjString* result = takeString(&vm->freeList, &vm->strings, chars, length);
+    ObjString* result = takeString(&vm->freeList, &vm->strings,
+        vm->frozenStrings, chars, length);
+    if (result == NULL) {
+        runtimeError(vm, "Out of memory.");
+        return false;
+    }
     push(vm, OBJ_VAL(result));
+    return true;
 }
 
-static InterpretResult run(VM* vm) {
+// Returns room for length more bytes of output, flushing or growing the
+// buffer as vm->flush allows, or NULL if it cannot hold that much
+static char* reserveOutput(VM* vm, size_t length) {
+    if (vm->outputCapacity - vm->outputCount >= length) {
+        return vm->output + vm->outputCount;
+    }
+    if (vm->flush != FLUSH_EXIT) {
+        flushOutput(vm);
+    }
+    size_t capacity = vm->outputCapacity > 0 ? vm->outputCapacity :
+        OUTPUT_BUFFER_SIZE;
+    while (vm->flush == FLUSH_EXIT && capacity - vm->outputCount < length &&
+            capacity <= SIZE_MAX / 2) {
+        capacity *= 2;
+    }
+    if (capacity > vm->outputCapacity &&
+            capacity - vm->outputCount >= length) {
+        char* output = GROW_ARRAY(vm->output, char, vm->outputCapacity,
+            capacity, MEM_OUTPUT);
+        if (output != NULL) {
+            vm->output = output;
+            vm->outputCapacity = capacity;
+        }
+    }
+    if (vm->outputCapacity - vm->outputCount < length) {
+        // Out of memory, or too long to buffer at all
+        flushOutput(vm);
+        if (vm->outputCapacity < length) {
+            return NULL;
+        }
+    }
+    return vm->output + vm->outputCount;
+}
 
-// Reads
-#define READ_BYTE() (*vm->ip++)
-#define READ_CONSTANT() (vm->chunk->constants.values[READ_BYTE()])
-#define READ_SHORT() (vm->ip += 2, \
-    (uint16_t)(COMBINE_2WORD(vm->ip[-2], vm->ip[-1])))
-#define READ_LONG_BYTE() (vm->ip += 3, \
-    (size_t)(COMBINE_3WORD(vm->ip[-3], vm->ip[-2], vm->ip[-1])))
-#define READ_LONG_CONSTANT() (vm->chunk->constants.values[READ_LONG_BYTE()])
-#define READ_STRING() AS_STRING(READ_CONSTANT())
-#define READ_LONG_STRING() AS_STRING(READ_LONG_CONSTANT())
+static void writeOutput(VM* vm, const char* text, size_t length) {
+    char* space = reserveOutput(vm, length);
+    if (space != NULL) {
+        memcpy(space, text, length);
+        vm->outputCount += length;
+    }
+    else if (vm->write != NULL) {
+        vm->write(vm->writeContext, text, length);
+    }
+    else {
+        fwrite(text, 1, length, vm->out);
+    }
+}
 
-// Operations
-#define PUSH(value) (push(vm, (value)))
-#define POP() (pop(vm))
-#define PEEK(value) (peek(vm, (value)))
-#ifdef CLOX_INTEGER_TYPE
-    #define BINARY_OP(fn1, fn2, op, divide) \
-        do { \
-            if (!IS_NUMBER(PEEK(0)) || !IS_NUMBER(PEEK(1))) { \
-                runtimeError(vm, "Operands must be numbers."); \
-                return INTERPRET_RUNTIME_ERROR; \
-            } \
-            Value b = POP(); \
-            Value a = POP(); \
-            if (IS_FLOAT(b) || IS_FLOAT(a)) { \
-                PUSH(fn1( \
-                    NUMBER_TO_FLOAT(a) op \
-                    NUMBER_TO_FLOAT(b) \
-                )); \
-            } \
-            else { \
-                int64_t vintb = AS_INT(b); \
-                if ((divide) && vintb == 0) { \
-                    runtimeError(vm, "Integer division by zero."); \
-                    return INTERPRET_RUNTIME_ERROR; \
-                } \
-                int64_t vinta = AS_INT(a); \
-                PUSH(fn2(vinta op vintb)); \
-            } \
-        } while(false)
-    #define BINARY_OP_NUMBER(op) BINARY_OP(FLOAT_VAL, INT_VAL, op, false)
-    #define BINARY_OP_BOOL(op) BINARY_OP(BOOL_VAL, BOOL_VAL, op, false)
-    #define BINARY_OP_DIVIDE(op) BINARY_OP(FLOAT_VAL, INT_VAL, op, true)
-#else
-    #define BINARY_OP(fn, op) \
-    do { \
-        if (!IS_NUMBER(PEEK(0)) || !IS_NUMBER(PEEK(1))) { \
-            runtimeError(vm, "Operands must be numbers."); \
-            return INTERPRET_RUNTIME_ERROR; \
-        } \
-        Value b = POP(); \
-        Value a = POP(); \
-        PUSH(fn(AS_FLOAT(a) op AS_FLOAT(b))); \
-    } while(false)
-    #define BINARY_OP_NUMBER(op) BINARY_OP(FLOAT_VAL, op)
-    #define BINARY_OP_BOOL(op) BINARY_OP(BOOL_VAL, op)
-    #define BINARY_OP_DIVIDE(op) BINARY_OP_NUMBER(op)
-#endif
-
-    // Begin VM Loop
-    while(1) {
-#ifdef DEBUG_TRACE_EXECUTION
-        // Print execution trace
-        printf("          ");
-        for (Value* slot = vm->stack; slot < vm->stackTop; slot++) {
-            printf("[ ");
-            printValue(*slot);
-            printf(" ]");
+// Prints value and a newline for a print statement
+// Returns false after reporting a runtime error
+static bool printStatement(VM* vm, Value value) {
+    if (IS_STRING(value)) {
+        writeOutput(vm, AS_CSTRING(value), (size_t)AS_STRING(value)->length);
+        writeOutput(vm, "\n", 1);
+    }
+#ifdef CLOX_BIG_INTEGERS
+    else if (IS_BIGINT(value)) {
+        ObjBigInt* big = AS_BIGINT(value);
+        size_t size = bigIntTextSize(big);
+        char* text = ALLOCATE(char, size, false, MEM_BIG_INTEGERS);
+        int length = text == NULL ? -1 : formatBigInt(text, big);
+        if (length >= 0) {
+            text[length] = '\n';
+            writeOutput(vm, text, (size_t)length + 1);
         }
-        printf("\n");
-        disassembleInstruction(vm->chunk, (size_t)(vm->ip - vm->chunk->code));
-#endif
-        uint8_t instruction;
-        bool longConstant = true;
-        switch (instruction = READ_BYTE()) {
-            case OP_CONSTANT:
-                longConstant = false;
-                // fall through
-            case OP_CONSTANT_LONG: {
-                Value constant;
-                if (longConstant) {
-                    constant = READ_LONG_CONSTANT();
-                }
-                else {
-                    constant = READ_CONSTANT();
-                }
-                PUSH(constant);
-                break;
-            }
-            case OP_DEFINE_GLOBAL:
-                longConstant = false;
-                // fall through
-            case OP_DEFINE_GLOBAL_LONG: {
-                ObjString* name;
-                if (longConstant) {
-                    name = READ_LONG_STRING();
-                }
-                else {
-                    name = READ_STRING();
-                }
+        FREE_ARRAY(char, text, size, MEM_BIG_INTEGERS);
+        if (length < 0) {
+            runtimeError(vm, "Out of memory.");
+            return false;
+        }
+    }
+#endif
+    else {
+        char text[VALUE_TEXT_SIZE + 1];
+        int length = formatValue(text, VALUE_TEXT_SIZE, value);
+        text[length] = '\n';
+        writeOutput(vm, text, (size_t)length + 1);
+    }
+    if (vm->flush == FLUSH_LINE) {
+        flushOutput(vm);
+    }
+    return true;
+}
+
+// Instructions with an OP_WIDE form share these, so that the two forms only
+// differ in how they read their operand
+// Each returns false after reporting a runtime error
+static bool defineGlobal(VM* vm, ObjString* name) {
 #ifdef CLOX_CONST_KEYWORD
-                Value placeholder;
-                if (tableGet(&vm->constGlobals, OBJ_VAL(name), &placeholder)) {
-                    runtimeError(vm,
-                        "Cannot declare global variable with the same name as "
-                        "global const '%s'.",
-                        name->chars);
-                    return INTERPRET_RUNTIME_ERROR;
-                }
-#endif
-                tableSet(&vm->globals, OBJ_VAL(name), PEEK(0));
-                POP();
-                break;
-            }
-            case OP_DEFINE_GLOBAL_CONST:
-                longConstant = false;
-                // fall through
-            case OP_DEFINE_GLOBAL_CONST_LONG: {
-                ObjString* name;
-                if (longConstant) {
-                    name = READ_LONG_STRING();
-                }
-                else {
-                    name = READ_STRING();
-                }
+    Value placeholder;
+    if (tableGet(&vm->constGlobals, OBJ_VAL(name), &placeholder)) {
+        runtimeError(vm,
+            "Cannot declare global variable with the same name as "
+            "global const '%s'.",
+            name->chars);
+        return false;
+    }
+#endif
+    if (tableSet(&vm->globals, OBJ_VAL(name), peek(vm, 0)) < 0) {
+        runtimeError(vm, "Out of memory.");
+        return false;
+    }
+    pop(vm);
+    return true;
+}
+
+static bool defineGlobalConst(VM* vm, ObjString* name) {
 #ifdef CLOX_CONST_KEYWORD
-                Value placeholder;
-                if (tableGet(&vm->constGlobals, OBJ_VAL(name), &placeholder)) {
-                    runtimeError(vm,
-                        "Cannot declare global const with the same name as "
-                        "global const '%s'.",
-                        name->chars);
-                    return INTERPRET_RUNTIME_ERROR;
-                }
-#endif
-                tableSet(&vm->globals, OBJ_VAL(name), PEEK(0));
+    Value placeholder;
+    if (tableGet(&vm->constGlobals, OBJ_VAL(name), &placeholder)) {
+        runtimeError(vm,
+            "Cannot declare global const with the same name as "
+            "global const '%s'.",
+            name->chars);
+        return false;
+    }
+#endif
+    if (tableSet(&vm->globals, OBJ_VAL(name), peek(vm, 0)) < 0) {
+        runtimeError(vm, "Out of memory.");
+        return false;
+    }
 #ifdef CLOX_CONST_KEYWORD
-                tableSet(&vm->constGlobals, OBJ_VAL(name), NIL_VAL);
-#endif
-                POP();
-                break;
-            }
-            case OP_GET_GLOBAL:
-                longConstant = false;
-                // fall through
-            case OP_GET_GLOBAL_LONG: {
-                ObjString* name;
-                if (longConstant) {
-                    name = READ_LONG_STRING();
-                }
-                else {
-                    name = READ_STRING();
-                }
-                Value value;
-                if (!tableGet(&vm->globals, OBJ_VAL(name), &value)) {
-                    runtimeError(vm, "Undefined variable %s.", name->chars);
-                    return INTERPRET_RUNTIME_ERROR;
-                }
-                PUSH(value);
-                break;
-            }
-            case OP_SET_GLOBAL:
-                longConstant = false;
-                // fall through
-            case OP_SET_GLOBAL_LONG: {
-                ObjString* name;
-                if (longConstant) {
-                    name = READ_LONG_STRING();
-                }
-                else {
-                    name = READ_STRING();
-                }
+    if (tableSet(&vm->constGlobals, OBJ_VAL(name), NIL_VAL) < 0) {
+        tableDelete(&vm->globals, OBJ_VAL(name));
+        runtimeError(vm, "Out of memory.");
+        return false;
+    }
+#endif
+    pop(vm);
+    return true;
+}
+
+static bool getGlobal(VM* vm, ObjString* name) {
+    Value value;
+    if (!tableGet(&vm->globals, OBJ_VAL(name), &value)) {
+        runtimeError(vm, "Undefined variable %s.", name->chars);
+        return false;
+    }
+    if (!push(vm, value)) {
+        runtimeError(vm, "Out of memory.");
+        return false;
+    }
+    return true;
+}
+
+static bool setGlobal(VM* vm, ObjString* name) {
 #ifdef CLOX_CONST_KEYWORD
-                Value placeholder;
-                if (tableGet(&vm->constGlobals, OBJ_VAL(name), &placeholder)) {
-                    runtimeError(vm,
-                        "Cannot overwrite the value of the global const '%s'.",
-                        name->chars);
-                    return INTERPRET_RUNTIME_ERROR;
-                }
-#endif
-                if (tableSet(&vm->globals, OBJ_VAL(name), PEEK(0))) {
-                    tableDelete(&vm->globals, OBJ_VAL(name));
-                    runtimeError(vm, "Undefined variable '%s'.", name->chars);
-                    return INTERPRET_RUNTIME_ERROR;
-                }
-                break;
-            }
-            case OP_GET_LOCAL:
-                longConstant = false;
-                // fall through
-            case OP_GET_LOCAL_LONG: {
-                size_t slot;
-                if (longConstant) {
-                    slot = READ_LONG_BYTE();
-                }
-                else {
-                    slot = READ_BYTE();
-                }
-                PUSH(vm->stack[slot]);
-                break;
-            }
-            case OP_SET_LOCAL:
-                longConstant = false;
-                // fall through
-            case OP_SET_LOCAL_LONG: {
-                size_t slot;
-                if (longConstant) {
-                    slot = READ_LONG_BYTE();
-                }
-                else {
-                    slot = READ_BYTE();
-                }
-                vm->stack[slot] = PEEK(0);
-                break;
-            }
-            case OP_NIL:   PUSH(NIL_VAL); break;
-            case OP_TRUE:  PUSH(BOOL_VAL(true)); break;
-            case OP_FALSE: PUSH(BOOL_VAL(false)); break;
-            case OP_POP:   POP(); break;
-            case OP_EQUAL: {
-                Value b = POP();
-                Value a = POP();
-                PUSH(BOOL_VAL(valuesEqual(a, b)));
-                break;
-            }
-            case OP_GREATER:  BINARY_OP_BOOL(>); break;
-            case OP_LESS:     BINARY_OP_BOOL(<); break;
-            case OP_ADD:      {
-                Value peek0 = PEEK(0);
-                Value peek1 = PEEK(1);
-                if (IS_STRING(peek0) && IS_STRING(peek1)) {
-                    concatenate(vm);
-                }
-                else if (IS_NUMBER(peek0) && IS_NUMBER(peek1)) {
-                    BINARY_OP_NUMBER(+);
-                }
-                else {
-                    runtimeError(vm,
-                        "Operands must be two numbers or two strings.");
-                    return INTERPRET_RUNTIME_ERROR;
-                }
-                break;
-            }
-            case OP_SUBTRACT: BINARY_OP_NUMBER(-); break;
-            case OP_MULTIPLY: BINARY_OP_NUMBER(*); break;
-            case OP_DIVIDE:   BINARY_OP_DIVIDE(/); break;
-            case OP_NOT: PUSH(BOOL_VAL(isFalsey(POP()))); break;
-            case OP_NEGATE:
-                if (!IS_NUMBER(PEEK(0))) {
-                    runtimeError(vm, "Operand for negation must be a number.");
-                    return INTERPRET_RUNTIME_ERROR;
-                }
-                PUSH(negate(POP())); break;
-            case OP_PRINT: {
-                printValue(POP());
-                printf("\n");
-                break;
-            }
-            case OP_JUMP: {
-                uint16_t offset = READ_SHORT();
-                vm->ip += offset;
-                break;
-            }
-            case OP_JUMP_IF_FALSE: {
-                uint16_t offset = READ_SHORT();
-                if (isFalsey(PEEK(0))) {
-                    vm->ip += offset;
-                }
-                break;
-            }
-            case OP_LOOP: {
-                uint16_t offset = READ_SHORT();
-                vm->ip -= offset;
-                break;
-            }
-            case OP_RETURN: {
-                // Exit interpreter
-                return INTERPRET_OK;
-            }
+    Value placeholder;
+    if (tableGet(&vm->constGlobals, OBJ_VAL(name), &placeholder)) {
+        runtimeError(vm,
+            "Cannot overwrite the value of the global const '%s'.",
+            name->chars);
+        return false;
+    }
+#endif
+    int isNewKey = tableSet(&vm->globals, OBJ_VAL(name), peek(vm, 0));
+    if (isNewKey < 0) {
+        runtimeError(vm, "Out of memory.");
+        return false;
+    }
+    if (isNewKey) {
+        tableDelete(&vm->globals, OBJ_VAL(name));
+        runtimeError(vm, "Undefined variable '%s'.", name->chars);
+        return false;
+    }
+    return true;
+}
+
+// Spends offset of the run's fuel on a jump back by OP_LOOP
+// Returns true if the run must pause, as it has run out or has been
+// interrupted
+static inline bool spendFuel(VM* vm, size_t offset) {
+    vm->fuel -= (int64_t)offset;
+    return vm->fuel < 0 || __atomic_load_n(&vm->interrupted, __ATOMIC_RELAXED);
+}
+
+// Why the run is pausing, clearing the interrupt it answers
+static InterpretResult pauseResult(VM* vm) {
+    if (__atomic_exchange_n(&vm->interrupted, 0, __ATOMIC_RELAXED)) {
+        return INTERPRET_INTERRUPTED;
+    }
+    return INTERPRET_BUDGET_EXCEEDED;
+}
+
+static bool isPause(InterpretResult result) {
+    return result == INTERPRET_BUDGET_EXCEEDED ||
+        result == INTERPRET_INTERRUPTED;
+}
+
+// Ends a paused run as a runtime error would
+static void reportPause(VM* vm, InterpretResult result) {
+    runtimeError(vm, result == INTERPRET_INTERRUPTED ?
+        "Interrupted." : "Instruction limit exceeded.");
+}
+
+// Gives a new or resumed run its full fuel
+static void refuel(VM* vm) {
+#ifdef CLOX_LIVE_STATS
+    vm->loopBytes += (uint64_t)vm->fullFuel - (uint64_t)vm->fuel;
+#endif
+    vm->fuel = vm->instructionLimit == 0 ||
+        vm->instructionLimit > (uint64_t)INT64_MAX ?
+        INT64_MAX : (int64_t)vm->instructionLimit;
+#ifdef CLOX_LIVE_STATS
+    vm->fullFuel = vm->fuel;
+#endif
+}
+
+#define RUN_NAME run
+#include "run.h"
+#undef RUN_NAME
+
+// The other variants are only used while their feature is on, so that the
+// normal loop pays nothing for them. All of them count instructions.
+#define RUN_COUNT
+#define RUN_NAME runCounted
+#include "run.h"
+#undef RUN_NAME
+
+#ifdef CLOX_PROFILE_OPS
+#define RUN_NAME runProfiled
+#define RUN_PROFILE_OPS
+#include "run.h"
+#undef RUN_NAME
+#undef RUN_PROFILE_OPS
+#endif
+
+#ifdef CLOX_EXECUTION_TRACE
+#define RUN_NAME runTraced
+#define RUN_TRACE
+#include "run.h"
+#undef RUN_NAME
+
+#ifdef CLOX_PROFILE_OPS
+#define RUN_NAME runProfiledTraced
+#define RUN_PROFILE_OPS
+#include "run.h"
+#undef RUN_NAME
+#undef RUN_PROFILE_OPS
+#endif
+#undef RUN_TRACE
+#endif
+#undef RUN_COUNT
+
+// Runs the variant of the dispatch loop that matches the VM's options
+static InterpretResult dispatch(VM* vm) {
+#ifdef CLOX_EXECUTION_TRACE
+    if (vm->trace != NULL) {
+#ifdef CLOX_PROFILE_OPS
+        if (vm->opProfile != NULL) {
+            return runProfiledTraced(vm);
         }
+#endif
+        return runTraced(vm);
+    }
+#endif
+#ifdef CLOX_PROFILE_OPS
+    if (vm->opProfile != NULL) {
+        return runProfiled(vm);
+    }
+#endif
+    if (vm->countInstructions) {
+        return runCounted(vm);
+    }
+    return run(vm);
+}
+
+static InterpretResult runBatch(VM* vm, Chunk* chunk, size_t start) {
+#ifdef CLOX_VARIABLE_STACK
+    if (vm->stack == NULL && !resetStack(vm)) {
+        // Allocating the stack failed the last time it was reset
+        fprintf(vm->err, "Out of memory.\n");
+        return INTERPRET_RUNTIME_ERROR;
+    }
+#endif
+    vm->chunk = chunk;
+    vm->ip = vm->chunk->code + start;
+
+#ifdef CLOX_SAMPLING_PROFILER
+    if (vm->sampler != NULL) {
+        vm->sampler->code = chunk->code;
+        vm->sampler->running = 1;
+    }
+#endif
+
+#ifdef CLOX_PERF_COUNTERS
+    PerfPhase phase = PERF_PHASE_NONE;
+    if (vm->perf != NULL) {
+        phase = enterPerfPhase(vm->perf, PERF_PHASE_RUN);
+    }
+#endif
+#ifdef CLOX_PROFILE_OPS
+    if (vm->opProfile != NULL) {
+        startOpSample(vm->opProfile);
+    }
+#endif
+    InterpretResult result = dispatch(vm);
+#ifdef CLOX_PROFILE_OPS
+    if (vm->opProfile != NULL) {
+        stopOpSample(vm->opProfile);
+    }
+#endif
+#ifdef CLOX_PERF_COUNTERS
+    if (vm->perf != NULL) {
+        enterPerfPhase(vm->perf, phase);
+    }
+#endif
+
+#ifdef CLOX_SAMPLING_PROFILER
+    if (vm->sampler != NULL) {
+        vm->sampler->running = 0;
     }
-#undef READ_BYTE
-#undef READ_CONSTANT
-#undef READ_SHORT
-#undef READ_LONG_BYTE
-#undef READ_LONG_CONSTANT
-#undef READ_STRING
-#undef READ_LONG_STRING
-#undef PUSH
-#undef POP
-#undef BINARY_OP
-#undef DEFINE_GLOBAL
-#undef GET_CONSTANT
+#endif
+    flushOutput(vm);
+    return result;
+}
+
+static InterpretResult finishInterpret(VM* vm, Chunk* chunk,
+        InterpretResult result) {
+#ifdef CLOX_PERF_COUNTERS
+    if (vm->perf != NULL) {
+        enterPerfPhase(vm->perf, PERF_PHASE_NONE);
+    }
+#endif
+    if (result == INTERPRET_OK && !vm->incremental) {
+        result = runBatch(vm, chunk, 0);
+    }
+    if (isPause(result)) {
+        // The chunk is freed below, so the run cannot be resumed
+        reportPause(vm, result);
+    }
+#ifdef CLOX_SAMPLING_PROFILER
+    if (vm->sampler != NULL) {
+        resolveSamples(vm->sampler, chunk);
+    }
+#endif
+    vm->emitted += chunk->count;
+    freeChunk(chunk);
+    vm->chunk = NULL;
+    PROBE1(interpret__end, (int)result);
+    return result;
+}
+
+// Gets the VM ready to run a new chunk
+static void startInterpret(VM* vm, Chunk* chunk) {
+    PROBE0(interpret__start);
+    useHeap(&vm->heap);
+    discardPaused(vm);
+    refuel(vm);
+    __atomic_store_n(&vm->interrupted, 0, __ATOMIC_RELAXED);
+    initChunk(chunk);
+#if defined(CLOX_TABLE_STATS) && defined(CLOX_CONST_CACHE)
+    if (vm->countTables) {
+        chunk->constantTable.stats = &vm->tableStats[VM_TABLE_CONSTANTS];
+    }
+#endif
+#ifdef CLOX_EXECUTION_TRACE
+    if (vm->trace != NULL) {
+        resetTrace(vm->trace);
+    }
+#endif
+#ifdef CLOX_PERF_COUNTERS
+    if (vm->perf != NULL) {
+        enterPerfPhase(vm->perf, PERF_PHASE_COMPILE);
+    }
+#endif
 }
 
 InterpretResult interpret(VM* vm, const char* source) {
     Chunk chunk;
-    initChunk(&chunk);
+    startInterpret(vm, &chunk);
+
+    InterpretResult result = compile(vm, source, &chunk, &vm->strings,
+        &vm->freeList, vm->incremental ? runBatch : NULL);
+    return finishInterpret(vm, &chunk, result);
+}
+
+#ifdef CLOX_STREAMING_SOURCE
+InterpretResult interpretFile(VM* vm, FILE* file) {
+    Chunk chunk;
+    startInterpret(vm, &chunk);
+
+    InterpretResult result = compileFile(vm, file, &chunk, &vm->strings,
+        &vm->freeList, vm->incremental ? runBatch : NULL);
+    return finishInterpret(vm, &chunk, result);
+}
+#endif
+
+// Gets program ready to be compiled into, counting what it allocates in
+// its own heap, held to the same limit as the VM's
+static void startProgram(VM* vm, Program* program) {
+    initHeap(&program->heap);
+    program->heap.limit = vm->heap.limit;
+    useHeap(&program->heap);
+    initChunk(&program->chunk);
+    initTable(&program->strings);
+    program->objects.head = NULL;
+#ifdef CLOX_PERF_COUNTERS
+    if (vm->perf != NULL) {
+        enterPerfPhase(vm->perf, PERF_PHASE_COMPILE);
+    }
+#endif
+}
 
-    if (!compile(vm, source, &chunk)) {
-        freeChunk(&chunk);
-        return INTERPRET_COMPILE_ERROR;
+static InterpretResult finishProgram(VM* vm, Program* program,
+        InterpretResult result) {
+#ifdef CLOX_PERF_COUNTERS
+    if (vm->perf != NULL) {
+        enterPerfPhase(vm->perf, PERF_PHASE_NONE);
+    }
+#endif
+#ifdef CLOX_CONST_CACHE
+    // Only needed to add constants
+    freeTable(&program->chunk.constantTable);
+#endif
+    if (result != INTERPRET_OK) {
+        freeProgram(program);
     }
-    
-    vm->chunk = &chunk;
-    vm->ip = vm->chunk->code;
+    useHeap(&vm->heap);
+    return result;
+}
 
-    InterpretResult result = run(vm);
+// Compiles source into program, which is only freed here if it cannot be
+// compiled. vm is only used for its options and to report errors.
+InterpretResult compileProgram(VM* vm, Program* program, const char* source) {
+    startProgram(vm, program);
+    InterpretResult result = compile(vm, source, &program->chunk,
+        &program->strings, &program->objects, NULL);
+    return finishProgram(vm, program, result);
+}
 
-    freeChunk(&chunk);
+#ifdef CLOX_STREAMING_SOURCE
+InterpretResult compileProgramFile(VM* vm, Program* program, FILE* file) {
+    startProgram(vm, program);
+    InterpretResult result = compileFile(vm, file, &program->chunk,
+        &program->strings, &program->objects, NULL);
+    return finishProgram(vm, program, result);
+}
+#endif
+
+// Must only be called once every VM that has run the program has been
+// reset or freed, as their globals can be named by, or hold, its strings
+void freeProgram(Program* program) {
+    Heap* previous = useHeap(&program->heap);
+    freeChunk(&program->chunk);
+    freeObjects(&program->objects);
+    freeTable(&program->strings);
+    useHeap(previous);
+}
+
+// Runs program from start with full fuel, keeping what is needed to
+// resume it if it pauses
+static InterpretResult continueProgram(VM* vm, Program* program,
+        size_t start) {
+    useHeap(&vm->heap);
+    refuel(vm);
+    vm->paused = NULL;
+    vm->frozenStrings = &program->strings;
+    InterpretResult result = runBatch(vm, &program->chunk, start);
+#ifdef CLOX_SAMPLING_PROFILER
+    if (vm->sampler != NULL) {
+        resolveSamples(vm->sampler, &program->chunk);
+    }
+#endif
+    if (isPause(result)) {
+        vm->paused = program;
+    }
+    else {
+        vm->frozenStrings = NULL;
+        vm->chunk = NULL;
+    }
+    PROBE1(interpret__end, (int)result);
     return result;
+}
+
+// Runs a compiled program without copying any of it, giving up on any run
+// that had paused
+InterpretResult runProgram(VM* vm, Program* program) {
+    PROBE0(interpret__start);
+    discardPaused(vm);
+    __atomic_store_n(&vm->interrupted, 0, __ATOMIC_RELAXED);
+#ifdef CLOX_EXECUTION_TRACE
+    if (vm->trace != NULL) {
+        resetTrace(vm->trace);
+    }
+#endif
+    vm->emitted += program->chunk.count;
+    return continueProgram(vm, program, 0);
+}
+
+// Continues a run of a program that paused from where it stopped, with
+// full fuel again
+// Returns INTERPRET_OK if no run has paused
+InterpretResult resumeProgram(VM* vm) {
+    Program* program = vm->paused;
+    if (program == NULL) {
+        return INTERPRET_OK;
+    }
+    PROBE0(interpret__start);
+    return continueProgram(vm, program,
+        (size_t)(vm->ip - program->chunk.code));
+}
+
+// Ends a run of a program that paused with result, reporting why as a
+// runtime error would
+void abandonProgram(VM* vm, InterpretResult result) {
+    if (vm->paused != NULL) {
+        reportPause(vm, result);
+        discardPaused(vm);
+    }
+}
+
+// Makes the run in progress pause at its next loop with
+// INTERPRET_INTERRUPTED. Safe to call from any thread or signal handler.
+// An interrupt while nothing runs is forgotten when the next run starts.
+void interruptVM(VM* vm) {
+    __atomic_store_n(&vm->interrupted, 1, __ATOMIC_RELAXED);
 }
\ No newline at end of file
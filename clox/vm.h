@@ -1,11 +1,18 @@
 #ifndef clox_vm_h
 #define clox_vm_h
 
+#include <stdio.h>
+
 #include "object.h"
 #include "chunk.h"
 #include "value.h"
 #include "settings.h"
 #include "table.h"
+#include "profile.h"
+#include "sampler.h"
+#include "trace.h"
+#include "perf.h"
+#include "memory.h"
 
 #define STACK_DEFAULT 256
 
@@ -17,6 +24,42 @@
     (size_t)((vm->stackMax)-(vm->stack))
 #endif
 
+#ifdef CLOX_TABLE_STATS
+// The kinds of table a VM uses, each counted separately
+typedef enum {
+    VM_TABLE_GLOBALS,
+    VM_TABLE_CONST_GLOBALS,
+    VM_TABLE_STRINGS,
+    // Constant tables of every chunk compiled
+    VM_TABLE_CONSTANTS,
+    VM_TABLE_COUNT
+} VMTable;
+#endif
+
+// A script compiled once, for any number of VMs to run at the same time,
+// on any threads. Nothing in it changes after compileProgram.
+typedef struct {
+    Chunk chunk;
+    // The strings among the chunk's constants, interned apart from any VM
+    Table strings;
+    FreeList objects;
+    // Everything the program allocates is counted here
+    Heap heap;
+} Program;
+
+// Receives length bytes of text, which are not terminated
+typedef void (*WriteFn)(void* context, const char* text, size_t length);
+
+// When what print statements write leaves the VM's buffer for write or
+// out. All of it has left by the time a run returns or reports an error.
+typedef enum {
+    FLUSH_LINE,  // After each print statement
+    FLUSH_SIZE,  // Whenever OUTPUT_BUFFER_SIZE bytes have built up
+    FLUSH_EXIT   // Only as the run returns, growing the buffer as needed
+} FlushPolicy;
+
+#define OUTPUT_BUFFER_SIZE 8192
+
 typedef struct {
     Chunk* chunk;
     uint8_t* ip;
@@ -26,6 +69,9 @@ typedef struct {
     Table constGlobals;
 #endif
     Table strings;
+    // Strings of the program being run, looked up before strings so that
+    // strings made at runtime are the same objects as its constants
+    Table* frozenStrings;
     FreeList freeList;
 #ifdef CLOX_VARIABLE_STACK
     Value* stack;
@@ -33,18 +79,122 @@ typedef struct {
 #else
     Value stack[STACK_DEFAULT];
 #endif
+#ifdef CLOX_PIPELINED_SCANNER
+    // Sources at least this many bytes long are scanned on a second thread
+    size_t pipelineThreshold;
+#endif
+    // Run top-level code as soon as it is compiled instead of waiting for
+    // the whole source
+    bool incremental;
+    // Where print statements and errors go, stdout and stderr by default
+    FILE* out;
+    FILE* err;
+    // What print statements write is handed to write instead of out when
+    // it is not NULL
+    WriteFn write;
+    void* writeContext;
+    // Output of print statements waiting to be written
+    char* output;
+    size_t outputCount;
+    size_t outputCapacity;
+    FlushPolicy flush;
+#ifdef CLOX_PROFILE_OPS
+    // Per-opcode counts and times are collected here when not NULL
+    OpProfile* opProfile;
+#endif
+#ifdef CLOX_SAMPLING_PROFILER
+    // Told where the VM is running when not NULL
+    Sampler* sampler;
+#endif
+#ifdef CLOX_EXECUTION_TRACE
+    // Recently executed instructions are kept here when not NULL
+    Trace* trace;
+#endif
+#ifdef CLOX_PERF_COUNTERS
+    // Compiling and running are counted separately here when not NULL
+    PerfCounters* perf;
+#endif
+    // Count every instruction executed into executed. Always done while
+    // profiling or tracing.
+    bool countInstructions;
+    uint64_t executed;
+    // Fuel each run or resumed run starts with, 0 for no limit. A run
+    // pauses with INTERPRET_BUDGET_EXCEEDED once it has used it all.
+    uint64_t instructionLimit;
+    // Fuel left to the current run, spent at each OP_LOOP on the bytes of
+    // bytecode it jumps back over, which is at least the instructions run
+    // by the loop. Code without loops cannot run longer than it is, so
+    // nothing else has to be checked.
+    int64_t fuel;
+    // Set by interruptVM from any thread or signal handler, and checked
+    // with the fuel
+    int interrupted;
+    // The program whose run has paused, which resumeProgram continues
+    Program* paused;
+    // Bytes of bytecode compiled by every call to interpret, or run by
+    // every call to runProgram
+    uint64_t emitted;
+#ifdef CLOX_LIVE_STATS
+    // Bytes of bytecode jumped back over by OP_LOOP in earlier runs, which
+    // stands in for the bytecode run by loops. The current run's share is
+    // the fuel it has spent, so loops pay nothing extra for it.
+    uint64_t loopBytes;
+    // Fuel the current run started with
+    int64_t fullFuel;
+    // Deepest the stack has been when it grew or when livestats.c took a
+    // snapshot
+    size_t stackHighWater;
+#endif
+#ifdef CLOX_SNAPSHOT
+    // Image mapped by loadSnapshot until the VM is reset or freed. Its
+    // strings are in strings but not freeList, and not counted in heap.
+    void* snapshot;
+    size_t snapshotSize;
+#endif
+    // Everything the VM allocates is counted here, and held to its limit
+    Heap heap;
+#ifdef CLOX_TABLE_STATS
+    // Counters for each kind of table, used after enableTableStats
+    TableStats tableStats[VM_TABLE_COUNT];
+    bool countTables;
+#endif
 } VM;
 
 typedef enum {
     INTERPRET_OK,
     INTERPRET_COMPILE_ERROR,
-    INTERPRET_RUNTIME_ERROR
+    INTERPRET_RUNTIME_ERROR,
+    // The run paused as it ran out of fuel, or was interrupted. Runs of a
+    // program can be resumed, others are ended as by a runtime error.
+    INTERPRET_BUDGET_EXCEEDED,
+    INTERPRET_INTERRUPTED
 } InterpretResult;
 
 void initVM(VM *vm);
 void freeVM(VM *vm);
+void resetVM(VM *vm);
 InterpretResult interpret(VM *vm, const char* source);
-void push(VM *vm, Value value);
+#ifdef CLOX_STREAMING_SOURCE
+InterpretResult interpretFile(VM *vm, FILE* file);
+#endif
+InterpretResult compileProgram(VM* vm, Program* program, const char* source);
+#ifdef CLOX_STREAMING_SOURCE
+InterpretResult compileProgramFile(VM* vm, Program* program, FILE* file);
+#endif
+void freeProgram(Program* program);
+InterpretResult runProgram(VM* vm, Program* program);
+InterpretResult resumeProgram(VM* vm);
+void abandonProgram(VM* vm, InterpretResult result);
+void interruptVM(VM* vm);
+#ifdef CLOX_EXECUTION_TRACE
+bool enableTrace(VM* vm, size_t length);
+void disableTrace(VM* vm);
+void dumpTrace(VM* vm, FILE* file);
+#endif
+#ifdef CLOX_TABLE_STATS
+void enableTableStats(VM* vm);
+#endif
+bool push(VM *vm, Value value);
 Value pop(VM *vm);
 
 #endif
\ No newline at end of file